@@ -0,0 +1,627 @@
+// SimpleOscilloscope のキャプチャ処理と、 GUI スレッドへのデータの受け渡し処理のベンチマーク
+//
+// 結果は一つの計測ごとに一行の JSON として標準出力に出力する。
+//
+// usage: SimpleOscilloscopeBench [--quick] [--filter <name>]
+
+#include "PluginProcessor.h"
+#include "BiquadCascade.h"
+#include "CaptureReader.h"
+#include "Goniometer.h"
+#include "LevelMeter.h"
+#include "RingBuffer.h"
+#include "SimdKernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+// アロケーションの回数を数えるために、グローバルな operator new / delete を置き換える。
+
+namespace
+{
+    std::atomic<std::int64_t> g_num_allocations { 0 };
+    thread_local bool t_count_allocations = false;
+}
+
+void * operator new(std::size_t size)
+{
+    if(t_count_allocations) { g_num_allocations.fetch_add(1, std::memory_order_relaxed); }
+    if(auto *p = std::malloc(size == 0 ? 1 : size)) { return p; }
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// アライメントを指定した new / delete も同じカウンタで数える。
+// 置き換えないと、 alignas で宣言した型の new は数えられず、標準ライブラリの実装の delete と組み合わされる。
+
+void * operator new(std::size_t size, std::align_val_t al)
+{
+    if(t_count_allocations) { g_num_allocations.fetch_add(1, std::memory_order_relaxed); }
+
+    auto const alignment = std::max<std::size_t>((std::size_t)al, sizeof(void *));
+#if defined(_MSC_VER)
+    if(auto *p = _aligned_malloc(size == 0 ? 1 : size, alignment)) { return p; }
+#else
+    void *p = nullptr;
+    if(posix_memalign(&p, alignment, size == 0 ? 1 : size) == 0) { return p; }
+#endif
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size, std::align_val_t al)
+{
+    return operator new(size, al);
+}
+
+namespace
+{
+    void freeAligned(void *p) noexcept
+    {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void operator delete(void *p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+//! 計測スレッドで発生したアロケーションを数えるクラス
+struct ScopedAllocationCounter
+{
+    ScopedAllocationCounter()
+    :   start_(g_num_allocations.load())
+    {
+        t_count_allocations = true;
+    }
+
+    ~ScopedAllocationCounter()
+    {
+        t_count_allocations = false;
+    }
+
+    std::int64_t get() const { return g_num_allocations.load() - start_; }
+
+private:
+    std::int64_t start_;
+};
+
+//! 一回の処理ごとの時間を記録し、統計値を出力するクラス
+struct Stats
+{
+    explicit
+    Stats(std::size_t num_iterations)
+    {
+        times_ns_.reserve(num_iterations);
+    }
+
+    template<class F>
+    void measure(F &&f)
+    {
+        auto const begin = Clock::now();
+        f();
+        auto const end = Clock::now();
+        times_ns_.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    //! 結果を一行の JSON として出力する。
+    /*! @param params 計測条件を表す JSON のメンバー（先頭と末尾の括弧を除いたもの）
+     */
+    void print(char const *name, std::string const &params, std::int64_t samples_per_iteration, std::int64_t num_allocations)
+    {
+        if(times_ns_.empty()) { return; }
+
+        std::sort(times_ns_.begin(), times_ns_.end());
+
+        double total = 0;
+        for(auto t: times_ns_) { total += t; }
+
+        auto percentile = [this](double p) {
+            auto const index = std::min<std::size_t>((std::size_t)(p * times_ns_.size()), times_ns_.size() - 1);
+            return times_ns_[index];
+        };
+
+        std::printf("{\"name\":\"%s\",%s%s\"iterations\":%zu,\"ns_per_sample\":%.4f,"
+                    "\"mean_ns\":%.1f,\"p50_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,\"max_ns\":%.1f,"
+                    "\"allocations\":%lld}\n",
+                    name,
+                    params.c_str(),
+                    params.empty() ? "" : ",",
+                    times_ns_.size(),
+                    total / ((double)times_ns_.size() * std::max<std::int64_t>(samples_per_iteration, 1)),
+                    total / times_ns_.size(),
+                    percentile(0.5),
+                    percentile(0.99),
+                    percentile(0.999),
+                    times_ns_.back(),
+                    (long long)num_allocations);
+        std::fflush(stdout);
+    }
+
+private:
+    std::vector<double> times_ns_;
+};
+
+struct Options
+{
+    bool quick = false;
+    std::string filter;
+
+    bool isEnabled(char const *name) const
+    {
+        return filter.empty() || std::string(name).find(filter) != std::string::npos;
+    }
+
+    std::size_t iterations(std::size_t n) const
+    {
+        return quick ? std::max<std::size_t>(n / 10, 100) : n;
+    }
+};
+
+constexpr double kSampleRate = 48000.0;
+constexpr int kBlockSizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+
+void fillNoise(juce::AudioSampleBuffer &buffer, std::uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for(int ch = 0; ch < buffer.getNumChannels(); ++ch) {
+        auto *data = buffer.getWritePointer(ch);
+        for(int i = 0; i < buffer.getNumSamples(); ++i) {
+            data[i] = dist(rng);
+        }
+    }
+}
+
+std::string params(int block_size, double capacity_seconds = 0, char const *extra = nullptr)
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "\"block_size\":%d,\"capacity_s\":%g%s%s",
+                  block_size, capacity_seconds, extra ? "," : "", extra ? extra : "");
+    return buf;
+}
+
+//==============================================================================
+//! ring に各ブロックサイズで書き込み・読み込みを行う時間を計測する。
+template<class Ring>
+void benchRing(Options const &opts, Ring &ring, double capacity_seconds, char const *extra)
+{
+    for(int block_size: kBlockSizes) {
+        juce::AudioSampleBuffer block(2, block_size);
+        fillNoise(block, 1);
+
+        // 1 秒分のデータを書き込める回数を目安にする。
+        auto const n = opts.iterations(std::max<std::size_t>(20000, (std::size_t)(kSampleRate * 10 / block_size)));
+
+        if(opts.isEnabled("ring_write")) {
+            Stats stats(n);
+            ScopedAllocationCounter allocs;
+            for(std::size_t i = 0; i < n; ++i) {
+                stats.measure([&] { ring.write(block.getArrayOfReadPointers(), 0, block_size); });
+            }
+            stats.print("ring_write", params(block_size, capacity_seconds, extra), block_size, allocs.get());
+        }
+
+        if(opts.isEnabled("ring_read")) {
+            Stats stats(n);
+            ScopedAllocationCounter allocs;
+            for(std::size_t i = 0; i < n; ++i) {
+                stats.measure([&] { ring.read(block.getArrayOfWritePointers(), 0, block_size); });
+            }
+            stats.print("ring_read", params(block_size, capacity_seconds, extra), block_size, allocs.get());
+        }
+    }
+}
+
+//! チャンネル数とサンプル数を実行時に決める RingBuffer と、コンパイル時に決める RingBuffer を同じ容量で比較する。
+template<std::int64_t Capacity>
+void benchRingVariants(Options const &opts)
+{
+    using DynamicRing = RingBuffer<float>;
+    using StaticRing = RingBuffer<float, 2, Capacity>;
+
+    auto const capacity_seconds = Capacity / kSampleRate;
+
+    for(auto mirrored: { false, true }) {
+        DynamicRing dynamic_ring(2, Capacity, mirrored ? DynamicRing::Layout::kMirrored : DynamicRing::Layout::kContiguous);
+        StaticRing static_ring(mirrored ? StaticRing::Layout::kMirrored : StaticRing::Layout::kContiguous);
+
+        char extra[96];
+        std::snprintf(extra, sizeof(extra), "\"mirrored\":%s,\"variant\":\"dynamic\"",
+                      dynamic_ring.isMirrored() ? "true" : "false");
+        benchRing(opts, dynamic_ring, capacity_seconds, extra);
+
+        std::snprintf(extra, sizeof(extra), "\"mirrored\":%s,\"variant\":\"static\"",
+                      static_ring.isMirrored() ? "true" : "false");
+        benchRing(opts, static_ring, capacity_seconds, extra);
+    }
+}
+
+void benchRingBuffer(Options const &opts)
+{
+    if(opts.isEnabled("ring_write") == false && opts.isEnabled("ring_read") == false) { return; }
+
+    using Layout = RingBuffer<float>::Layout;
+
+    for(auto layout: { Layout::kContiguous, Layout::kMirrored }) {
+        for(double capacity_seconds: { 1.0, 10.0, 60.0 }) {
+            auto const capacity = (std::int64_t)std::round(kSampleRate * capacity_seconds);
+            RingBuffer<float> ring(2, capacity, layout);
+
+            // ミラーリングに対応していない環境では、 kContiguous と同じ計測になる。
+            char extra[64];
+            std::snprintf(extra, sizeof(extra), "\"mirrored\":%s", ring.isMirrored() ? "true" : "false");
+            benchRing(opts, ring, capacity_seconds, extra);
+        }
+    }
+
+    // 2 の累乗の容量（約 1.4 秒、 10.9 秒、 87.4 秒）で、実行時に決める場合と比較する。
+    benchRingVariants<(1 << 16)>(opts);
+    benchRingVariants<(1 << 19)>(opts);
+    benchRingVariants<(1 << 22)>(opts);
+}
+
+//==============================================================================
+void benchProcessBlock(Options const &opts)
+{
+    for(bool with_reader: { false, true }) {
+        char const *name = with_reader ? "process_block_contended" : "process_block";
+        if(opts.isEnabled(name) == false) { continue; }
+
+        for(int block_size: kBlockSizes) {
+            AudioPluginAudioProcessor processor;
+            processor.setPlayConfigDetails(2, 2, kSampleRate, block_size);
+            processor.prepareToPlay(kSampleRate, block_size);
+
+            juce::AudioSampleBuffer input(2, block_size);
+            juce::AudioSampleBuffer buffer(2, block_size);
+            juce::MidiBuffer midi;
+            fillNoise(input, 2);
+
+            // GUI スレッドを模して、読み込み処理を繰り返すスレッドを動かす。
+            std::atomic<bool> stop { false };
+            std::thread reader;
+            if(with_reader) {
+                reader = std::thread([&] {
+                    CaptureReader capture_reader(3.0);
+                    while(stop.load() == false) {
+                        capture_reader.update(processor.getAudioData(), kSampleRate);
+                    }
+                });
+            }
+
+            auto const n = opts.iterations(std::max<std::size_t>(20000, (std::size_t)(kSampleRate * 10 / block_size)));
+            Stats stats(n);
+
+            {
+                ScopedAllocationCounter allocs;
+                for(std::size_t i = 0; i < n; ++i) {
+                    for(int ch = 0; ch < 2; ++ch) {
+                        buffer.copyFrom(ch, 0, input, ch, 0, block_size);
+                    }
+
+                    stats.measure([&] { processor.processBlock(buffer, midi); });
+                }
+
+                stats.print(name, params(block_size), block_size, allocs.get());
+            }
+
+            stop = true;
+            if(reader.joinable()) { reader.join(); }
+
+            processor.releaseResources();
+        }
+    }
+}
+
+//==============================================================================
+//! 倍精度で処理するホストを模して、 double のバッファで processBlock() を呼び出す。
+void benchProcessBlockDouble(Options const &opts)
+{
+    if(opts.isEnabled("process_block_double") == false) { return; }
+
+    for(int block_size: kBlockSizes) {
+        AudioPluginAudioProcessor processor;
+        processor.setProcessingPrecision(juce::AudioProcessor::doublePrecision);
+        processor.setPlayConfigDetails(2, 2, kSampleRate, block_size);
+        processor.prepareToPlay(kSampleRate, block_size);
+
+        juce::AudioSampleBuffer noise(2, block_size);
+        fillNoise(noise, 2);
+
+        juce::AudioBuffer<double> input(2, block_size);
+        juce::AudioBuffer<double> buffer(2, block_size);
+        input.makeCopyOf(noise);
+        juce::MidiBuffer midi;
+
+        auto const n = opts.iterations(std::max<std::size_t>(20000, (std::size_t)(kSampleRate * 10 / block_size)));
+        Stats stats(n);
+
+        {
+            ScopedAllocationCounter allocs;
+            for(std::size_t i = 0; i < n; ++i) {
+                for(int ch = 0; ch < 2; ++ch) {
+                    buffer.copyFrom(ch, 0, input, ch, 0, block_size);
+                }
+
+                stats.measure([&] { processor.processBlock(buffer, midi); });
+            }
+
+            stats.print("process_block_double", params(block_size), block_size, allocs.get());
+        }
+
+        processor.releaseResources();
+    }
+}
+
+//==============================================================================
+void benchFilter(Options const &opts)
+{
+    // 従来の処理（チャンネルごとの juce::IIRFilter で、係数はブロックごとに計算する）と、
+    // BiquadCascade（チャンネルをまとめて処理し、係数はサンプルごとに係数表から補間する）を比較する。
+    // automated が true の場合は、カットオフパラメータを常に変化させる。
+    constexpr int kNumChannels = 2;
+    constexpr int kBlockSize = 256;
+
+    auto const param_to_hz = [](float value) {
+        auto const log_max = std::log(std::round(kSampleRate * 0.475) - 20 + 1) / std::log(1.2);
+        return std::pow(1.2, value * log_max) + 19;
+    };
+
+    auto const cutoff_at = [](std::size_t iteration, int i) {
+        return 0.5f + 0.4f * (float)std::sin((iteration * kBlockSize + i) * 1e-4);
+    };
+
+    juce::AudioSampleBuffer input(kNumChannels, kBlockSize);
+    juce::AudioSampleBuffer buffer(kNumChannels, kBlockSize);
+    fillNoise(input, 5);
+
+    auto const n = opts.iterations(20000);
+
+    for(bool automated: { false, true }) {
+        char extra[128];
+
+        if(opts.isEnabled("filter_iir")) {
+            std::vector<juce::IIRFilter> filters(kNumChannels);
+            for(auto &filter: filters) { filter.setCoefficients(juce::IIRCoefficients::makeLowPass(kSampleRate, param_to_hz(0.5f))); }
+
+            Stats stats(n);
+            ScopedAllocationCounter allocs;
+            for(std::size_t i = 0; i < n; ++i) {
+                for(int ch = 0; ch < kNumChannels; ++ch) {
+                    buffer.copyFrom(ch, 0, input, ch, 0, kBlockSize);
+                }
+
+                stats.measure([&] {
+                    if(automated) {
+                        auto const coefficients = juce::IIRCoefficients::makeLowPass(kSampleRate, param_to_hz(cutoff_at(i, 0)));
+                        for(auto &filter: filters) { filter.setCoefficients(coefficients); }
+                    }
+
+                    for(int ch = 0; ch < kNumChannels; ++ch) {
+                        filters[ch].processSamples(buffer.getWritePointer(ch), kBlockSize);
+                    }
+                });
+            }
+
+            std::snprintf(extra, sizeof(extra), "\"slope_db\":12,\"automated\":%s", automated ? "true" : "false");
+            stats.print("filter_iir", params(kBlockSize, 0, extra), kBlockSize, allocs.get());
+        }
+
+        if(opts.isEnabled("filter_cascade")) {
+            for(auto slope: { BiquadCascade::Slope::k12dB, BiquadCascade::Slope::k24dB, BiquadCascade::Slope::k48dB }) {
+                BiquadCascade filter;
+                filter.prepare(kNumChannels, kBlockSize, kSampleRate, param_to_hz);
+                filter.setSlope(slope);
+
+                std::vector<float> cutoffs(kBlockSize);
+
+                Stats stats(n);
+                ScopedAllocationCounter allocs;
+                for(std::size_t i = 0; i < n; ++i) {
+                    for(int ch = 0; ch < kNumChannels; ++ch) {
+                        buffer.copyFrom(ch, 0, input, ch, 0, kBlockSize);
+                    }
+
+                    // Processor では SmoothedValue から求める値なので、計測の対象に含めない。
+                    if(automated) {
+                        for(int s = 0; s < kBlockSize; ++s) { cutoffs[s] = cutoff_at(i, s); }
+                    }
+
+                    stats.measure([&] {
+                        if(automated) {
+                            filter.process(buffer.getArrayOfWritePointers(), kNumChannels, kBlockSize, cutoffs.data());
+                        } else {
+                            filter.process(buffer.getArrayOfWritePointers(), kNumChannels, kBlockSize, 0.5f);
+                        }
+                    });
+                }
+
+                std::snprintf(extra, sizeof(extra), "\"slope_db\":%d,\"automated\":%s",
+                              BiquadCascade::getNumSections(slope) * 12, automated ? "true" : "false");
+                stats.print("filter_cascade", params(kBlockSize, 0, extra), kBlockSize, allocs.get());
+            }
+        }
+    }
+}
+
+//==============================================================================
+void benchCapturePull(Options const &opts)
+{
+    if(opts.isEnabled("capture_pull") == false) { return; }
+
+    // エディタのタイマー周期 (16 ms) ごとに書き込まれるデータ量を、一回の読み込みで処理する。
+    constexpr int kBlockSize = 256;
+    auto const samples_per_tick = (int)std::round(kSampleRate * 0.016);
+
+    for(double tick_scale: { 1.0, 4.0, 16.0 }) {
+        auto const num_samples = (int)(samples_per_tick * tick_scale);
+
+        auto audio_data = std::make_shared<AudioData>(juce::AudioChannelSet::stereo(),
+                                                        juce::AudioChannelSet::disabled(),
+                                                        (std::int64_t)kSampleRate);
+        CaptureReader capture_reader(3.0);
+        capture_reader.update(audio_data, kSampleRate);
+
+        juce::AudioSampleBuffer pre(2, kBlockSize);
+        juce::AudioSampleBuffer post(2, kBlockSize);
+        fillNoise(pre, 3);
+        fillNoise(post, 4);
+
+        auto const n = opts.iterations(5000);
+        Stats stats(n);
+        std::int64_t num_allocations = 0;
+
+        for(std::size_t i = 0; i < n; ++i) {
+            for(int written = 0; written < num_samples; written += kBlockSize) {
+                audio_data->write(pre.getArrayOfReadPointers(), post.getArrayOfReadPointers(), nullptr, kBlockSize);
+            }
+
+            ScopedAllocationCounter allocs;
+            stats.measure([&] { capture_reader.update(audio_data, kSampleRate); });
+            num_allocations += allocs.get();
+        }
+
+        char extra[64];
+        std::snprintf(extra, sizeof(extra), "\"samples_per_pull\":%d", num_samples);
+        stats.print("capture_pull", params(kBlockSize, 1.0, extra), num_samples, num_allocations);
+    }
+}
+
+//==============================================================================
+void benchGoniometer(Options const &opts)
+{
+    if(opts.isEnabled("goniometer") == false) { return; }
+
+    // XY 表示の 1 フレーム分の処理（減衰・新しいサンプルの加算・トーンマッピング）を計測する。
+    // 処理量は新しいサンプル数と格子の大きさだけで決まることを確認するため、 1 フレームあたりのサンプル数を変える。
+    auto const samples_per_tick = (int)std::round(kSampleRate * 0.016);
+
+    for(double tick_scale: { 1.0, 4.0, 16.0 }) {
+        auto const num_samples = (int)(samples_per_tick * tick_scale);
+
+        juce::AudioSampleBuffer input(2, num_samples);
+        fillNoise(input, 6);
+
+        Goniometer goniometer;
+        juce::Image image(juce::Image::SingleChannel, Goniometer::kGridSize, Goniometer::kGridSize, true);
+
+        auto const n = opts.iterations(5000);
+        Stats stats(n);
+        ScopedAllocationCounter allocs;
+
+        for(std::size_t i = 0; i < n; ++i) {
+            stats.measure([&] {
+                goniometer.decay(0.9f);
+                goniometer.accumulate(input.getReadPointer(0), input.getReadPointer(1), num_samples, Goniometer::Mode::kMidSide);
+                goniometer.toneMap(image, 0.1f);
+            });
+        }
+
+        char extra[64];
+        std::snprintf(extra, sizeof(extra), "\"samples_per_frame\":%d", num_samples);
+        stats.print("goniometer", params(num_samples, 0, extra), num_samples, allocs.get());
+    }
+}
+
+//==============================================================================
+void benchMeter(Options const &opts)
+{
+    if(opts.isEnabled("meter") == false) { return; }
+
+    // processBlock() でのエフェクト処理前後のレベルの計測（ 2 バス分の計測と FIFO への書き込み）を計測する。
+    constexpr int kNumChannels = 2;
+
+    for(int block_size: { 64, 512, 4096 }) {
+        juce::AudioSampleBuffer pre(kNumChannels, block_size);
+        juce::AudioSampleBuffer post(kNumChannels, block_size);
+        fillNoise(pre, 7);
+        fillNoise(post, 8);
+
+        auto meter = std::make_unique<LevelMeter>();
+        meter->prepare(kNumChannels, kSampleRate);
+        LevelMeter::Frame frame;
+
+        auto const n = opts.iterations(20000);
+        Stats stats(n);
+        ScopedAllocationCounter allocs;
+
+        for(std::size_t i = 0; i < n; ++i) {
+            stats.measure([&] {
+                meter->process(LevelMeter::Bus::kPre, pre.getArrayOfReadPointers(), kNumChannels, block_size);
+                meter->process(LevelMeter::Bus::kPost, post.getArrayOfReadPointers(), kNumChannels, block_size);
+                meter->publish(block_size);
+            });
+
+            // GUI スレッドの代わりに計測結果を取り出して、 FIFO が一杯にならないようにする。
+            while(meter->pop(frame)) {}
+        }
+
+        stats.print("meter", params(block_size), block_size, allocs.get());
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if(arg == "--quick") {
+            opts.quick = true;
+        } else if(arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--quick] [--filter <name>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(SimdKernels::verify() == false) {
+        std::fprintf(stderr, "SIMD kernels do not match the scalar implementation.\n");
+        return 1;
+    }
+
+    std::printf("{\"name\":\"environment\",\"instruction_set\":%d}\n", (int)SimdKernels::getActiveInstructionSet());
+
+    benchRingBuffer(opts);
+    benchProcessBlock(opts);
+    benchProcessBlockDouble(opts);
+    benchFilter(opts);
+    benchCapturePull(opts);
+    benchGoniometer(opts);
+    benchMeter(opts);
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include "BiquadCascade.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SIMPLE_OSCILLOSCOPE_BIQUAD_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define SIMPLE_OSCILLOSCOPE_BIQUAD_NEON 1
+  #include <arm_neon.h>
+  #if defined(__aarch64__) || defined(_M_ARM64)
+    #define SIMPLE_OSCILLOSCOPE_BIQUAD_NEON_F64 1
+  #endif
+#endif
+
+namespace
+{
+
+constexpr double kPi = 3.14159265358979323846;
+
+//! 4 チャンネル分のサンプルを一つのレジスタで扱うクラス
+struct Lanes
+{
+#if defined(SIMPLE_OSCILLOSCOPE_BIQUAD_SSE2)
+    __m128 v;
+
+    static Lanes broadcast(float x) { return { _mm_set1_ps(x) }; }
+    static Lanes load(float const *p) { return { _mm_loadu_ps(p) }; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+#elif defined(SIMPLE_OSCILLOSCOPE_BIQUAD_NEON)
+    float32x4_t v;
+
+    static Lanes broadcast(float x) { return { vdupq_n_f32(x) }; }
+    static Lanes load(float const *p) { return { vld1q_f32(p) }; }
+    void store(float *p) const { vst1q_f32(p, v); }
+
+    friend Lanes operator+(Lanes a, Lanes b) { return { vaddq_f32(a.v, b.v) }; }
+    friend Lanes operator-(Lanes a, Lanes b) { return { vsubq_f32(a.v, b.v) }; }
+    friend Lanes operator*(Lanes a, Lanes b) { return { vmulq_f32(a.v, b.v) }; }
+#else
+    float v[BiquadCascade::kNumLanes];
+
+    static Lanes broadcast(float x) { return { { x, x, x, x } }; }
+    static Lanes load(float const *p) { return { { p[0], p[1], p[2], p[3] } }; }
+    void store(float *p) const { std::copy_n(v, BiquadCascade::kNumLanes, p); }
+
+    template<class F>
+    static Lanes apply(Lanes a, Lanes b, F f)
+    {
+        return { { f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3]) } };
+    }
+
+    friend Lanes operator+(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+    friend Lanes operator-(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+    friend Lanes operator*(Lanes a, Lanes b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+#endif
+};
+
+//! 4 チャンネル分のサンプルを倍精度で扱うクラス
+/*! SSE2 と NEON では、 2 レーンのレジスタを 2 つ使用する。
+ */
+struct LanesDouble
+{
+#if defined(SIMPLE_OSCILLOSCOPE_BIQUAD_SSE2)
+    __m128d lo;
+    __m128d hi;
+
+    static LanesDouble broadcast(double x) { auto const v = _mm_set1_pd(x); return { v, v }; }
+    static LanesDouble load(double const *p) { return { _mm_loadu_pd(p), _mm_loadu_pd(p + 2) }; }
+    void store(double *p) const { _mm_storeu_pd(p, lo); _mm_storeu_pd(p + 2, hi); }
+
+    friend LanesDouble operator+(LanesDouble a, LanesDouble b) { return { _mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi) }; }
+    friend LanesDouble operator-(LanesDouble a, LanesDouble b) { return { _mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi) }; }
+    friend LanesDouble operator*(LanesDouble a, LanesDouble b) { return { _mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi) }; }
+#elif defined(SIMPLE_OSCILLOSCOPE_BIQUAD_NEON_F64)
+    float64x2_t lo;
+    float64x2_t hi;
+
+    static LanesDouble broadcast(double x) { auto const v = vdupq_n_f64(x); return { v, v }; }
+    static LanesDouble load(double const *p) { return { vld1q_f64(p), vld1q_f64(p + 2) }; }
+    void store(double *p) const { vst1q_f64(p, lo); vst1q_f64(p + 2, hi); }
+
+    friend LanesDouble operator+(LanesDouble a, LanesDouble b) { return { vaddq_f64(a.lo, b.lo), vaddq_f64(a.hi, b.hi) }; }
+    friend LanesDouble operator-(LanesDouble a, LanesDouble b) { return { vsubq_f64(a.lo, b.lo), vsubq_f64(a.hi, b.hi) }; }
+    friend LanesDouble operator*(LanesDouble a, LanesDouble b) { return { vmulq_f64(a.lo, b.lo), vmulq_f64(a.hi, b.hi) }; }
+#else
+    double v[BiquadCascade::kNumLanes];
+
+    static LanesDouble broadcast(double x) { return { { x, x, x, x } }; }
+    static LanesDouble load(double const *p) { return { { p[0], p[1], p[2], p[3] } }; }
+    void store(double *p) const { std::copy_n(v, BiquadCascade::kNumLanes, p); }
+
+    template<class F>
+    static LanesDouble apply(LanesDouble a, LanesDouble b, F f)
+    {
+        return { { f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3]) } };
+    }
+
+    friend LanesDouble operator+(LanesDouble a, LanesDouble b) { return apply(a, b, [](double x, double y) { return x + y; }); }
+    friend LanesDouble operator-(LanesDouble a, LanesDouble b) { return apply(a, b, [](double x, double y) { return x - y; }); }
+    friend LanesDouble operator*(LanesDouble a, LanesDouble b) { return apply(a, b, [](double x, double y) { return x * y; }); }
+#endif
+};
+
+static_assert(BiquadCascade::kNumLanes == 4, "Lanes assumes four channels per register");
+
+//! サンプルの型に対応する、レーンの型
+template<class Sample>
+using LanesFor = std::conditional_t<std::is_same<Sample, double>::value, LanesDouble, Lanes>;
+
+//! 傾きごとの係数表の先頭のセクションの番号
+int getFirstSection(BiquadCascade::Slope slope)
+{
+    switch(slope) {
+        case BiquadCascade::Slope::k12dB: return 0;
+        case BiquadCascade::Slope::k24dB: return 1;
+        case BiquadCascade::Slope::k48dB: return 3;
+        default: assert("unknown slope" && false); return 0;
+    }
+}
+
+//! すべての傾きのセクション数の合計
+constexpr int kNumTableSections = 1 + 2 + 4;
+
+} // namespace
+
+int BiquadCascade::getNumSections(Slope slope)
+{
+    switch(slope) {
+        case Slope::k12dB: return 1;
+        case Slope::k24dB: return 2;
+        case Slope::k48dB: return 4;
+        default: assert("unknown slope" && false); return 1;
+    }
+}
+
+BiquadCascade::Coefficients BiquadCascade::makeLowPass(double sample_rate, double frequency, double q)
+{
+    // RBJ Audio EQ Cookbook のローパスフィルタ
+    auto const w0 = 2.0 * kPi * frequency / sample_rate;
+    auto const cos_w0 = std::cos(w0);
+    auto const alpha = std::sin(w0) / (2.0 * q);
+    auto const a0 = 1.0 + alpha;
+
+    Coefficients c;
+    c.b0 = (float)((1.0 - cos_w0) / 2.0 / a0);
+    c.b1 = (float)((1.0 - cos_w0) / a0);
+    c.b2 = c.b0;
+    c.a1 = (float)(-2.0 * cos_w0 / a0);
+    c.a2 = (float)((1.0 - alpha) / a0);
+    return c;
+}
+
+void BiquadCascade::prepare(int num_channels, int max_block_size, double sample_rate,
+                            std::function<double(float)> const &param_to_hz)
+{
+    num_channels_ = std::max(num_channels, 0);
+    max_block_size_ = std::max(max_block_size, 1);
+
+    // バターワース特性になるように、 n 次のフィルタの k 番目のセクションの Q を
+    // 1 / (2 cos((2k - 1) pi / 2n)) とする。
+    table_.resize(kNumTableSections * (kTableSize + 1));
+    for(auto slope: { Slope::k12dB, Slope::k24dB, Slope::k48dB }) {
+        auto const num_sections = getNumSections(slope);
+        auto const order = num_sections * 2;
+
+        for(int s = 0; s < num_sections; ++s) {
+            auto const q = 1.0 / (2.0 * std::cos((2 * s + 1) * kPi / (2.0 * order)));
+            auto *table = table_.data() + (getFirstSection(slope) + s) * (kTableSize + 1);
+
+            for(int i = 0; i <= kTableSize; ++i) {
+                auto const param = (float)std::min(i, kTableSize - 1) / (kTableSize - 1);
+                // カットオフ周波数をナイキスト周波数限界まで設定すると発振してしまうので、それ以下に制限する。
+                auto const hz = std::min(param_to_hz(param), sample_rate / 2.0 - 1);
+                table[i] = makeLowPass(sample_rate, hz, q);
+            }
+        }
+    }
+
+    block_coefficients_.resize(kMaxSections * max_block_size_);
+
+    auto const num_groups = (num_channels_ + kNumLanes - 1) / kNumLanes;
+    state_.assign(num_groups * kMaxSections * 2 * kNumLanes, 0.0f);
+    state_double_.assign(state_.size(), 0.0);
+}
+
+void BiquadCascade::reset()
+{
+    std::fill(state_.begin(), state_.end(), 0.0f);
+    std::fill(state_double_.begin(), state_double_.end(), 0.0);
+}
+
+void BiquadCascade::setSlope(Slope slope)
+{
+    if(slope == slope_) { return; }
+
+    slope_ = slope;
+    reset();
+}
+
+BiquadCascade::Coefficients const * BiquadCascade::getTable(Slope slope, int section) const
+{
+    return table_.data() + (getFirstSection(slope) + section) * (kTableSize + 1);
+}
+
+BiquadCascade::Coefficients BiquadCascade::getCoefficients(Slope slope, int section, float cutoff) const
+{
+    auto const *table = getTable(slope, section);
+
+    auto const x = std::min(std::max(cutoff, 0.0f), 1.0f) * (kTableSize - 1);
+    auto const i = std::min((int)x, kTableSize - 1);
+    auto const t = x - i;
+
+    // 末尾には番兵として最後の要素と同じ値を置いているので、 i + 1 は常に範囲内になる。
+    auto const &c0 = table[i];
+    auto const &c1 = table[i + 1];
+
+    Coefficients c;
+    c.b0 = c0.b0 + (c1.b0 - c0.b0) * t;
+    c.b1 = c0.b1 + (c1.b1 - c0.b1) * t;
+    c.b2 = c0.b2 + (c1.b2 - c0.b2) * t;
+    c.a1 = c0.a1 + (c1.a1 - c0.a1) * t;
+    c.a2 = c0.a2 + (c1.a2 - c0.a2) * t;
+    return c;
+}
+
+void BiquadCascade::process(float * const *channels, int num_channels, int length, float const *cutoffs)
+{
+    processPerSample(channels, num_channels, length, cutoffs);
+}
+
+void BiquadCascade::process(float * const *channels, int num_channels, int length, float cutoff)
+{
+    processConstant(channels, num_channels, length, cutoff);
+}
+
+void BiquadCascade::process(double * const *channels, int num_channels, int length, float const *cutoffs)
+{
+    processPerSample(channels, num_channels, length, cutoffs);
+}
+
+void BiquadCascade::process(double * const *channels, int num_channels, int length, float cutoff)
+{
+    processConstant(channels, num_channels, length, cutoff);
+}
+
+template<class Sample>
+void BiquadCascade::processPerSample(Sample * const *channels, int num_channels, int length, float const *cutoffs)
+{
+    if(table_.empty()) { return; }
+
+    auto const num_sections = getNumSections(slope_);
+
+    for(int offset = 0; offset < length; offset += max_block_size_) {
+        auto const num = std::min(length - offset, max_block_size_);
+
+        // 係数の補間はチャンネル数に関係なく、サンプルごとに一度だけ行う。
+        for(int s = 0; s < num_sections; ++s) {
+            auto *dest = block_coefficients_.data() + s * max_block_size_;
+            for(int i = 0; i < num; ++i) {
+                dest[i] = getCoefficients(slope_, s, cutoffs[offset + i]);
+            }
+        }
+
+        processChunk(channels, num_channels, offset, num, true);
+    }
+}
+
+template<class Sample>
+void BiquadCascade::processConstant(Sample * const *channels, int num_channels, int length, float cutoff)
+{
+    if(table_.empty()) { return; }
+
+    auto const num_sections = getNumSections(slope_);
+    for(int s = 0; s < num_sections; ++s) {
+        block_coefficients_[s * max_block_size_] = getCoefficients(slope_, s, cutoff);
+    }
+
+    processChunk(channels, num_channels, 0, length, false);
+}
+
+template<class Sample>
+void BiquadCascade::processChunk(Sample * const *channels, int num_channels, int offset, int length, bool per_sample)
+{
+    using L = LanesFor<Sample>;
+
+    assert(num_channels <= num_channels_);
+    num_channels = std::min(num_channels, num_channels_);
+
+    auto const num_sections = getNumSections(slope_);
+
+    Sample *states = nullptr;
+    if constexpr(std::is_same<Sample, double>::value) {
+        states = state_double_.data();
+    } else {
+        states = state_.data();
+    }
+
+    for(int group = 0; group * kNumLanes < num_channels; ++group) {
+        auto const first_channel = group * kNumLanes;
+        auto const num_lanes = std::min(kNumLanes, num_channels - first_channel);
+        auto *state = states + group * kMaxSections * 2 * kNumLanes;
+
+        L s1[kMaxSections];
+        L s2[kMaxSections];
+        for(int s = 0; s < num_sections; ++s) {
+            s1[s] = L::load(state + (s * 2 + 0) * kNumLanes);
+            s2[s] = L::load(state + (s * 2 + 1) * kNumLanes);
+        }
+
+        // 使用しないレーンには 0 を入力する。
+        Sample lanes[kNumLanes] = {};
+
+        for(int i = 0; i < length; ++i) {
+            for(int lane = 0; lane < num_lanes; ++lane) {
+                lanes[lane] = channels[first_channel + lane][offset + i];
+            }
+
+            auto x = L::load(lanes);
+
+            // Transposed Direct Form II
+            for(int s = 0; s < num_sections; ++s) {
+                auto const &c = block_coefficients_[s * max_block_size_ + (per_sample ? i : 0)];
+                auto const y = L::broadcast(c.b0) * x + s1[s];
+                s1[s] = L::broadcast(c.b1) * x - L::broadcast(c.a1) * y + s2[s];
+                s2[s] = L::broadcast(c.b2) * x - L::broadcast(c.a2) * y;
+                x = y;
+            }
+
+            x.store(lanes);
+            for(int lane = 0; lane < num_lanes; ++lane) {
+                channels[first_channel + lane][offset + i] = lanes[lane];
+            }
+        }
+
+        for(int s = 0; s < num_sections; ++s) {
+            s1[s].store(state + (s * 2 + 0) * kNumLanes);
+            s2[s].store(state + (s * 2 + 1) * kNumLanes);
+        }
+    }
+}
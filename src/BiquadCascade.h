@@ -0,0 +1,108 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// 複数チャンネルのローパスフィルタを、 SIMD のレーンにチャンネルを割り当てて処理するクラス
+//
+// 2 次のセクションを縦続接続して、 12 / 24 / 48 dB/oct のバターワース特性を実現する。
+// 係数はカットオフパラメータ (0.0 .. 1.0) に対してあらかじめ表にしておき、
+// サンプルごとに表を線形補間して求めるので、オートメーション中も三角関数の計算は発生しない。
+//
+// prepare() 以外はメモリを確保しないので、 process() はオーディオスレッドから呼び出せる。
+// double のデータを処理する場合は、内部状態と演算を倍精度で行う。係数表は単精度のものを共有する。
+struct BiquadCascade
+{
+    //! フィルタの傾き
+    enum class Slope : int {
+        k12dB = 1,
+        k24dB,
+        k48dB,
+    };
+
+    //! 縦続接続するセクションの最大数
+    static constexpr int kMaxSections = 4;
+
+    //! 係数表の要素数
+    static constexpr int kTableSize = 1024;
+
+    //! 一度に処理するチャンネル数（SIMD のレーン数）
+    static constexpr int kNumLanes = 4;
+
+    //! 一つのセクションの係数。 a0 で正規化したもの
+    struct Coefficients
+    {
+        float b0 = 1;
+        float b1 = 0;
+        float b2 = 0;
+        float a1 = 0;
+        float a2 = 0;
+    };
+
+    //! 指定した傾きのセクション数を返す。
+    static int getNumSections(Slope slope);
+
+    //! 処理の準備をする。
+    /*! 係数表と内部状態のメモリを確保する。オーディオスレッドから呼び出してはいけない。
+     *  @param num_channels 処理するチャンネル数
+     *  @param max_block_size process() で一度に処理する最大のサンプル数
+     *  @param sample_rate サンプルレート
+     *  @param param_to_hz カットオフパラメータ (0.0 .. 1.0) をカットオフ周波数 [Hz] に変換する関数
+     */
+    void prepare(int num_channels, int max_block_size, double sample_rate,
+                 std::function<double(float)> const &param_to_hz);
+
+    //! フィルタの内部状態を初期化する。
+    void reset();
+
+    //! フィルタの傾きを変更する。
+    /*! 傾きが変わった場合は内部状態を初期化する。
+     */
+    void setSlope(Slope slope);
+    Slope getSlope() const noexcept { return slope_; }
+
+    //! channels の各チャンネルのデータにフィルタを適用する。
+    /*! @param cutoffs サンプルごとのカットオフパラメータ (0.0 .. 1.0) 。 length 個の要素を持つこと。
+     *  @pre num_channels <= prepare() で指定したチャンネル数
+     */
+    void process(float * const *channels, int num_channels, int length, float const *cutoffs);
+
+    //! channels の各チャンネルのデータに、一定のカットオフパラメータでフィルタを適用する。
+    void process(float * const *channels, int num_channels, int length, float cutoff);
+
+    //! double のデータに、倍精度でフィルタを適用する。
+    /*! 内部状態は float のデータを処理する場合とは別に保持する。
+     */
+    void process(double * const *channels, int num_channels, int length, float const *cutoffs);
+    void process(double * const *channels, int num_channels, int length, float cutoff);
+
+    //! 係数表から、指定した傾きとセクションの、カットオフパラメータ cutoff に対応する係数を求める。
+    Coefficients getCoefficients(Slope slope, int section, float cutoff) const;
+
+    //! サンプルレートとカットオフ周波数 [Hz] と Q から、ローパスフィルタの係数を計算する。
+    static Coefficients makeLowPass(double sample_rate, double frequency, double q);
+
+private:
+    Slope slope_ = Slope::k12dB;
+    int num_channels_ = 0;
+    int max_block_size_ = 0;
+    // [傾き][セクション][kTableSize + 1] の順に並べた係数表
+    std::vector<Coefficients> table_;
+    // [セクション][サンプル] の順に並べた、処理中のブロックの係数
+    std::vector<Coefficients> block_coefficients_;
+    // [チャンネルのグループ][セクション][s1, s2][レーン] の順に並べた内部状態
+    std::vector<float> state_;
+    // double のデータを処理する場合の内部状態。並びは state_ と同じ
+    std::vector<double> state_double_;
+
+    Coefficients const * getTable(Slope slope, int section) const;
+
+    template<class Sample>
+    void processPerSample(Sample * const *channels, int num_channels, int length, float const *cutoffs);
+
+    template<class Sample>
+    void processConstant(Sample * const *channels, int num_channels, int length, float cutoff);
+
+    template<class Sample>
+    void processChunk(Sample * const *channels, int num_channels, int offset, int length, bool per_sample);
+};
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "RingBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+// 一つの書き込みスレッドから複数の読み込みスレッドへデータを配信するリングバッファクラス
+//
+// 書き込み側はロックや待機をせずにデータを書き込む。
+// 読み込み側は Reader ごとに読み込み位置を保持していて、書き込み側を止めることなくデータを読み込む。
+// 読み込みが間に合わずに上書きされてしまったデータは破棄され、その数が Reader に記録される。
+//
+// read() は未読のデータを古いものから順に dest へコピーし、すべてのデータを必要とする読み込み側（録音など）に使用する。
+// readLatest() は未読のデータのうち最新の部分だけをコピーし、表示や解析のように最新のデータだけが必要な読み込み側に使用する。
+// beginRead() / getView() / endRead() を使用すると、 readLatest() と同じ範囲を内部バッファからコピーせずに参照できる。
+template<class T>
+struct BroadcastRingBuffer
+{
+    using Layout = typename RingBuffer<T>::Layout;
+    using View = typename RingBuffer<T>::View;
+
+    //! 読み込み側の状態を表すクラス
+    /*! 読み込みスレッドごとに一つずつ用意する。
+     */
+    struct Reader
+    {
+        Reader()
+        {}
+
+        explicit
+        Reader(std::int64_t position)
+        :   position_(position)
+        {}
+
+        //! 次に読み込む、書き込み開始からの通算のサンプル位置
+        std::int64_t getPosition() const noexcept { return position_; }
+        //! 読み込みが間に合わずにデータが失われた回数
+        std::int64_t getNumOverruns() const noexcept { return num_overruns_; }
+        //! 読み込みが間に合わずに失われたサンプル数の合計
+        std::int64_t getNumDropped() const noexcept { return num_dropped_; }
+
+    private:
+        friend BroadcastRingBuffer;
+
+        std::int64_t position_ = 0;
+        std::int64_t num_overruns_ = 0;
+        std::int64_t num_dropped_ = 0;
+    };
+
+    //! read() / readLatest() の結果
+    struct ReadResult
+    {
+        //! 読み込んだ先頭のサンプルの、書き込み開始からの通算のサンプル位置
+        std::int64_t position = 0;
+        //! 読み込んだサンプル数
+        std::int64_t num_read = 0;
+        //! 今回の読み込みで、書き込み側に上書きされていたために失われたサンプル数
+        std::int64_t num_dropped = 0;
+        //! readLatest() で、最新の max_length サンプルより古いために読み飛ばしたサンプル数
+        /*! 呼び出し側が指定した読み飛ばしなので、 num_dropped や Reader の記録には含めない。
+         */
+        std::int64_t num_skipped = 0;
+        //! 読み込みの後に、まだ読み込んでいないサンプル数
+        std::int64_t num_pending = 0;
+    };
+
+    //! 空のリングバッファを構築する
+    BroadcastRingBuffer()
+    {}
+
+    //! コンストラクタ
+    //! 指定したチャンネル数とサンプル数のバッファを構築する。
+    /*! 実際のサンプル数は layout によって切り上げられることがある。 RingBuffer のコンストラクタを参照。
+     *  @pre num_channels >= 0 && num_samples >= 0
+     */
+    BroadcastRingBuffer(std::int64_t num_channels, std::int64_t num_samples, Layout layout = Layout::kContiguous)
+    :   buffer_(num_channels, num_samples, layout)
+    {}
+
+    //! src のデータを内部バッファに書き込む。
+    //! 古いデータは上書きされる。
+    /*! 書き込みスレッドからのみ呼び出すこと。
+     *  @pre src に対して、各チャンネルで [src_start_sample, src_start_sample + length) の範囲の読み込みが可能であること。
+     *  @pre length <= getNumSamples()
+     */
+    void write(T const * const * src, std::int64_t src_start_sample, std::int64_t length)
+    {
+        if(length == 0 || getNumSamples() == 0) { return; }
+
+        auto const new_num_written = num_written_.load(std::memory_order_relaxed) + length;
+
+        // これから上書きする範囲を、データを書き込む前に読み込み側へ公開する。
+        // 読み込み側は、読み込みの後にこの値を確認することで、読み込み中に上書きされた範囲を判別する。
+        num_claimed_.store(new_num_written, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        buffer_.write(src, src_start_sample, length);
+
+        num_written_.store(new_num_written, std::memory_order_release);
+    }
+
+    //! 読み込み可能な最も古いデータの位置から読み込みを開始する Reader を作成する。
+    Reader createReader() const
+    {
+        return Reader(std::max<std::int64_t>(getNumWritten() - getNumSamples(), 0));
+    }
+
+    //! reader の読み込み位置以降に書き込まれたデータを、古いものから順に最大 max_length サンプル dest に読み込み、
+    //! reader の読み込み位置を読み込んだ分だけ進める。
+    /*! 読み込むデータが max_length より多い場合、残りは ReadResult::num_pending に示され、次の呼び出しで読み込まれる。
+     *  reader が保持する読み込み位置のデータがすでに上書きされていた場合や、
+     *  読み込み中に書き込み側に追い越された場合は、そのデータを破棄して num_dropped に記録する。
+     *
+     *  読み込んだデータは dest の各チャンネルの dest_start_index から ReadResult::num_read サンプル分に格納される。
+     *  @pre dest に対して、各チャンネルで [dest_start_index, dest_start_index + max_length) の範囲の書き込みが可能であること。
+     */
+    ReadResult read(Reader &reader, T **dest, std::int64_t dest_start_index, std::int64_t max_length) const
+    {
+        auto const capacity = getNumSamples();
+        auto const end = num_written_.load(std::memory_order_acquire);
+
+        // このリングバッファより先の位置を指している Reader は、末尾に合わせる。
+        reader.position_ = std::min(reader.position_, end);
+
+        // すでに上書きされてしまったデータは読み込めない。
+        auto const oldest = std::max(reader.position_, end - capacity);
+        auto const stop = std::min(end, oldest + std::max<std::int64_t>(max_length, 0));
+
+        buffer_.readAt(dest, dest_start_index, oldest, stop - oldest);
+        auto const num_invalid = discardOverwritten(dest, dest_start_index, oldest, stop);
+
+        ReadResult result;
+        result.position = oldest + num_invalid;
+        result.num_read = stop - result.position;
+        result.num_dropped = (oldest - reader.position_) + num_invalid;
+        result.num_pending = end - stop;
+
+        recordDropped(reader, result.num_dropped);
+
+        reader.position_ = stop;
+        return result;
+    }
+
+    //! reader の読み込み位置以降に書き込まれたデータのうち、最新の最大 max_length サンプルを dest に読み込み、
+    //! reader の読み込み位置を末尾まで進める。
+    /*! 読み込むデータが max_length より多い場合、それより古いデータは読み込まずに読み飛ばし、
+     *  その数を ReadResult::num_skipped に記録する。読み飛ばしたデータは num_dropped には含めない。
+     *  reader が保持する読み込み位置のデータがすでに上書きされていた場合や、
+     *  読み込み中に書き込み側に追い越された場合は、そのデータを破棄して num_dropped に記録する。
+     *
+     *  読み込んだデータは dest の各チャンネルの dest_start_index から ReadResult::num_read サンプル分に格納される。
+     *  @pre dest に対して、各チャンネルで [dest_start_index, dest_start_index + max_length) の範囲の書き込みが可能であること。
+     */
+    ReadResult readLatest(Reader &reader, T **dest, std::int64_t dest_start_index, std::int64_t max_length) const
+    {
+        auto const capacity = getNumSamples();
+        auto const end = num_written_.load(std::memory_order_acquire);
+
+        reader.position_ = std::min(reader.position_, end);
+
+        auto const oldest = std::max(reader.position_, end - capacity);
+        auto const start = std::max(oldest, end - std::max<std::int64_t>(max_length, 0));
+
+        buffer_.readAt(dest, dest_start_index, start, end - start);
+        auto const num_invalid = discardOverwritten(dest, dest_start_index, start, end);
+
+        ReadResult result;
+        result.position = start + num_invalid;
+        result.num_read = end - result.position;
+        result.num_dropped = (oldest - reader.position_) + num_invalid;
+        result.num_skipped = start - oldest;
+
+        recordDropped(reader, result.num_dropped);
+
+        reader.position_ = end;
+        return result;
+    }
+
+    //! 書き込み開始からの通算のサンプル位置 position から length サンプル分のデータを dest に読み込む。
+    /*! Reader を使用せずに、指定した範囲のデータを読み込む。
+     *  @return 指定した範囲のデータがすべて書き込み済みで、読み込みの前後で上書きされていなかった場合は true。
+     *  false の場合、 dest の内容は不定になる。
+     *  @pre dest に対して、各チャンネルで [dest_start_index, dest_start_index + length) の範囲の書き込みが可能であること。
+     */
+    bool readRange(T **dest, std::int64_t dest_start_index, std::int64_t position, std::int64_t length) const
+    {
+        if(isReadable(position, length) == false) { return false; }
+
+        buffer_.readAt(dest, dest_start_index, position, length);
+
+        return isIntact(position);
+    }
+
+    //! reader の読み込み位置以降に書き込まれたデータのうち、コピーせずに参照する範囲を求める。
+    /*! readLatest() と同じ規則で範囲を決めるが、データのコピーも reader の読み込み位置の更新も行わない。
+     *  返された範囲は getView() で参照し、参照し終えたら endRead() を呼び出すこと。
+     *  ReadResult::num_dropped には、すでに上書きされていたために範囲から除外したサンプル数が格納される。
+     */
+    ReadResult beginRead(Reader &reader, std::int64_t max_length) const
+    {
+        auto const capacity = getNumSamples();
+        auto const end = num_written_.load(std::memory_order_acquire);
+
+        reader.position_ = std::min(reader.position_, end);
+
+        auto const oldest = std::max(reader.position_, end - capacity);
+
+        ReadResult result;
+        result.position = std::max(oldest, end - std::max<std::int64_t>(max_length, 0));
+        result.num_read = end - result.position;
+        result.num_dropped = oldest - reader.position_;
+        result.num_skipped = result.position - oldest;
+        return result;
+    }
+
+    //! beginRead() で求めた範囲の参照を終了し、 reader の読み込み位置を進める。
+    /*! @return 参照している間にデータが上書きされなかった場合は true。
+     *  false の場合、参照したデータの内容は不定で、その範囲は失われたものとして reader に記録される。
+     */
+    bool endRead(Reader &reader, ReadResult const &result) const
+    {
+        bool const intact = isIntact(result.position);
+        recordDropped(reader, result.num_dropped + (intact ? 0 : result.num_read));
+
+        reader.position_ = result.position + result.num_read;
+        return intact;
+    }
+
+    //! 書き込み開始からの通算のサンプル位置 position から length サンプル分のデータを、コピーせずに参照する。
+    /*! 内部バッファがミラーリングされている場合は、常に一つの連続した範囲を返す。
+     *  参照し終えたら isIntact(position) で、参照している間に上書きされていないかを確認すること。
+     *  @pre isReadable(position, length)
+     */
+    View getView(std::int64_t channel, std::int64_t position, std::int64_t length) const
+    {
+        return buffer_.getView(channel, position, length);
+    }
+
+    //! position から length サンプル分のデータが書き込み済みで、まだ上書きされていないかどうかを返す。
+    bool isReadable(std::int64_t position, std::int64_t length) const
+    {
+        auto const capacity = getNumSamples();
+        auto const end = num_written_.load(std::memory_order_acquire);
+
+        return position >= 0 && length >= 0 && length <= capacity
+            && position + length <= end && position >= end - capacity;
+    }
+
+    //! position 以降のデータが、これまでに上書きされていないかどうかを返す。
+    /*! データの読み込みや参照を終えた後に呼び出して、その間に書き込み側に追い越されていないかを確認する。
+     */
+    bool isIntact(std::int64_t position) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto const valid_start = num_claimed_.load(std::memory_order_relaxed) - getNumSamples();
+
+        return position >= valid_start;
+    }
+
+    std::int64_t getNumChannels() const noexcept { return buffer_.getNumChannels(); }
+    std::int64_t getNumSamples() const noexcept { return buffer_.getNumSamples(); }
+
+    //! 書き込み開始からの通算の書き込みサンプル数を返す。
+    std::int64_t getNumWritten() const noexcept { return num_written_.load(std::memory_order_acquire); }
+
+private:
+    RingBuffer<T> buffer_;
+
+    //! dest に読み込んだ [start, stop) のうち、読み込み中に上書きが始まっていた先頭の範囲を破棄し、
+    //! 残りのデータを dest_start_index に詰める。
+    /*! @return 破棄したサンプル数
+     */
+    std::int64_t discardOverwritten(T **dest, std::int64_t dest_start_index, std::int64_t start, std::int64_t stop) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto const valid_start = num_claimed_.load(std::memory_order_relaxed) - getNumSamples();
+        if(valid_start <= start) { return 0; }
+
+        auto const num_invalid = std::min(valid_start, stop) - start;
+        auto const num_valid = stop - start - num_invalid;
+
+        for(int ch = 0, num_channels = (int)getNumChannels(); ch < num_channels; ++ch) {
+            auto *ch_dest = dest[ch] + dest_start_index;
+            std::copy_n(ch_dest + num_invalid, num_valid, ch_dest);
+        }
+
+        return num_invalid;
+    }
+
+    //! 失われたサンプルがあれば reader に記録する。
+    static void recordDropped(Reader &reader, std::int64_t num_dropped)
+    {
+        if(num_dropped <= 0) { return; }
+
+        reader.num_overruns_ += 1;
+        reader.num_dropped_ += num_dropped;
+    }
+
+    // 書き込みが完了したサンプル数
+    std::atomic<std::int64_t> num_written_ { 0 };
+    // 書き込みを開始したサンプル数
+    std::atomic<std::int64_t> num_claimed_ { 0 };
+};
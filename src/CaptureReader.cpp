@@ -0,0 +1,111 @@
+#include "CaptureReader.h"
+
+#include <cassert>
+
+CaptureReader::CaptureReader(double history_seconds)
+:   history_seconds_(history_seconds)
+{}
+
+std::int64_t CaptureReader::update(std::shared_ptr<AudioData const> audio_data, double sample_rate)
+{
+    if(audio_data == nullptr) { return 0; }
+
+    auto const num_channels = audio_data->getBuffer().getNumChannels();
+
+    if(sample_rate_ != sample_rate || num_channels != buffer_.getNumChannels()) {
+        sample_rate_ = sample_rate;
+
+        auto const max_samples = (int)std::round(sample_rate * history_seconds_);
+        buffer_ = juce::AudioSampleBuffer((int)num_channels, max_samples);
+        pyramids_.assign(num_channels, PeakPyramid(max_samples));
+        audio_data_.reset();
+    }
+
+    // prepareToPlay() によって AudioData が作り直されていたら、新しい AudioData から読み込みを始める。
+    if(audio_data != audio_data_) {
+        audio_data_ = audio_data;
+        reader_ = audio_data->getBuffer().createReader();
+
+        auto const capacity = std::min<std::int64_t>(audio_data->getBuffer().getNumSamples(), buffer_.getNumSamples());
+        frame_pyramids_.assign(num_channels, PeakPyramid(capacity));
+        frame_ = TriggeredFrame {};
+        frame_valid_ = false;
+    }
+
+    assert(audio_data->getBuffer().getNumChannels() == buffer_.getNumChannels());
+
+    auto const &ring = audio_data->getBuffer();
+
+    // 読み込むデータがリングバッファの新しい側の半分に収まっていれば、
+    // 書き込み側に追い越されるまでに十分な余裕があるので、リングバッファのデータを直接ピラミッドに追加する。
+    // 追い越された場合にその範囲だけを取り消せるように、ピラミッドの容量の 1/4 までに限る（PeakPyramid::rewind() を参照）。
+    auto result = ring.beginRead(reader_, buffer_.getNumSamples());
+    if(result.num_read <= ring.getNumSamples() / 2 && result.num_read <= buffer_.getNumSamples() / 4) {
+        for(int ch = 0; ch < (int)pyramids_.size(); ++ch) {
+            auto const view = ring.getView(ch, result.position, result.num_read);
+            pyramids_[ch].push(view.first.data, view.first.size);
+            pyramids_[ch].push(view.second.data, view.second.size);
+        }
+
+        // 追加している間に上書きされていた場合は、不正なデータが混ざっているので、追加した範囲だけを無音に置き換える。
+        // それより前のデータはそのまま残し、無音の区間は失われたデータの位置を示す。
+        read_stats_.num_direct += 1;
+        if(ring.endRead(reader_, result) == false) {
+            buffer_.clear(0, (int)result.num_read);
+            for(int ch = 0; ch < (int)pyramids_.size(); ++ch) {
+                pyramids_[ch].rewind(result.num_read);
+                pyramids_[ch].push(buffer_.getReadPointer(ch), result.num_read);
+            }
+
+            read_stats_.num_invalidated += 1;
+        }
+
+        return result.num_read;
+    }
+
+    // Processor 側の書き込みを止めることなく、前回読み込んだ位置以降のデータを読み込む。
+    // 読み込みが間に合わずに失われたデータは reader_ に記録され、残りのデータだけが読み込まれる。
+    result = ring.readLatest(reader_, buffer_.getArrayOfWritePointers(), 0, buffer_.getNumSamples());
+    read_stats_.num_copied += 1;
+
+    // 読み込んだ分だけピラミッドを更新する。
+    for(int ch = 0; ch < (int)pyramids_.size(); ++ch) {
+        pyramids_[ch].push(buffer_.getReadPointer(ch), result.num_read);
+    }
+
+    return result.num_read;
+}
+
+bool CaptureReader::updateFrame()
+{
+    if(audio_data_ == nullptr) { return false; }
+
+    auto const frame = audio_data_->getTriggeredFrameSlot().load();
+    if(frame.sequence == 0 || frame.sequence == frame_.sequence) { return false; }
+
+    frame_ = frame;
+    frame_valid_ = false;
+
+    if(frame.length > buffer_.getNumSamples() ||
+       frame_pyramids_.empty() || frame.length > frame_pyramids_[0].getCapacity())
+    {
+        return false;
+    }
+
+    // フレームの範囲だけを、リングバッファから直接ピラミッドに追加する。
+    // 読み込みが間に合わずに上書きされていた場合は、このフレームを破棄して次のフレームを待つ。
+    auto const &ring = audio_data_->getBuffer();
+    if(ring.isReadable(frame.start, frame.length) == false) { return false; }
+
+    for(int ch = 0; ch < (int)frame_pyramids_.size(); ++ch) {
+        auto const view = ring.getView(ch, frame.start, frame.length);
+        frame_pyramids_[ch].reset();
+        frame_pyramids_[ch].push(view.first.data, view.first.size);
+        frame_pyramids_[ch].push(view.second.data, view.second.size);
+    }
+
+    if(ring.isIntact(frame.start) == false) { return false; }
+
+    frame_valid_ = true;
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "PluginProcessor.h"
+#include "PeakPyramid.h"
+
+// Processor が AudioData に書き込んだデータを読み込み、波形表示用のデータを更新するクラス
+//
+// GUI を持たないので、エディタ以外（ベンチマークなど）からも同じ読み込み処理を実行できる。
+struct CaptureReader
+{
+    //! update() でリングバッファからデータを読み込んだ方法ごとの回数
+    struct ReadStats
+    {
+        //! リングバッファのデータを、コピーせずに直接ピラミッドに追加した回数
+        std::int64_t num_direct = 0;
+        //! 読み込むデータが多いため、一度コピーしてからピラミッドに追加した回数
+        std::int64_t num_copied = 0;
+        //! 直接追加している間に書き込み側に追い越され、追加した範囲を無音に置き換えた回数
+        std::int64_t num_invalidated = 0;
+    };
+
+    //! コンストラクタ
+    /*! @param history_seconds 波形表示用に保持するデータの長さ [秒]
+     */
+    explicit
+    CaptureReader(double history_seconds);
+
+    //! 前回の呼び出し以降に書き込まれたデータを audio_data から読み込み、波形表示用のデータを更新する。
+    /*! サンプルレートやチャンネル数が変わっていた場合は、保持しているデータを破棄して読み込みを始め直す。
+     *  AudioData が作り直されただけの場合や、読み込み中に書き込み側に追い越された場合は、それまでのデータを残して続きに追加する。
+     *  @return 読み込んだサンプル数
+     */
+    std::int64_t update(std::shared_ptr<AudioData const> audio_data, double sample_rate);
+
+    //! 波形表示用のデータのチャンネル数
+    /*! チャンネルは AudioData のリングバッファと同じく、
+     *  [エフェクト処理前の各チャンネル, エフェクト処理後の各チャンネル, サイドチェインの各チャンネル] の順に並ぶ。
+     */
+    int getNumChannels() const noexcept { return (int)pyramids_.size(); }
+
+    //! 指定したチャンネルの波形表示用のデータを返す。
+    PeakPyramid const & getPyramid(int channel) const { return pyramids_[channel]; }
+
+    //! トリガーによって新しいフレームが確定していたら、そのフレームのデータを読み込む。
+    /*! 直前の update() で使用した AudioData からフレームを読み込む。
+     *  @return 新しいフレームを読み込んだ場合は true
+     */
+    bool updateFrame();
+
+    //! 最後に読み込んだフレームがあるかどうかを返す。
+    bool hasFrame() const noexcept { return frame_.sequence != 0 && frame_valid_; }
+
+    //! 最後に読み込んだフレームの範囲を返す。
+    TriggeredFrame const & getFrame() const noexcept { return frame_; }
+
+    //! 最後に読み込んだフレームの、指定したチャンネルの波形表示用のデータを返す。
+    PeakPyramid const & getFramePyramid(int channel) const { return frame_pyramids_[channel]; }
+
+    //! 最後に update() を呼び出したときのサンプルレート
+    double getSampleRate() const noexcept { return sample_rate_; }
+
+    //! 最後に update() で使用した AudioData を返す。まだ update() を呼び出していない場合は nullptr
+    AudioData const * getAudioData() const noexcept { return audio_data_.get(); }
+
+    //! AudioData からの読み込み状況を返す。
+    AudioData::BufferType::Reader const & getReader() const noexcept { return reader_; }
+
+    //! update() での読み込み方法ごとの回数を返す。
+    ReadStats const & getReadStats() const noexcept { return read_stats_; }
+
+private:
+    double history_seconds_ = 0;
+    double sample_rate_ = 0;
+    juce::AudioSampleBuffer buffer_;
+    // buffer_ の各チャンネルに対応する、波形表示用のピラミッド
+    std::vector<PeakPyramid> pyramids_;
+    std::shared_ptr<AudioData const> audio_data_;
+    AudioData::BufferType::Reader reader_;
+    ReadStats read_stats_;
+    // トリガーによって確定したフレームのデータ
+    std::vector<PeakPyramid> frame_pyramids_;
+    TriggeredFrame frame_;
+    bool frame_valid_ = false;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// processBlock() が AudioData のリングバッファに書き込んだブロックの、位置と時刻とトランスポートの記録
+//
+// GUI 側はこの記録を使って、表示しているデータがいつ書き込まれたものか（表示の遅れ）や、
+// ホストのタイムライン上のどの位置に対応するかを求める。
+struct CaptureStamp
+{
+    //! 記録の通し番号。 0 の場合はまだ記録されていない。
+    std::int64_t sequence = 0;
+    //! ブロックの先頭と末尾の、リングバッファ上の通算のサンプル位置
+    std::int64_t start = 0;
+    std::int64_t end = 0;
+    //! ブロックの書き込みを終えた時刻 [ns] 。 ProcessorTelemetry::now() と同じ時計を使用する。
+    std::int64_t time_ns = 0;
+    //! ホストからトランスポートの位置を取得できたかどうか
+    bool has_transport = false;
+    //! ホストが再生中かどうか
+    bool is_playing = false;
+    //! ブロックの先頭での、ホストのタイムライン上の位置 [samples]
+    std::int64_t transport_position = 0;
+
+    //! リングバッファ上の通算のサンプル位置 position に対応する、タイムライン上の位置 [samples]
+    /*! このブロックからの距離でタイムラインが進んだものとして求めるので、
+     *  ループや再生位置の移動をまたぐ位置では実際の位置と一致しない。
+     */
+    std::int64_t toTransportPosition(std::int64_t position) const noexcept
+    {
+        return transport_position + (position - start);
+    }
+
+    //! リングバッファ上の通算のサンプル位置 position のサンプルが読み込めるようになった時刻 [ns] を推定する。
+    /*! position がこのブロックより前の場合は、実時間で再生されているものとして遡る。
+     */
+    std::int64_t estimateTime(std::int64_t position, double sample_rate) const noexcept
+    {
+        if(position >= end || sample_rate <= 0) { return time_ns; }
+        return time_ns - (std::int64_t)((end - position) * 1e9 / sample_rate);
+    }
+};
+
+// オーディオスレッドが公開する最新の CaptureStamp を、ロックせずに受け渡すクラス
+//
+// TriggeredFrameSlot と同じく、書き込み中は通し番号を奇数にし、読み込み側は番号が変わらなかった値だけを使用する。
+struct CaptureStampSlot
+{
+    //! stamp を公開する。 stamp.sequence は無視して、このスロットの通し番号を付ける。オーディオスレッドからのみ呼び出すこと。
+    void publish(CaptureStamp const &stamp)
+    {
+        auto const seq = seq_.load(std::memory_order_relaxed);
+
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        start_.store(stamp.start, std::memory_order_relaxed);
+        end_.store(stamp.end, std::memory_order_relaxed);
+        time_ns_.store(stamp.time_ns, std::memory_order_relaxed);
+        flags_.store((stamp.has_transport ? kHasTransport : 0) | (stamp.is_playing ? kIsPlaying : 0), std::memory_order_relaxed);
+        transport_position_.store(stamp.transport_position, std::memory_order_relaxed);
+
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    //! 最後に公開された記録を返す。
+    CaptureStamp load() const
+    {
+        for( ; ; ) {
+            auto const seq1 = seq_.load(std::memory_order_acquire);
+            if(seq1 % 2 != 0) { continue; }
+
+            CaptureStamp stamp;
+            stamp.start = start_.load(std::memory_order_relaxed);
+            stamp.end = end_.load(std::memory_order_relaxed);
+            stamp.time_ns = time_ns_.load(std::memory_order_relaxed);
+            auto const flags = flags_.load(std::memory_order_relaxed);
+            stamp.has_transport = (flags & kHasTransport) != 0;
+            stamp.is_playing = (flags & kIsPlaying) != 0;
+            stamp.transport_position = transport_position_.load(std::memory_order_relaxed);
+            stamp.sequence = seq1 / 2;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(seq_.load(std::memory_order_relaxed) == seq1) { return stamp; }
+        }
+    }
+
+private:
+    static constexpr int kHasTransport = 1;
+    static constexpr int kIsPlaying = 2;
+
+    std::atomic<std::int64_t> seq_ { 0 };
+    std::atomic<std::int64_t> start_ { 0 };
+    std::atomic<std::int64_t> end_ { 0 };
+    std::atomic<std::int64_t> time_ns_ { 0 };
+    std::atomic<int> flags_ { 0 };
+    std::atomic<std::int64_t> transport_position_ { 0 };
+};
@@ -0,0 +1,182 @@
+#include "Goniometer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SIMPLE_OSCILLOSCOPE_GONIO_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define SIMPLE_OSCILLOSCOPE_GONIO_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace
+{
+
+constexpr int kNumCells = Goniometer::kGridSize * Goniometer::kGridSize;
+
+//! 格子の番号は (行 << kGridShift) + 列 で求める。
+constexpr int kGridShift = 8;
+static_assert((1 << kGridShift) == Goniometer::kGridSize, "kGridShift must match the grid size");
+
+//! 減衰させた結果がこの値を下回った密度は 0 にする。非正規化数になって計算が遅くなるのを防ぐ。
+constexpr float kMinDensity = 1e-3f;
+
+//! Mid / Side に回転するときの係数。フルスケールの L, R が格子からはみ出さないように 1 / sqrt(2) を掛ける。
+constexpr float kRotate = 0.70710678f;
+
+//! 4 サンプル分の x, y 座標 (-1.0 .. 1.0) を格子の番号に変換する。
+void toCells(float const *x, float const *y, std::int32_t *cells)
+{
+    constexpr float kHalf = (Goniometer::kGridSize - 1) * 0.5f;
+    constexpr float kMax = (float)(Goniometer::kGridSize - 1);
+
+#if defined(SIMPLE_OSCILLOSCOPE_GONIO_SSE2)
+    auto const half = _mm_set1_ps(kHalf);
+    auto const zero = _mm_setzero_ps();
+    auto const max = _mm_set1_ps(kMax);
+    auto const col = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x), half), half), zero), max);
+    auto const row = _mm_min_ps(_mm_max_ps(_mm_sub_ps(half, _mm_mul_ps(_mm_loadu_ps(y), half)), zero), max);
+    auto const ci = _mm_cvtps_epi32(col);
+    auto const ri = _mm_cvtps_epi32(row);
+    _mm_storeu_si128((__m128i *)cells, _mm_add_epi32(_mm_slli_epi32(ri, kGridShift), ci));
+#elif defined(SIMPLE_OSCILLOSCOPE_GONIO_NEON)
+    auto const half = vdupq_n_f32(kHalf);
+    auto const zero = vdupq_n_f32(0.0f);
+    auto const max = vdupq_n_f32(kMax);
+    auto const col = vminq_f32(vmaxq_f32(vmlaq_f32(half, vld1q_f32(x), half), zero), max);
+    auto const row = vminq_f32(vmaxq_f32(vmlsq_f32(half, vld1q_f32(y), half), zero), max);
+    // 0.5 を足してから切り捨てることで、最も近い格子に丸める。
+    auto const ci = vcvtq_s32_f32(vaddq_f32(col, vdupq_n_f32(0.5f)));
+    auto const ri = vcvtq_s32_f32(vaddq_f32(row, vdupq_n_f32(0.5f)));
+    vst1q_s32(cells, vaddq_s32(vshlq_n_s32(ri, kGridShift), ci));
+#else
+    for(int i = 0; i < 4; ++i) {
+        auto const col = std::min(std::max(x[i] * kHalf + kHalf, 0.0f), kMax);
+        auto const row = std::min(std::max(kHalf - y[i] * kHalf, 0.0f), kMax);
+        cells[i] = ((std::int32_t)std::lround(row) << kGridShift) + (std::int32_t)std::lround(col);
+    }
+#endif
+}
+
+} // namespace
+
+Goniometer::Goniometer()
+:   density_(kNumCells, 0.0f)
+{}
+
+void Goniometer::reset()
+{
+    std::fill(density_.begin(), density_.end(), 0.0f);
+}
+
+void Goniometer::accumulate(float const *left, float const *right, int num_samples, Mode mode)
+{
+    float x[4];
+    float y[4];
+    std::int32_t cells[4];
+
+    for(int i = 0; i < num_samples; i += 4) {
+        auto const n = std::min(num_samples - i, 4);
+
+        for(int k = 0; k < 4; ++k) {
+            // 端数の分は、最後のサンプルを繰り返して 4 サンプルに揃え、加算しない。
+            auto const l = left[i + std::min(k, n - 1)];
+            auto const r = right[i + std::min(k, n - 1)];
+            if(mode == Mode::kMidSide) {
+                x[k] = (r - l) * kRotate;
+                y[k] = (l + r) * kRotate;
+            } else {
+                x[k] = l;
+                y[k] = r;
+            }
+        }
+
+        toCells(x, y, cells);
+
+        // 格子への加算は位置が重なることがあるので、一つずつ行う。
+        for(int k = 0; k < n; ++k) {
+            density_[cells[k]] += 1.0f;
+        }
+    }
+}
+
+void Goniometer::decay(float factor)
+{
+    static_assert(kNumCells % 4 == 0, "the kernels process four cells at a time");
+
+    auto *d = density_.data();
+
+#if defined(SIMPLE_OSCILLOSCOPE_GONIO_SSE2)
+    auto const f = _mm_set1_ps(factor);
+    auto const min = _mm_set1_ps(kMinDensity);
+    for(int i = 0; i < kNumCells; i += 4) {
+        auto const v = _mm_mul_ps(_mm_loadu_ps(d + i), f);
+        _mm_storeu_ps(d + i, _mm_and_ps(v, _mm_cmpge_ps(v, min)));
+    }
+#elif defined(SIMPLE_OSCILLOSCOPE_GONIO_NEON)
+    auto const min = vdupq_n_f32(kMinDensity);
+    for(int i = 0; i < kNumCells; i += 4) {
+        auto const v = vmulq_n_f32(vld1q_f32(d + i), factor);
+        vst1q_f32(d + i, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vcgeq_f32(v, min))));
+    }
+#else
+    for(int i = 0; i < kNumCells; ++i) {
+        auto const v = d[i] * factor;
+        d[i] = v >= kMinDensity ? v : 0.0f;
+    }
+#endif
+}
+
+void Goniometer::toneMap(juce::Image &image, float exposure) const
+{
+    jassert(image.getFormat() == juce::Image::SingleChannel);
+    jassert(image.getWidth() == kGridSize && image.getHeight() == kGridSize);
+
+    juce::Image::BitmapData bitmap(image, juce::Image::BitmapData::writeOnly);
+
+    for(int row = 0; row < kGridSize; ++row) {
+        auto const *d = density_.data() + row * kGridSize;
+        auto *dest = bitmap.getLinePointer(row);
+
+#if defined(SIMPLE_OSCILLOSCOPE_GONIO_SSE2)
+        auto const e = _mm_set1_ps(exposure);
+        auto const one = _mm_set1_ps(1.0f);
+        auto const scale = _mm_set1_ps(255.0f);
+        for(int x = 0; x < kGridSize; x += 16) {
+            __m128i v[4];
+            for(int k = 0; k < 4; ++k) {
+                auto const de = _mm_mul_ps(_mm_loadu_ps(d + x + k * 4), e);
+                v[k] = _mm_cvtps_epi32(_mm_mul_ps(_mm_div_ps(de, _mm_add_ps(one, de)), scale));
+            }
+
+            // 0 .. 255 の範囲に収まっているので、飽和させながら 8 ビットに詰める。
+            auto const lo = _mm_packs_epi32(v[0], v[1]);
+            auto const hi = _mm_packs_epi32(v[2], v[3]);
+            _mm_storeu_si128((__m128i *)(dest + x), _mm_packus_epi16(lo, hi));
+        }
+#elif defined(SIMPLE_OSCILLOSCOPE_GONIO_NEON)
+        auto const one = vdupq_n_f32(1.0f);
+        for(int x = 0; x < kGridSize; x += 8) {
+            uint16x4_t v[2];
+            for(int k = 0; k < 2; ++k) {
+                auto const de = vmulq_n_f32(vld1q_f32(d + x + k * 4), exposure);
+                // 逆数の近似値を Newton 法で 1 回補正する。
+                auto const den = vaddq_f32(one, de);
+                auto recip = vrecpeq_f32(den);
+                recip = vmulq_f32(vrecpsq_f32(den, recip), recip);
+                auto const ratio = vmulq_f32(de, recip);
+                v[k] = vqmovn_u32(vcvtq_u32_f32(vmulq_n_f32(ratio, 255.0f)));
+            }
+
+            vst1_u8(dest + x, vqmovn_u16(vcombine_u16(v[0], v[1])));
+        }
+#else
+        for(int x = 0; x < kGridSize; ++x) {
+            auto const de = d[x] * exposure;
+            dest[x] = (juce::uint8)std::min(255.0f, de / (1.0f + de) * 255.0f + 0.5f);
+        }
+#endif
+    }
+}
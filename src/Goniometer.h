@@ -0,0 +1,46 @@
+#pragma once
+
+#include <juce_graphics/juce_graphics.h>
+
+#include <cstdint>
+#include <vector>
+
+// ステレオの 2 チャンネルを XY 平面上の点として蓄積し、残光のある表示（ゴニオメーター）を作成するクラス
+//
+// 固定サイズの格子に、サンプルごとの点が当たった回数を浮動小数点数の密度として加算し、
+// 表示を更新するたびに密度を一定の割合で減衰させる。画像に変換するときは、密度をトーンマッピングして輝度にする。
+// 処理量は新しいサンプル数と格子の大きさだけで決まり、保持しているデータの長さには依存しない。
+struct Goniometer
+{
+    //! 格子の一辺の大きさ
+    static constexpr int kGridSize = 256;
+
+    //! 点の配置
+    enum class Mode : int {
+        //! 横軸を L 、縦軸を R とする。
+        kLeftRight = 1,
+        //! 45 度回転して、縦軸を Mid (L + R) 、横軸を Side (R - L) とする。モノラルの信号は縦線になる。
+        kMidSide,
+    };
+
+    Goniometer();
+
+    //! 密度をすべて 0 にする。
+    void reset();
+
+    //! left[i], right[i] (i = 0 .. num_samples - 1) を点として密度に加算する。
+    void accumulate(float const *left, float const *right, int num_samples, Mode mode);
+
+    //! 密度に factor (0.0 .. 1.0) を掛ける。
+    void decay(float factor);
+
+    //! 密度を輝度に変換して、 image に書き込む。
+    /*! image は kGridSize 四方の juce::Image::SingleChannel 形式の画像であること。
+     *  輝度は density * exposure / (1 + density * exposure) で、密度が高くなるほど 1.0 に近づく。
+     */
+    void toneMap(juce::Image &image, float exposure) const;
+
+private:
+    // [y][x] の順に並べた密度。 y = 0 が上端 (+1.0) に対応する。
+    std::vector<float> density_;
+};
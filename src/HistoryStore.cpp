@@ -0,0 +1,462 @@
+#include "HistoryStore.h"
+
+#include <cmath>
+#include <cstring>
+#include <set>
+
+#if ! JUCE_WINDOWS
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+
+constexpr char kMagic[8] = { 'S', 'O', 'S', 'C', 'H', 'I', 'S', 'T' };
+constexpr std::int32_t kVersion = 1;
+
+//! 同時に使用できる履歴ファイルの数
+constexpr int kMaxInstances = 16;
+
+//! 同じプロセス内のインスタンスが使用中の履歴ファイルの番号
+/*! InterProcessLock はプラットフォームによっては同じプロセス内では排他されないので、別に管理する。
+ */
+std::mutex g_slots_mutex;
+std::set<int> g_used_slots;
+
+//! file の先頭から size バイトのディスク上の領域を確保する。
+/*! 末尾だけを書き込んだファイルは領域が確保されていない（スパースな）ことがあり、
+ *  そのままマップして書き込むと、ディスクの空きがなくなったときに SIGBUS でプロセスが停止する。
+ *  @return 領域を確保できなかった場合は false
+ */
+bool reserveFileSpace(juce::File const &file, std::int64_t size)
+{
+#if JUCE_WINDOWS
+    // Windows ではファイルの末尾に書き込んだ時点で、途中の領域も確保されている。
+    juce::ignoreUnused(file, size);
+    return true;
+#else
+    auto const fd = ::open(file.getFullPathName().toRawUTF8(), O_RDWR);
+    if(fd < 0) { return false; }
+
+  #if JUCE_MAC
+    fstore_t store { F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+    auto const ok = ::fcntl(fd, F_PREALLOCATE, &store) != -1;
+  #else
+    auto const ok = ::posix_fallocate(fd, 0, (off_t)size) == 0;
+  #endif
+
+    ::close(fd);
+    return ok;
+#endif
+}
+
+} // namespace
+
+struct HistoryStore::Header
+{
+    char magic[8];
+    std::int32_t version;
+    std::int32_t num_channels;
+    double sample_rate;
+    std::int64_t capacity;
+    //! これまでに書き込まれたサンプル数の通算。次回同じファイルを開いたときに、この位置から追記する。
+    std::int64_t num_written;
+    //! このファイルを使用しているインスタンスの番号。使用していない場合は 0
+    std::int32_t slot;
+};
+
+HistoryStore::HistoryStore(AudioPluginAudioProcessor &processor)
+:   juce::Thread("HistoryStore")
+,   processor_(processor)
+{}
+
+HistoryStore::~HistoryStore()
+{
+    stop();
+}
+
+juce::File HistoryStore::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("SimpleOscilloscope")
+        .getChildFile("History");
+}
+
+std::int64_t HistoryStore::getFileSize(int num_channels, std::int64_t capacity)
+{
+    auto size = kHeaderSize + (std::int64_t)sizeof(float) * num_channels * capacity;
+    for(auto bin_size: kIndexBinSizes) {
+        size += (std::int64_t)sizeof(IndexEntry) * num_channels * (capacity / bin_size);
+    }
+
+    return size;
+}
+
+HistoryStore::Header * HistoryStore::getHeader() const
+{
+    return static_cast<Header *>(mapping_->getData());
+}
+
+float * HistoryStore::getSamples(int channel) const
+{
+    auto *base = static_cast<char *>(mapping_->getData()) + kHeaderSize;
+    return reinterpret_cast<float *>(base) + (std::int64_t)channel * capacity_;
+}
+
+HistoryStore::IndexEntry * HistoryStore::getIndex(int level, int channel) const
+{
+    auto *base = static_cast<char *>(mapping_->getData()) + kHeaderSize + (std::int64_t)sizeof(float) * num_channels_ * capacity_;
+    auto *entries = reinterpret_cast<IndexEntry *>(base);
+
+    for(int l = 0; l < level; ++l) {
+        entries += num_channels_ * (capacity_ / kIndexBinSizes[l]);
+    }
+
+    return entries + channel * (capacity_ / kIndexBinSizes[level]);
+}
+
+std::int64_t HistoryStore::getOldestPosition() const
+{
+    auto const guard = (std::int64_t)std::ceil(sample_rate_ * kGuardSeconds);
+    return std::max<std::int64_t>(getNumWritten() - capacity_ + guard, 0);
+}
+
+bool HistoryStore::start(juce::File const &directory, double seconds)
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    stopThread(2000);
+    close();
+
+    auto audio_data = processor_.getAudioData();
+    auto const sample_rate = processor_.getSampleRate();
+    if(audio_data == nullptr || sample_rate <= 0) { return false; }
+
+    auto const num_channels = (int)audio_data->getBuffer().getNumChannels();
+
+    // 索引の最も粗いレベルのエントリがちょうど収まるように切り上げる。
+    // サンプル列が kMaxFileBytes を超える場合は、収まる長さまで短くする。
+    auto const largest_bin = kIndexBinSizes[kNumLevels - 1];
+    auto const max_largest_bins = kMaxFileBytes / ((std::int64_t)sizeof(float) * num_channels * largest_bin);
+    auto const num_largest_bins = std::max<std::int64_t>(
+        std::min<std::int64_t>((std::int64_t)std::ceil(seconds * sample_rate / largest_bin), max_largest_bins), 2);
+    auto const capacity = num_largest_bins * largest_bin;
+
+    if(directory.createDirectory().failed()) { return false; }
+
+    // 他のインスタンスが使用していない番号のファイルを探す。
+    for(int slot = 1; slot <= kMaxInstances; ++slot) {
+        {
+            std::lock_guard<std::mutex> slots_lock(g_slots_mutex);
+            if(g_used_slots.count(slot) != 0) { continue; }
+        }
+
+        auto file_lock = std::make_unique<juce::InterProcessLock>("SimpleOscilloscopeHistory" + juce::String(slot));
+        if(file_lock->enter(0) == false) { continue; }
+
+        auto const file = directory.getChildFile("History-" + juce::String(slot) + ".sohist");
+        if(openFile(file, num_channels, sample_rate, capacity) == false) { return false; }
+
+        {
+            std::lock_guard<std::mutex> slots_lock(g_slots_mutex);
+            g_used_slots.insert(slot);
+        }
+
+        getHeader()->slot = slot;
+        file_lock_ = std::move(file_lock);
+        break;
+    }
+
+    if(mapping_ == nullptr) { return false; }
+
+    audio_data_ = audio_data;
+    reader_ = AudioData::BufferType::Reader(audio_data_->getBuffer().getNumWritten());
+    read_buffer_.setSize(num_channels, (int)std::ceil(sample_rate * kBatchSeconds));
+    silence_.assign((std::size_t)read_buffer_.getNumSamples(), 0.0f);
+    silence_channels_.assign((std::size_t)num_channels, silence_.data());
+    restoreAccumulators();
+
+    num_overruns_ = 0;
+    num_dropped_ = 0;
+
+    mapped_ = true;
+    startThread();
+    return true;
+}
+
+bool HistoryStore::openFile(juce::File const &file, int num_channels, double sample_rate, std::int64_t capacity)
+{
+    auto const size = getFileSize(num_channels, capacity);
+
+    // 同じ構成の履歴ファイルが残っていれば、その続きから追記する。
+    bool reuse = false;
+    if(file.existsAsFile() && file.getSize() == size) {
+        juce::FileInputStream in(file);
+        Header h {};
+        reuse = in.openedOk()
+             && in.read(&h, sizeof(h)) == (int)sizeof(h)
+             && std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0
+             && h.version == kVersion
+             && h.num_channels == num_channels
+             && h.sample_rate == sample_rate
+             && h.capacity == capacity
+             && h.num_written >= 0;
+    }
+
+    if(reuse == false) {
+        file.deleteFile();
+
+        if(file.getParentDirectory().getBytesFreeOnVolume() < size) { return false; }
+
+        // 末尾の 1 バイトだけを書き込んで、ファイルのサイズを決める。
+        juce::FileOutputStream out(file);
+        if(out.failedToOpen() || out.setPosition(size - 1) == false || out.writeByte(0) == false) { return false; }
+        out.flush();
+        if(out.getStatus().failed()) { return false; }
+    }
+
+    // 再利用するファイルも、途中がスパースなまま残っていることがあるので確保し直す。
+    if(reserveFileSpace(file, size) == false) {
+        if(reuse == false) { file.deleteFile(); }
+        return false;
+    }
+
+    mapping_ = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readWrite);
+    if(mapping_->getData() == nullptr || (std::int64_t)mapping_->getSize() != size) {
+        mapping_.reset();
+        return false;
+    }
+
+    num_channels_ = num_channels;
+    sample_rate_ = sample_rate;
+    capacity_ = capacity;
+
+    auto *header = getHeader();
+    if(reuse == false) {
+        std::memcpy(header->magic, kMagic, sizeof(kMagic));
+        header->version = kVersion;
+        header->num_channels = num_channels;
+        header->sample_rate = sample_rate;
+        header->capacity = capacity;
+        header->num_written = 0;
+    }
+
+    num_written_.store(header->num_written, std::memory_order_release);
+    return true;
+}
+
+void HistoryStore::restoreAccumulators()
+{
+    accumulators_.assign(kNumLevels * num_channels_, Accumulator {});
+
+    // 各レベルの書き込み途中のエントリを、一つ下のレベルの確定した範囲から作り直す。
+    // 一つ下のレベルで書き込み途中の範囲は、そのエントリが確定したときに加えられる。
+    auto const n = getNumWritten();
+
+    for(int level = 0; level < kNumLevels; ++level) {
+        auto const bin_size = kIndexBinSizes[level];
+        auto const begin = n / bin_size * bin_size;
+
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            auto &acc = accumulators_[level * num_channels_ + ch];
+
+            if(level == 0) {
+                auto const *samples = getSamples(ch);
+                for(auto p = begin; p < n; ++p) {
+                    acc.add(samples[p % capacity_]);
+                }
+            } else {
+                auto const lower_bin_size = kIndexBinSizes[level - 1];
+                auto const num_lower_bins = capacity_ / lower_bin_size;
+                auto const *lower = getIndex(level - 1, ch);
+                for(auto b = begin / lower_bin_size; b < n / lower_bin_size; ++b) {
+                    acc.add(lower[b % num_lower_bins]);
+                }
+            }
+        }
+    }
+}
+
+void HistoryStore::stop()
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    // 書き込みスレッドは終了する前に残りのデータを書き出す。
+    stopThread(2000);
+    close();
+}
+
+void HistoryStore::close()
+{
+    mapped_ = false;
+
+    if(mapping_ != nullptr) {
+        auto *header = getHeader();
+
+        {
+            std::lock_guard<std::mutex> slots_lock(g_slots_mutex);
+            g_used_slots.erase(header->slot);
+        }
+
+        header->slot = 0;
+
+        // マップを解除したときに、変更した内容がファイルに書き出される。
+        mapping_.reset();
+    }
+
+    file_lock_.reset();
+    audio_data_.reset();
+}
+
+void HistoryStore::run()
+{
+    while(threadShouldExit() == false) {
+        drain();
+        wait(kIntervalMs);
+    }
+
+    drain();
+}
+
+void HistoryStore::drain()
+{
+    if(audio_data_ == nullptr) { return; }
+
+    // prepareToPlay() によって AudioData が作り直されていたら、新しい AudioData の先頭から追記を続ける。
+    // チャンネル構成やサンプルレートが変わった場合は同じファイルに追記できないので、 start() し直すまで追記しない。
+    auto audio_data = processor_.getAudioData();
+    if(audio_data != audio_data_) {
+        if(audio_data == nullptr ||
+           (int)audio_data->getBuffer().getNumChannels() != num_channels_ ||
+           processor_.getSampleRate() != sample_rate_)
+        {
+            return;
+        }
+
+        audio_data_ = audio_data;
+        reader_ = AudioData::BufferType::Reader(0);
+    }
+
+    auto const &buffer = audio_data_->getBuffer();
+
+    // 読み込み位置から順に一度に kBatchSeconds ずつ読み込み、溜まっているデータがなくなるまで繰り返す。
+    for( ; ; ) {
+        auto const result = buffer.read(reader_, read_buffer_.getArrayOfWritePointers(), 0, read_buffer_.getNumSamples());
+
+        // 失われたデータは読み込んだデータより前の位置にあるので、先に無音で埋める。
+        if(result.num_dropped > 0) {
+            num_overruns_ += 1;
+            num_dropped_ += result.num_dropped;
+            appendSilence(result.num_dropped);
+        }
+
+        if(result.num_read > 0) {
+            append(read_buffer_.getArrayOfReadPointers(), result.num_read);
+        }
+
+        if(result.num_pending == 0) { break; }
+    }
+}
+
+void HistoryStore::appendSilence(std::int64_t length)
+{
+    auto const batch_size = (std::int64_t)silence_.size();
+
+    while(length > 0) {
+        auto const n = std::min(length, batch_size);
+        append(silence_channels_.data(), n);
+        length -= n;
+    }
+}
+
+void HistoryStore::append(float const * const *channels, std::int64_t length)
+{
+    auto const position = num_written_.load(std::memory_order_relaxed);
+
+    for(int ch = 0; ch < num_channels_; ++ch) {
+        auto *samples = getSamples(ch);
+        auto const *src = channels[ch];
+
+        // サンプル列をリングバッファに書き込む。
+        auto const offset = position % capacity_;
+        auto const num_copy1 = std::min(length, capacity_ - offset);
+        std::copy_n(src, num_copy1, samples + offset);
+        std::copy_n(src + num_copy1, length - num_copy1, samples);
+
+        // エントリが確定するたびに、一つ上のレベルの書き込み途中のエントリに加える。
+        for(std::int64_t i = 0; i < length; ++i) {
+            accumulators_[ch].add(src[i]);
+
+            auto const p = position + i + 1;
+            for(int level = 0; level < kNumLevels && p % kIndexBinSizes[level] == 0; ++level) {
+                auto &acc = accumulators_[level * num_channels_ + ch];
+                auto const entry = acc.toEntry();
+                auto const num_bins = capacity_ / kIndexBinSizes[level];
+                getIndex(level, ch)[(p / kIndexBinSizes[level] - 1) % num_bins] = entry;
+                acc = Accumulator {};
+
+                if(level + 1 < kNumLevels) {
+                    accumulators_[(level + 1) * num_channels_ + ch].add(entry);
+                }
+            }
+        }
+    }
+
+    // サンプル列と索引を書き終えてから、表示側に公開する。
+    num_written_.store(position + length, std::memory_order_release);
+    getHeader()->num_written = position + length;
+}
+
+bool HistoryStore::getColumns(int channel, double end, double num_samples, int num_columns, PeakPyramid::Column *dest) const
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if(mapped_.load() == false || channel < 0 || channel >= num_channels_ || num_columns <= 0) { return false; }
+
+    auto const samples_per_column = num_samples / num_columns;
+    auto const start = end - num_samples;
+
+    // 1 列あたりのサンプル数を超えない範囲で、最も粗いレベルを選ぶ。
+    int level = -1;
+    for(int l = 0; l < kNumLevels; ++l) {
+        if(kIndexBinSizes[l] > samples_per_column) { break; }
+        level = l;
+    }
+
+    std::int64_t const bin_size = (level < 0) ? 1 : kIndexBinSizes[level];
+    std::int64_t const num_bins = capacity_ / bin_size;
+    std::int64_t const bins_end = getNumWritten() / bin_size;
+    std::int64_t const bins_begin = (getOldestPosition() + bin_size - 1) / bin_size;
+
+    auto const *samples = getSamples(channel);
+    auto const *index = (level < 0) ? nullptr : getIndex(level, channel);
+
+    for(int c = 0; c < num_columns; ++c) {
+        auto const col_start = start + samples_per_column * c;
+        auto const col_end = col_start + samples_per_column;
+
+        auto b0 = (std::int64_t)std::floor(col_start / bin_size);
+        auto b1 = std::max<std::int64_t>((std::int64_t)std::ceil(col_end / bin_size), b0 + 1);
+        b0 = std::max(b0, bins_begin);
+        b1 = std::min(b1, bins_end);
+
+        auto &col = dest[c];
+        col = PeakPyramid::Column {};
+
+        if(b0 >= b1) { continue; }
+
+        Accumulator acc;
+        if(level < 0) {
+            for(auto b = b0; b < b1; ++b) { acc.add(samples[b % capacity_]); }
+        } else {
+            for(auto b = b0; b < b1; ++b) { acc.add(index[b % num_bins]); }
+        }
+
+        col.min = acc.min;
+        col.max = acc.max;
+        col.rms = (float)std::sqrt(acc.sumsq / ((b1 - b0) * bin_size));
+        col.valid = true;
+    }
+
+    return true;
+}
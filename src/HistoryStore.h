@@ -0,0 +1,180 @@
+#pragma once
+
+#include "PluginProcessor.h"
+#include "PeakPyramid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Processor が AudioData に書き込んだデータを、メモリマップしたファイル上のリングバッファに長時間分保持するクラス
+//
+// 書き込みスレッドは Recorder と同様に専用の Reader で AudioData のリングバッファを前回の続きから順に読み込み、
+// ファイル上のリングバッファへ追記すると同時に、 kIndexBinSizes[] のサンプル数ごとの最小値・最大値・二乗和の索引を更新する。
+// 書き込みが間に合わずに AudioData のリングバッファで上書きされたデータは、同じ長さの無音として追記して、
+// 履歴上の時間の間隔が実際の時間とずれないようにする。そのサンプル数は getNumDropped() で取得できる。
+// 履歴上の位置は AudioData のリングバッファ上の位置とは別の通算の位置で、 prepareToPlay() によって AudioData が作り直されると
+// その続きから追記する（作り直されるまでの間に書き込まれなかった時間は詰められる）。
+// 索引も同じファイルに保存されるので、次回同じ構成で開始したときには続きから追記され、過去の履歴もそのまま表示できる。
+//
+// 表示側は getColumns() で必要な範囲の索引だけを参照するので、ファイルのうち画面に表示している部分のページだけが読み込まれ、
+// 保持する時間の長さに関係なく常駐メモリは増えない。
+//
+// ファイルは start() のときにディスク上の領域をすべて確保してからマップするので、
+// 保存中にディスクの空きがなくなっても、マップした領域への書き込みでプロセスが停止することはない。
+// ファイルの大きさは kMaxFileBytes までに制限し、チャンネル数やサンプルレートが大きい場合は保持する長さを短くする。
+//
+// ファイルの構成:
+//   [Header (kHeaderSize バイト)]
+//   [チャンネルごとのサンプル列 (float × capacity)]
+//   [レベルごと・チャンネルごとの索引 (IndexEntry × capacity / kIndexBinSizes[level])]
+struct HistoryStore
+:   private juce::Thread
+{
+    //! 索引のレベルの数
+    static constexpr int kNumLevels = 3;
+
+    //! 索引の各レベルの、一つのエントリに対応するサンプル数
+    static constexpr std::int64_t kIndexBinSizes[kNumLevels] = { 256, 4096, 65536 };
+
+    //! 既定で保持する長さ [秒]
+    static constexpr double kDefaultSeconds = 60.0 * 60.0;
+
+    //! 履歴ファイルのサンプル列の大きさの上限 [バイト]
+    /*! ステレオ（エフェクト処理前後の 4 チャンネル）の場合、 48 kHz で 1 時間分 (約 2.8 GB) が収まる。
+     */
+    static constexpr std::int64_t kMaxFileBytes = std::int64_t(4) << 30;
+
+    //! コンストラクタ
+    /*! @param processor 保持するデータを書き込む Processor 。
+     *  書き込みスレッドから getAudioData() と getSampleRate() を呼び出す。
+     */
+    explicit
+    HistoryStore(AudioPluginAudioProcessor &processor);
+    ~HistoryStore() override;
+
+    //! 履歴の保存を開始する。
+    /*! directory に履歴のファイルを作成する。同時に起動している他のインスタンスとは別のファイルを使用する。
+     *  前回と同じチャンネル構成・サンプルレート・長さの履歴ファイルが残っている場合は、その続きから追記する。
+     *  保持する長さは、サンプル列が kMaxFileBytes を超えないように短くされる。実際の長さは getCapacity() で取得できる。
+     *  Processor の準備ができていない場合や、ファイルを作成できなかった場合、ディスクの空きが足りない場合は false を返す。
+     *  メッセージスレッドから呼び出すこと。
+     */
+    bool start(juce::File const &directory, double seconds = kDefaultSeconds);
+
+    //! 履歴の保存を終了して、ファイルを閉じる。
+    void stop();
+
+    bool isRunning() const { return mapped_.load(); }
+
+    //! 既定の保存先のディレクトリ
+    static juce::File getDefaultDirectory();
+
+    //! これまでに書き込まれたサンプル数の通算
+    std::int64_t getNumWritten() const { return num_written_.load(std::memory_order_acquire); }
+
+    //! 表示できる最も古いサンプルの通算位置
+    std::int64_t getOldestPosition() const;
+
+    //! 書き込みが間に合わずに失われ、無音で埋めたデータの回数とサンプル数。 start() で 0 に戻る。
+    std::int64_t getNumOverruns() const { return num_overruns_.load(); }
+    std::int64_t getNumDropped() const { return num_dropped_.load(); }
+
+    //! 保持できるサンプル数
+    std::int64_t getCapacity() const noexcept { return capacity_; }
+    int getNumChannels() const noexcept { return num_channels_; }
+    double getSampleRate() const noexcept { return sample_rate_; }
+
+    //! [end - num_samples, end) の範囲を num_columns 列に分けて、各列の最小値・最大値・RMS を dest に格納する。
+    /*! 1 列あたりのサンプル数を超えない範囲で最も粗い索引を使用し、 kIndexBinSizes[0] 未満の場合はサンプル列を直接参照する。
+     *  保持していない範囲の列は Column::valid が false になる。
+     *  メッセージスレッドから呼び出すこと。
+     *  @return 履歴の保存中でなく、列を求められなかった場合は false
+     */
+    bool getColumns(int channel, double end, double num_samples, int num_columns, PeakPyramid::Column *dest) const;
+
+private:
+    static constexpr std::int64_t kHeaderSize = 4096;
+    //! 一度に読み込む最大の長さ [秒]
+    static constexpr double kBatchSeconds = 0.25;
+    //! 書き込みの間隔 [ms]
+    static constexpr int kIntervalMs = 50;
+    //! 表示側が読み込み中に書き込み側に上書きされないように、最も古い部分から除外する長さ [秒]
+    static constexpr double kGuardSeconds = 1.0;
+
+    struct Header;
+
+    //! 索引の一つのエントリ
+    struct IndexEntry
+    {
+        float min;
+        float max;
+        float sumsq;
+    };
+
+    //! 書き込み途中の索引のエントリ
+    struct Accumulator
+    {
+        float min = std::numeric_limits<float>::max();
+        float max = std::numeric_limits<float>::lowest();
+        double sumsq = 0;
+
+        void add(float v)
+        {
+            min = std::min(min, v);
+            max = std::max(max, v);
+            sumsq += (double)v * v;
+        }
+
+        void add(IndexEntry const &e)
+        {
+            min = std::min(min, e.min);
+            max = std::max(max, e.max);
+            sumsq += e.sumsq;
+        }
+
+        IndexEntry toEntry() const { return { min, max, (float)sumsq }; }
+    };
+
+    AudioPluginAudioProcessor &processor_;
+
+    // start() / stop() と getColumns() が並行して呼び出されないようにする。
+    mutable std::mutex control_mutex_;
+
+    std::unique_ptr<juce::InterProcessLock> file_lock_;
+    std::unique_ptr<juce::MemoryMappedFile> mapping_;
+    std::atomic<bool> mapped_ { false };
+    std::atomic<std::int64_t> num_written_ { 0 };
+    std::atomic<std::int64_t> num_overruns_ { 0 };
+    std::atomic<std::int64_t> num_dropped_ { 0 };
+    int num_channels_ = 0;
+    double sample_rate_ = 0;
+    std::int64_t capacity_ = 0;
+
+    // 以下は保存中は書き込みスレッドからのみアクセスする。
+    std::shared_ptr<AudioData const> audio_data_;
+    AudioData::BufferType::Reader reader_;
+    juce::AudioSampleBuffer read_buffer_;
+    // 失われたデータの代わりに追記する無音。 read_buffer_ と同じ長さで、すべてのチャンネルが silence_ を参照する。
+    std::vector<float> silence_;
+    std::vector<float const *> silence_channels_;
+    // [レベル][チャンネル] の順に並べた、書き込み途中の索引のエントリ
+    std::vector<Accumulator> accumulators_;
+
+    Header * getHeader() const;
+    float * getSamples(int channel) const;
+    IndexEntry * getIndex(int level, int channel) const;
+    static std::int64_t getFileSize(int num_channels, std::int64_t capacity);
+
+    bool openFile(juce::File const &file, int num_channels, double sample_rate, std::int64_t capacity);
+    void restoreAccumulators();
+    void run() override;
+    void drain();
+    void append(float const * const *channels, std::int64_t length);
+    //! length サンプルの無音を追記する。
+    void appendSilence(std::int64_t length);
+    void close();
+};
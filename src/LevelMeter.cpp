@@ -0,0 +1,368 @@
+#include "LevelMeter.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SIMPLE_OSCILLOSCOPE_METER_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define SIMPLE_OSCILLOSCOPE_METER_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace
+{
+
+constexpr double kPi = 3.14159265358979323846;
+
+// ITU-R BS.1770 の K 特性のフィルタのパラメータ
+// 48 kHz 以外のサンプルレートでも同じ特性になるように、仕様の係数ではなくアナログのプロトタイプから係数を求める。
+constexpr double kShelfFrequency = 1681.974450955533;
+constexpr double kShelfGain = 3.999843853973347;
+constexpr double kShelfQ = 0.7071752369554196;
+constexpr double kHighpassFrequency = 38.13547087602444;
+constexpr double kHighpassQ = 0.5003270373238773;
+
+//! ラウドネスのオフセット [LUFS]
+constexpr double kLoudnessOffset = -0.691;
+
+//! モーメンタリー / ショートターム ラウドネスを求める区間 [秒]
+constexpr double kMomentarySeconds = 0.4;
+constexpr double kShortTermSeconds = 3.0;
+
+//! トゥルーピーク用の補間フィルタのカイザー窓のパラメータ
+constexpr double kKaiserBeta = 5.0;
+
+//! 第 1 種変形ベッセル関数 I0
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12) { break; }
+    }
+
+    return sum;
+}
+
+//! Transposed Direct Form II の biquad で 1 サンプルを処理する。
+inline double biquad(double const *c, double *s, double x) noexcept
+{
+    auto const y = c[0] * x + s[0];
+    s[0] = c[1] * x - c[3] * y + s[1];
+    s[1] = c[2] * x - c[4] * y;
+    return y;
+}
+
+//! オーバーサンプリングした 4 つの位相の値を SIMD のレーンに並べて計算し、絶対値の最大値を保持する。
+struct TruePeak
+{
+    static_assert(LevelMeter::kOversampling == 4, "the kernel holds one phase per lane");
+
+    //! 古い順に並んだ kTruePeakTaps 個のサンプルから、中央のサンプル間を補間した値を求めて最大値を更新する。
+    void push(float const *history, float const (*coeffs)[LevelMeter::kOversampling]) noexcept
+    {
+#if defined(SIMPLE_OSCILLOSCOPE_METER_SSE2)
+        auto acc = _mm_setzero_ps();
+        for(int k = 0; k < LevelMeter::kTruePeakTaps; ++k) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(history[k]), _mm_load_ps(coeffs[k])));
+        }
+        // 符号ビットを落として絶対値にする。
+        max_ = _mm_max_ps(max_, _mm_andnot_ps(_mm_set1_ps(-0.0f), acc));
+#elif defined(SIMPLE_OSCILLOSCOPE_METER_NEON)
+        auto acc = vdupq_n_f32(0.0f);
+        for(int k = 0; k < LevelMeter::kTruePeakTaps; ++k) {
+            acc = vmlaq_n_f32(acc, vld1q_f32(coeffs[k]), history[k]);
+        }
+        max_ = vmaxq_f32(max_, vabsq_f32(acc));
+#else
+        for(int p = 0; p < LevelMeter::kOversampling; ++p) {
+            float acc = 0;
+            for(int k = 0; k < LevelMeter::kTruePeakTaps; ++k) {
+                acc += history[k] * coeffs[k][p];
+            }
+            max_[p] = std::max(max_[p], std::abs(acc));
+        }
+#endif
+    }
+
+    float get() const noexcept
+    {
+#if defined(SIMPLE_OSCILLOSCOPE_METER_SSE2)
+        auto v = _mm_max_ps(max_, _mm_movehl_ps(max_, max_));
+        v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+#elif defined(SIMPLE_OSCILLOSCOPE_METER_NEON)
+        auto const pair = vmax_f32(vget_low_f32(max_), vget_high_f32(max_));
+        return vget_lane_f32(vpmax_f32(pair, pair), 0);
+#else
+        return *std::max_element(max_, max_ + LevelMeter::kOversampling);
+#endif
+    }
+
+private:
+#if defined(SIMPLE_OSCILLOSCOPE_METER_SSE2)
+    __m128 max_ = _mm_setzero_ps();
+#elif defined(SIMPLE_OSCILLOSCOPE_METER_NEON)
+    float32x4_t max_ = vdupq_n_f32(0.0f);
+#else
+    float max_[LevelMeter::kOversampling] = {};
+#endif
+};
+
+} // namespace
+
+//==============================================================================
+void LevelMeter::Frame::merge(Frame const &other)
+{
+    num_samples += other.num_samples;
+
+    for(int b = 0; b < kNumBuses; ++b) {
+        auto &dest = buses[b];
+        auto const &src = other.buses[b];
+
+        dest.num_channels = src.num_channels;
+        for(int ch = 0; ch < kMaxChannels; ++ch) {
+            dest.peak[ch] = std::max(dest.peak[ch], src.peak[ch]);
+            dest.true_peak[ch] = std::max(dest.true_peak[ch], src.true_peak[ch]);
+            dest.sum_squares[ch] += src.sum_squares[ch];
+        }
+
+        dest.sum_lr += src.sum_lr;
+        dest.sum_ll += src.sum_ll;
+        dest.sum_rr += src.sum_rr;
+        dest.momentary = src.momentary;
+        dest.short_term = src.short_term;
+    }
+}
+
+//==============================================================================
+LevelMeter::LevelMeter()
+{
+    // サンプル間を 1 / kOversampling 刻みで補間する、カイザー窓を掛けた sinc 関数の係数
+    // 位相 0 は元のサンプルそのものになるので、サンプルピークもトゥルーピークに含まれる。
+    constexpr int kHalf = kTruePeakTaps / 2;
+    auto const i0_beta = besselI0(kKaiserBeta);
+
+    for(int p = 0; p < kOversampling; ++p) {
+        auto const frac = (double)p / kOversampling;
+        double sum = 0;
+        double coeffs[kTruePeakTaps];
+        for(int k = 0; k < kTruePeakTaps; ++k) {
+            // k = kHalf - 1 と kHalf のサンプルの間を補間する。
+            auto const x = (k - (kHalf - 1)) - frac;
+            auto const sinc = (x == 0) ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            auto const r = x / kHalf;
+            auto const window = (std::abs(r) >= 1.0) ? 0.0 : besselI0(kKaiserBeta * std::sqrt(1.0 - r * r)) / i0_beta;
+            coeffs[k] = sinc * window;
+            sum += coeffs[k];
+        }
+
+        // 直流の利得を 1 にする。
+        for(int k = 0; k < kTruePeakTaps; ++k) {
+            true_peak_coeffs_[k][p] = (float)(coeffs[k] / sum);
+        }
+    }
+}
+
+void LevelMeter::prepare(int num_channels, double sample_rate)
+{
+    jassert(sample_rate > 0);
+
+    sample_rate_ = sample_rate;
+    sub_block_length_ = std::max<std::int64_t>(1, (std::int64_t)std::round(sample_rate * kSubBlockSeconds));
+
+    // 高域のシェルビングフィルタ
+    {
+        auto const k = std::tan(kPi * kShelfFrequency / sample_rate);
+        auto const vh = std::pow(10.0, kShelfGain / 20.0);
+        auto const vb = std::pow(vh, 0.4996667741545416);
+        auto const a0 = 1.0 + k / kShelfQ + k * k;
+        shelf_coeffs_[0] = (vh + vb * k / kShelfQ + k * k) / a0;
+        shelf_coeffs_[1] = 2.0 * (k * k - vh) / a0;
+        shelf_coeffs_[2] = (vh - vb * k / kShelfQ + k * k) / a0;
+        shelf_coeffs_[3] = 2.0 * (k * k - 1.0) / a0;
+        shelf_coeffs_[4] = (1.0 - k / kShelfQ + k * k) / a0;
+    }
+
+    // 低域のハイパスフィルタ
+    {
+        auto const k = std::tan(kPi * kHighpassFrequency / sample_rate);
+        auto const a0 = 1.0 + k / kHighpassQ + k * k;
+        highpass_coeffs_[0] = 1.0;
+        highpass_coeffs_[1] = -2.0;
+        highpass_coeffs_[2] = 1.0;
+        highpass_coeffs_[3] = 2.0 * (k * k - 1.0) / a0;
+        highpass_coeffs_[4] = (1.0 - k / kHighpassQ + k * k) / a0;
+    }
+
+    // BS.1770 のチャンネルの重み。 5.1ch (L, R, C, LFE, Ls, Rs) の場合は LFE を除外し、サラウンドを 1.41 倍にする。
+    channel_weights_.fill(1.0);
+    if(num_channels == 6) {
+        channel_weights_[3] = 0.0;
+        channel_weights_[4] = 1.41;
+        channel_weights_[5] = 1.41;
+    }
+
+    reset();
+}
+
+void LevelMeter::reset() noexcept
+{
+    for(auto &state : states_) {
+        state.channels.fill(ChannelState {});
+        state.sub_blocks.fill(SubBlock {});
+        state.sub_block_pos = 0;
+        state.current = SubBlock {};
+    }
+
+    frame_ = Frame {};
+}
+
+//==============================================================================
+double LevelMeter::processChannels(BusState &state, BusStats &stats, float const * const * data, int channel,
+                                   int count, int length) noexcept
+{
+    jassert(count == 1 || count == 2);
+
+    // 1 サンプルを処理して、ピーク・二乗和・K 特性の二乗和・トゥルーピークを更新する。
+    auto step = [this](ChannelState &s, float x, float &peak, double &sum_sq, double &k_sum, TruePeak &tp) {
+        peak = std::max(peak, std::abs(x));
+        sum_sq += (double)x * x;
+
+        auto const y = biquad(highpass_coeffs_, s.highpass, biquad(shelf_coeffs_, s.shelf, x));
+        k_sum += y * y;
+
+        s.history[s.pos] = x;
+        s.history[s.pos + kTruePeakTaps] = x;
+        s.pos = (s.pos + 1 == kTruePeakTaps) ? 0 : s.pos + 1;
+        tp.push(s.history + s.pos, true_peak_coeffs_);
+    };
+
+    float peak[2] = {};
+    double sum_sq[2] = {};
+    double k_sum[2] = {};
+    TruePeak tp[2];
+
+    auto &s0 = state.channels[channel];
+    auto const *x0 = data[channel];
+
+    if(count == 2) {
+        auto &s1 = state.channels[channel + 1];
+        auto const *x1 = data[channel + 1];
+        double lr = 0;
+        for(int i = 0; i < length; ++i) {
+            step(s0, x0[i], peak[0], sum_sq[0], k_sum[0], tp[0]);
+            step(s1, x1[i], peak[1], sum_sq[1], k_sum[1], tp[1]);
+            lr += (double)x0[i] * x1[i];
+        }
+
+        stats.sum_lr += lr;
+        stats.sum_ll += sum_sq[0];
+        stats.sum_rr += sum_sq[1];
+    } else {
+        for(int i = 0; i < length; ++i) {
+            step(s0, x0[i], peak[0], sum_sq[0], k_sum[0], tp[0]);
+        }
+    }
+
+    double energy = 0;
+    for(int k = 0; k < count; ++k) {
+        auto const ch = channel + k;
+        stats.peak[ch] = std::max(stats.peak[ch], peak[k]);
+        stats.true_peak[ch] = std::max(stats.true_peak[ch], tp[k].get());
+        stats.sum_squares[ch] += sum_sq[k];
+        energy += channel_weights_[ch] * k_sum[k];
+    }
+
+    return energy;
+}
+
+void LevelMeter::process(Bus bus, float const * const * data, int num_channels, int length) noexcept
+{
+    auto &state = states_[(int)bus];
+    auto &stats = frame_.buses[(int)bus];
+
+    num_channels = std::min(num_channels, kMaxChannels);
+    stats.num_channels = num_channels;
+    if(length <= 0 || sample_rate_ <= 0) { return; }
+
+    // 先頭の 2 チャンネルは相関を求めるために同じループで処理する。それ以外のチャンネルは 1 チャンネルずつ処理する。
+    double energy = 0;
+    int ch = 0;
+    if(num_channels >= 2) {
+        energy += processChannels(state, stats, data, 0, 2, length);
+        ch = 2;
+    }
+
+    for(; ch < num_channels; ++ch) {
+        energy += processChannels(state, stats, data, ch, 1, length);
+    }
+
+    // ブロックの境界はラウドネスの区間の境界と揃わないので、区間の長さを超えたブロックで区間を閉じる。
+    // 区間ごとにサンプル数を保持して平均を取るので、ブロックが区間より長くても結果は正しい。
+    state.current.energy += energy;
+    state.current.num_samples += length;
+    if(state.current.num_samples >= sub_block_length_) {
+        state.sub_blocks[state.sub_block_pos] = state.current;
+        state.sub_block_pos = (state.sub_block_pos + 1) % kNumSubBlocks;
+        state.current = SubBlock {};
+    }
+
+    stats.momentary = getLoudness(state, kMomentarySeconds);
+    stats.short_term = getLoudness(state, kShortTermSeconds);
+}
+
+void LevelMeter::publish(int length) noexcept
+{
+    frame_.num_samples = length;
+
+    int start1, size1, start2, size2;
+    fifo_.prepareToWrite(1, start1, size1, start2, size2);
+    if(size1 > 0) {
+        fifo_frames_[(size_t)start1] = frame_;
+        fifo_.finishedWrite(1);
+    } else {
+        num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // ラウドネスはブロックごとに計算し直すので、ピークと二乗和だけを次のブロックのためにクリアする。
+    for(auto &stats : frame_.buses) {
+        auto const momentary = stats.momentary;
+        auto const short_term = stats.short_term;
+        stats = BusStats {};
+        stats.momentary = momentary;
+        stats.short_term = short_term;
+    }
+}
+
+bool LevelMeter::pop(Frame &frame) noexcept
+{
+    int start1, size1, start2, size2;
+    fifo_.prepareToRead(1, start1, size1, start2, size2);
+    if(size1 == 0) { return false; }
+
+    frame = fifo_frames_[(size_t)start1];
+    fifo_.finishedRead(1);
+    return true;
+}
+
+float LevelMeter::getLoudness(BusState const &state, double window_seconds) const noexcept
+{
+    auto const window = (std::int64_t)(window_seconds * sample_rate_);
+
+    double energy = 0;
+    std::int64_t num_samples = 0;
+    for(int i = 1; i <= kNumSubBlocks && num_samples < window; ++i) {
+        auto const &sub = state.sub_blocks[(state.sub_block_pos - i + kNumSubBlocks) % kNumSubBlocks];
+        if(sub.num_samples == 0) { break; }
+        energy += sub.energy;
+        num_samples += sub.num_samples;
+    }
+
+    if(num_samples == 0 || energy <= 0) { return kSilence; }
+
+    return std::max(kSilence, (float)(kLoudnessOffset + 10.0 * std::log10(energy / num_samples)));
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// エフェクト処理前後のメインバスのレベルを、オーディオスレッドでブロックごとに計測するクラス
+//
+// 一つのバスについて、ピーク・トゥルーピーク (4 倍オーバーサンプリング)・二乗和・先頭 2 チャンネルの相関・
+// K 特性で重み付けしたラウドネス (モーメンタリー 400 ms / ショートターム 3 s) を、各サンプルを一度だけ読む処理でまとめて求める。
+// ブロックごとの計測結果は、ロックを使用しない単一生産者・単一消費者の FIFO で GUI スレッドに渡す。
+// FIFO が一杯の場合、そのブロックの計測結果は破棄される。
+//
+// prepare() 以外はメモリを確保しないので、 process() と publish() はオーディオスレッドから呼び出せる。
+struct LevelMeter
+{
+    //! 計測するチャンネル数の上限。これを超えるチャンネルは計測しない。
+    static constexpr int kMaxChannels = 8;
+
+    //! トゥルーピークを求めるためのオーバーサンプリングの倍率と、1 位相あたりのタップ数
+    static constexpr int kOversampling = 4;
+    static constexpr int kTruePeakTaps = 12;
+
+    //! 計測結果を渡す FIFO の大きさ [ブロック]
+    static constexpr int kFifoSize = 64;
+
+    //! ラウドネスを計算できない場合の値 [LUFS]
+    static constexpr float kSilence = -100.0f;
+
+    //! 計測するバス
+    enum class Bus : int {
+        kPre,
+        kPost,
+        kNumBuses,
+    };
+
+    static constexpr int kNumBuses = (int)Bus::kNumBuses;
+
+    //! 一つのバスの計測結果
+    struct BusStats
+    {
+        int num_channels = 0;
+        //! サンプル値の絶対値の最大値
+        std::array<float, kMaxChannels> peak {};
+        //! オーバーサンプリングして求めたサンプル間の値も含めた、絶対値の最大値
+        std::array<float, kMaxChannels> true_peak {};
+        //! サンプル値の二乗和
+        std::array<double, kMaxChannels> sum_squares {};
+        //! 先頭 2 チャンネル (L, R) の積和と二乗和。相関係数は getCorrelation() で求める。
+        double sum_lr = 0;
+        double sum_ll = 0;
+        double sum_rr = 0;
+        //! 計測した時点でのモーメンタリー / ショートターム ラウドネス [LUFS]
+        float momentary = kSilence;
+        float short_term = kSilence;
+
+        //! L, R の相関係数 (-1.0 .. 1.0) 。無音の場合は 0
+        double getCorrelation() const
+        {
+            auto const denom = std::sqrt(sum_ll * sum_rr);
+            return denom > 0 ? sum_lr / denom : 0.0;
+        }
+    };
+
+    //! 1 ブロック分の計測結果
+    struct Frame
+    {
+        int num_samples = 0;
+        std::array<BusStats, kNumBuses> buses;
+
+        //! other の計測結果を、 other の方が新しいものとしてまとめる。
+        /*! ピークは最大値を、二乗和と積和は合計を取り、ラウドネスは other の値を使用する。
+         */
+        void merge(Frame const &other);
+    };
+
+    LevelMeter();
+
+    //! 計測を始める前に呼び出す。オーディオスレッドと並行して呼び出さないこと。
+    void prepare(int num_channels, double sample_rate);
+
+    //! フィルタの状態とラウドネスの履歴を破棄する。
+    void reset() noexcept;
+
+    //! bus のデータ length サンプル分を計測する。
+    void process(Bus bus, float const * const * data, int num_channels, int length) noexcept;
+
+    //! process() で計測した結果を 1 ブロック分として FIFO に書き込む。
+    void publish(int length) noexcept;
+
+    //! FIFO から最も古い計測結果を取り出す。 GUI スレッドなど一つのスレッドから呼び出す。
+    /*! @return 取り出した場合は true
+     */
+    bool pop(Frame &frame) noexcept;
+
+    //! FIFO が一杯で破棄した計測結果の数
+    std::int64_t getNumDropped() const noexcept { return num_dropped_.load(std::memory_order_relaxed); }
+
+private:
+    //! ラウドネスを求める区間の単位 [秒] と、保持する区間の数
+    static constexpr double kSubBlockSeconds = 0.1;
+    static constexpr int kNumSubBlocks = 64;
+
+    //! チャンネルごとのフィルタの状態
+    struct ChannelState
+    {
+        // K 特性の 2 段の biquad の状態 (Transposed Direct Form II)
+        double shelf[2] = {};
+        double highpass[2] = {};
+        // トゥルーピーク用の過去のサンプル。同じ値を pos と pos + kTruePeakTaps の両方に書き込み、常に連続した領域として読めるようにする。
+        alignas(16) float history[kTruePeakTaps * 2] = {};
+        int pos = 0;
+    };
+
+    //! K 特性のフィルタを通したサンプルの二乗和を、 kSubBlockSeconds ごとにまとめたもの
+    struct SubBlock
+    {
+        double energy = 0;
+        std::int64_t num_samples = 0;
+    };
+
+    struct BusState
+    {
+        std::array<ChannelState, kMaxChannels> channels;
+        std::array<SubBlock, kNumSubBlocks> sub_blocks;
+        int sub_block_pos = 0;
+        SubBlock current;
+    };
+
+    // [タップ][位相] の順に並べた、トゥルーピーク用の補間フィルタの係数
+    alignas(16) float true_peak_coeffs_[kTruePeakTaps][kOversampling];
+
+    // K 特性のフィルタの係数 (b0, b1, b2, a1, a2)
+    double shelf_coeffs_[5] = {};
+    double highpass_coeffs_[5] = {};
+    // チャンネルごとのラウドネスの重み
+    std::array<double, kMaxChannels> channel_weights_ {};
+    double sample_rate_ = 0;
+    std::int64_t sub_block_length_ = 0;
+
+    std::array<BusState, kNumBuses> states_;
+    Frame frame_;
+
+    juce::AbstractFifo fifo_ { kFifoSize };
+    std::array<Frame, kFifoSize> fifo_frames_;
+    std::atomic<std::int64_t> num_dropped_ { 0 };
+
+    //! channel から count チャンネル (1 または 2) 分を計測する。 count が 2 の場合は、2 つのチャンネルの相関も求める。
+    /*! @return K 特性のフィルタを通したサンプルの、チャンネルの重みを掛けた二乗和
+     */
+    double processChannels(BusState &state, BusStats &stats, float const * const * data, int channel, int count,
+                           int length) noexcept;
+
+    //! sub_blocks の新しいものから、合計 window_seconds 秒以上になるまでのラウドネスを求める。
+    float getLoudness(BusState const &state, double window_seconds) const noexcept;
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// 波形表示用に、サンプル列の最小値・最大値・二乗和を複数の解像度で保持するクラス
+//
+// レベル 0 は生のサンプル列で、レベル k (k >= 1) は kFactor^k サンプルごとの最小値・最大値・二乗和を保持する。
+// サンプルを追加するたびに、新たに確定したビンの分だけ各レベルを更新する。
+// 表示時には、 1 ピクセルあたりのサンプル数に応じたレベルを選ぶことで、
+// 表示する時間幅に関係なくピクセル数に比例した計算量で各列の値を求められる。
+struct PeakPyramid
+{
+    //! 表示上の一列分の値
+    struct Column
+    {
+        float min = 0;
+        float max = 0;
+        float rms = 0;
+        //! この列に対応するデータが存在するかどうか
+        bool valid = false;
+    };
+
+    //! 一つ上のレベルに進むごとに、ビンあたりのサンプル数が何倍になるか
+    static constexpr std::int64_t kFactor = 4;
+
+    //! 空のピラミッドを構築する
+    PeakPyramid()
+    {}
+
+    //! コンストラクタ
+    //! 直近 capacity サンプル分のデータを保持するピラミッドを構築する。
+    /*! @pre capacity >= 0
+     */
+    explicit
+    PeakPyramid(std::int64_t capacity)
+    :   capacity_(capacity)
+    {
+        raw_.resize(capacity);
+
+        for(std::int64_t bin_size = kFactor; bin_size <= capacity; bin_size *= kFactor) {
+            Level level;
+            level.bin_size = bin_size;
+            // 書き込み途中のレベルの更新で参照する分の余裕を持たせる。
+            level.num_bins = capacity / bin_size + 2;
+            level.mins.resize(level.num_bins);
+            level.maxs.resize(level.num_bins);
+            level.sumsqs.resize(level.num_bins);
+            levels_.push_back(std::move(level));
+        }
+    }
+
+    //! 保持するサンプル数
+    std::int64_t getCapacity() const noexcept { return capacity_; }
+
+    //! これまでに追加されたサンプル数の合計
+    std::int64_t getNumPushed() const noexcept { return num_pushed_; }
+
+    //! 追加されたデータを破棄する。
+    void reset()
+    {
+        num_pushed_ = 0;
+    }
+
+    //! 最後に追加した length サンプルを取り消す。
+    /*! 取り消した範囲は、次に push() したデータで置き換えられる。それより前のデータと上位のレベルはそのまま残る。
+     *  取り消した範囲を含むビンは次の push() で計算し直すので、その計算に必要な下位のデータが上書きされていないように、
+     *  length は capacity / 4 までに制限する。
+     *  @pre length <= getNumPushed() && length <= getCapacity() / 4
+     */
+    void rewind(std::int64_t length)
+    {
+        assert(length >= 0 && length <= num_pushed_ && length <= capacity_ / 4);
+        num_pushed_ -= length;
+    }
+
+    //! サンプル列を追加する。
+    void push(float const *data, std::int64_t length)
+    {
+        if(capacity_ == 0) { return; }
+
+        // 一度に capacity_ を超えて追加すると、ビンの計算に必要な下位のデータが上書きされてしまうので、
+        // 分割して追加する。
+        auto const max_chunk = std::max<std::int64_t>(capacity_ / 2, 1);
+
+        while(length > 0) {
+            auto const num = std::min(length, max_chunk);
+            pushChunk(data, num);
+            data += num;
+            length -= num;
+        }
+    }
+
+    //! 通算のサンプル位置で [end - num_samples, end) の範囲を num_columns 個の列に等分し、
+    //! 各列の最小値・最大値・RMS を dest に書き込む。
+    /*! 保持していない範囲に対応する列は Column::valid が false になる。
+     *  @pre dest に num_columns 個の要素を書き込めること。
+     */
+    void getColumns(double end, double num_samples, int num_columns, Column *dest) const
+    {
+        if(num_columns <= 0) { return; }
+
+        auto const samples_per_column = num_samples / num_columns;
+        auto const start = end - num_samples;
+
+        // 1 列あたりのサンプル数を超えない範囲で、最も粗いレベルを選ぶ。
+        int level_index = -1;
+        for(int i = 0; i < (int)levels_.size(); ++i) {
+            if(levels_[i].bin_size > samples_per_column) { break; }
+            level_index = i;
+        }
+
+        std::int64_t const bin_size = (level_index < 0) ? 1 : levels_[level_index].bin_size;
+        std::int64_t const bins_end = num_pushed_ / bin_size;
+        std::int64_t const bins_begin = std::max<std::int64_t>(num_pushed_ - capacity_, 0) / bin_size
+                                      + ((level_index < 0) ? 0 : 1);
+
+        for(int c = 0; c < num_columns; ++c) {
+            auto const col_start = start + samples_per_column * c;
+            auto const col_end = col_start + samples_per_column;
+
+            auto b0 = (std::int64_t)std::floor(col_start / bin_size);
+            auto b1 = std::max<std::int64_t>((std::int64_t)std::ceil(col_end / bin_size), b0 + 1);
+            b0 = std::max(b0, bins_begin);
+            b1 = std::min(b1, bins_end);
+
+            auto &col = dest[c];
+            col = Column {};
+
+            if(b0 >= b1) { continue; }
+
+            float mn = std::numeric_limits<float>::max();
+            float mx = std::numeric_limits<float>::lowest();
+            double sumsq = 0;
+
+            if(level_index < 0) {
+                for(auto b = b0; b < b1; ++b) {
+                    auto const v = raw_[b % capacity_];
+                    mn = std::min(mn, v);
+                    mx = std::max(mx, v);
+                    sumsq += v * v;
+                }
+            } else {
+                auto const &level = levels_[level_index];
+                for(auto b = b0; b < b1; ++b) {
+                    auto const i = b % level.num_bins;
+                    mn = std::min(mn, level.mins[i]);
+                    mx = std::max(mx, level.maxs[i]);
+                    sumsq += level.sumsqs[i];
+                }
+            }
+
+            col.min = mn;
+            col.max = mx;
+            col.rms = (float)std::sqrt(sumsq / ((b1 - b0) * bin_size));
+            col.valid = true;
+        }
+    }
+
+    //! 通算のサンプル位置 position から length サンプル分の生のデータを dest に読み込む。
+    /*! @return 保持している範囲のデータをすべて読み込めた場合は true
+     */
+    bool getSamples(std::int64_t position, std::int64_t length, float *dest) const
+    {
+        if(position < std::max<std::int64_t>(num_pushed_ - capacity_, 0) ||
+           position + length > num_pushed_)
+        {
+            return false;
+        }
+
+        for(std::int64_t i = 0; i < length; ++i) {
+            dest[i] = raw_[(position + i) % capacity_];
+        }
+
+        return true;
+    }
+
+private:
+    struct Level
+    {
+        std::int64_t bin_size = 0;
+        std::int64_t num_bins = 0;
+        std::vector<float> mins;
+        std::vector<float> maxs;
+        std::vector<float> sumsqs;
+    };
+
+    std::int64_t capacity_ = 0;
+    std::int64_t num_pushed_ = 0;
+    std::vector<float> raw_;
+    std::vector<Level> levels_;
+
+    void pushChunk(float const *data, std::int64_t length)
+    {
+        auto const old_num_pushed = num_pushed_;
+
+        for(std::int64_t i = 0; i < length; ++i) {
+            raw_[(old_num_pushed + i) % capacity_] = data[i];
+        }
+
+        num_pushed_ += length;
+
+        // 新たに確定したビンだけを、一つ下のレベルから計算する。
+        for(int li = 0; li < (int)levels_.size(); ++li) {
+            auto &level = levels_[li];
+            auto const first_bin = old_num_pushed / level.bin_size;
+            auto const last_bin = num_pushed_ / level.bin_size;
+
+            for(auto b = first_bin; b < last_bin; ++b) {
+                float mn = std::numeric_limits<float>::max();
+                float mx = std::numeric_limits<float>::lowest();
+                float sumsq = 0;
+
+                if(li == 0) {
+                    for(std::int64_t j = b * kFactor, end = j + kFactor; j < end; ++j) {
+                        auto const v = raw_[j % capacity_];
+                        mn = std::min(mn, v);
+                        mx = std::max(mx, v);
+                        sumsq += v * v;
+                    }
+                } else {
+                    auto const &lower = levels_[li - 1];
+                    for(std::int64_t j = b * kFactor, end = j + kFactor; j < end; ++j) {
+                        auto const k = j % lower.num_bins;
+                        mn = std::min(mn, lower.mins[k]);
+                        mx = std::max(mx, lower.maxs[k]);
+                        sumsq += lower.sumsqs[k];
+                    }
+                }
+
+                auto const i = b % level.num_bins;
+                level.mins[i] = mn;
+                level.maxs[i] = mx;
+                level.sumsqs[i] = sumsq;
+            }
+        }
+    }
+};
@@ -1,27 +1,67 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "HistoryStore.h"
+#include "Recorder.h"
 
 #include <cassert>
-#include <thread>
+#include <cmath>
+#include <iterator>
+#include <limits>
 
 constexpr int kButtonHeight = 20;
+constexpr int kNumControlRows = 4;
+constexpr int kScrollBarHeight = 12;
+//! メーターを表示する領域の幅
+constexpr int kMeterWidth = 160;
+//! メーターの表示範囲の下限 [dB]
+constexpr float kMeterMinDb = -60.0f;
+//! ピークホールドが下がる速さ [dB/秒]
+constexpr float kMeterPeakFallDbPerSecond = 20.0f;
+//! RMS と相関係数を平滑化する時定数 [秒]
+constexpr double kMeterSmoothingSeconds = 0.3;
+//! 履歴表示を開始したときに表示する長さ [秒]
+constexpr double kDefaultHistoryViewSeconds = 10.0;
+//! 波形の表示時間として選択できる最長の長さ (DurationId::k3s) [秒]。描画スレッドはこの長さのデータを保持する。
+constexpr double kMaxDisplaySeconds = 3.0;
+static_assert(kMaxDisplaySeconds <= AudioPluginAudioProcessor::kMaxFrameSeconds,
+              "the longest display duration must fit in a triggered frame");
 
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
 :   AudioProcessorEditor(&p)
 ,   processorRef (p)
-,   thumb_cache_(5)
-,   thumb_(1.0, afm_, thumb_cache_)
+,   waveform_renderer_(p, kMaxDisplaySeconds)
+,   spectrum_analyzer_(p, 512)
 {
     juce::ignoreUnused (processorRef);
 
     addAndMakeVisible(cmb_duration_);
-    addAndMakeVisible(btn_left_pre_);
-    addAndMakeVisible(btn_left_post_);
-    addAndMakeVisible(btn_right_pre_);
-    addAndMakeVisible(btn_right_post_);
+    addAndMakeVisible(btn_traces_);
+    addAndMakeVisible(btn_scroll_cache_);
+    addAndMakeVisible(btn_telemetry_);
+    addAndMakeVisible(btn_dump_telemetry_);
     addAndMakeVisible(sl_cutoff_);
-
+    addAndMakeVisible(cmb_slope_);
+    addAndMakeVisible(btn_history_);
+    addChildComponent(sb_history_);
+    addAndMakeVisible(cmb_trigger_mode_);
+    addAndMakeVisible(cmb_trigger_source_);
+    addAndMakeVisible(sl_trigger_level_);
+    addAndMakeVisible(sl_pre_trigger_);
+    addAndMakeVisible(sl_trigger_hysteresis_);
+    addAndMakeVisible(sl_trigger_holdoff_);
+    addAndMakeVisible(btn_spectrum_);
+    addAndMakeVisible(cmb_fft_size_);
+    addAndMakeVisible(cmb_fft_window_);
+    addAndMakeVisible(cmb_fft_overlap_);
+    addAndMakeVisible(cmb_fft_averaging_);
+    addAndMakeVisible(btn_record_);
+    addAndMakeVisible(cmb_view_);
+    addAndMakeVisible(btn_meters_);
+    addAndMakeVisible(btn_transport_);
+
+    cmb_duration_.addItem("100 us", (int)DurationId::k100us);
+    cmb_duration_.addItem("1 ms",   (int)DurationId::k1ms);
     cmb_duration_.addItem("10 ms",  (int)DurationId::k10ms);
     cmb_duration_.addItem("100 ms", (int)DurationId::k100ms);
     cmb_duration_.addItem("1 s",  (int)DurationId::k1s);
@@ -36,12 +76,23 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
         repaint();
     };
 
-    btn_left_pre_.setButtonText("Left Pre");
-    btn_left_post_.setButtonText("Left Post");
-    btn_right_pre_.setButtonText("Right Pre");
-    btn_right_post_.setButtonText("Right Post");
-    btn_left_pre_.setToggleState(true, juce::dontSendNotification);
-    btn_left_post_.setToggleState(true, juce::dontSendNotification);
+    btn_traces_.setButtonText("Traces");
+    btn_traces_.onClick = [this] { showTraceMenu(); };
+
+    // 有効な場合は、新たに追加された列だけを描画して、描画済みの波形はスクロールさせて再利用する。
+    btn_scroll_cache_.setButtonText("Scroll Cache");
+    btn_scroll_cache_.setToggleState(true, juce::dontSendNotification);
+    btn_scroll_cache_.onClick = [this] { repaint(); };
+
+    // 有効な場合は、ホストの再生中に波形の右端をトランスポートの位置が表示する長さの倍数になる位置に合わせる。
+    btn_transport_.setButtonText("Transport");
+    btn_transport_.onClick = [this] { repaint(); };
+
+    btn_telemetry_.setButtonText("Stats");
+    btn_telemetry_.onClick = [this] { repaint(); };
+
+    btn_dump_telemetry_.setButtonText("Dump Stats");
+    btn_dump_telemetry_.onClick = [this] { dumpTelemetry(); };
 
     sl_cutoff_.valueFromTextFunction = [this](juce::String const &str) -> double {
         return processorRef.stringToFloat(str);
@@ -66,59 +117,639 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     sl_cutoff_.setRange(0.0, 1.0);
     sl_cutoff_.setValue(0.5);
 
+    // アイテムの ID は、 slope_ パラメータの選択肢のインデックスに 1 を足したもの
+    cmb_slope_.addItemList(processorRef.slope_->choices, 1);
+    cmb_slope_.setSelectedId(processorRef.slope_->getIndex() + 1, juce::dontSendNotification);
+    cmb_slope_.onChange = [this] {
+        auto id = cmb_slope_.getSelectedId();
+        if(id != 0) {
+            processorRef.slope_->beginChangeGesture();
+            *processorRef.slope_ = id - 1;
+            processorRef.slope_->endChangeGesture();
+        }
+    };
+
+    auto &trigger = processorRef.getTriggerEngine();
+
+    cmb_trigger_mode_.addItem("Free Run", (int)TriggerEngine::Mode::kOff);
+    cmb_trigger_mode_.addItem("Rising Edge", (int)TriggerEngine::Mode::kRising);
+    cmb_trigger_mode_.addItem("Falling Edge", (int)TriggerEngine::Mode::kFalling);
+    cmb_trigger_mode_.setSelectedId((int)trigger.getMode(), juce::dontSendNotification);
+    cmb_trigger_mode_.onChange = [this] {
+        auto id = cmb_trigger_mode_.getSelectedId();
+        if(id != 0) {
+            processorRef.getTriggerEngine().setMode((TriggerEngine::Mode)id);
+        }
+
+        repaint();
+    };
+
+    // 選択肢はチャンネル構成に合わせて updateTraces() で作成する。
+    cmb_trigger_source_.onChange = [this] {
+        auto id = cmb_trigger_source_.getSelectedId();
+        if(id != 0) {
+            processorRef.getTriggerEngine().setSource(id - 1);
+        }
+    };
+
+    sl_trigger_level_.setRange(-1.0, 1.0);
+    sl_trigger_level_.setValue(trigger.getLevel(), juce::dontSendNotification);
+    sl_trigger_level_.setTextValueSuffix(" FS level");
+    sl_trigger_level_.onValueChange = [this] {
+        processorRef.getTriggerEngine().setLevel((float)sl_trigger_level_.getValue());
+    };
+
+    sl_pre_trigger_.setRange(0.0, 100.0, 1.0);
+    sl_pre_trigger_.setValue(trigger.getPreTrigger() * 100.0, juce::dontSendNotification);
+    sl_pre_trigger_.setTextValueSuffix(" % pre");
+    sl_pre_trigger_.onValueChange = [this] {
+        processorRef.getTriggerEngine().setPreTrigger((float)(sl_pre_trigger_.getValue() / 100.0));
+    };
+
+    sl_trigger_hysteresis_.setRange(0.0, 0.5, 0.001);
+    sl_trigger_hysteresis_.setValue(trigger.getHysteresis(), juce::dontSendNotification);
+    sl_trigger_hysteresis_.setTextValueSuffix(" FS hysteresis");
+    sl_trigger_hysteresis_.onValueChange = [this] {
+        processorRef.getTriggerEngine().setHysteresis((float)sl_trigger_hysteresis_.getValue());
+    };
+
+    // ホールドオフはサンプル数で設定するので、サンプルレートに合わせて onRenderTick() で反映する。
+    sl_trigger_holdoff_.setRange(0.0, 1000.0, 1.0);
+    sl_trigger_holdoff_.setSkewFactorFromMidPoint(100.0);
+    if(processorRef.getSampleRate() > 0) {
+        sl_trigger_holdoff_.setValue(trigger.getHoldoff() * 1000.0 / processorRef.getSampleRate(), juce::dontSendNotification);
+    }
+    sl_trigger_holdoff_.setTextValueSuffix(" ms holdoff");
+
+    // スペクトラム表示が有効な間だけ、解析スレッドを動かす。
+    btn_spectrum_.setButtonText("Spectrum");
+    btn_spectrum_.onClick = [this] {
+        if(btn_spectrum_.getToggleState()) {
+            spectrum_analyzer_.start();
+        } else {
+            spectrum_analyzer_.stop();
+        }
+
+        repaint();
+    };
+
+    // ComboBox の ID には FFT のサイズの指数をそのまま使用する。
+    for(int order = SpectrumAnalyzer::kMinOrder; order <= SpectrumAnalyzer::kMaxOrder; ++order) {
+        cmb_fft_size_.addItem("FFT " + juce::String(1 << order), order);
+    }
+    cmb_fft_size_.setSelectedId(spectrum_analyzer_.getOrder(), juce::dontSendNotification);
+    cmb_fft_size_.onChange = [this] {
+        auto id = cmb_fft_size_.getSelectedId();
+        if(id != 0) {
+            spectrum_analyzer_.setOrder(id);
+        }
+    };
+
+    cmb_fft_window_.addItem("Rectangular", (int)SpectrumAnalyzer::Window::kRectangular);
+    cmb_fft_window_.addItem("Hann", (int)SpectrumAnalyzer::Window::kHann);
+    cmb_fft_window_.addItem("Blackman-Harris", (int)SpectrumAnalyzer::Window::kBlackmanHarris);
+    cmb_fft_window_.addItem("Flat Top", (int)SpectrumAnalyzer::Window::kFlatTop);
+    cmb_fft_window_.setSelectedId((int)spectrum_analyzer_.getWindow(), juce::dontSendNotification);
+    cmb_fft_window_.onChange = [this] {
+        auto id = cmb_fft_window_.getSelectedId();
+        if(id != 0) {
+            spectrum_analyzer_.setWindow((SpectrumAnalyzer::Window)id);
+        }
+    };
+
+    // ComboBox の ID は、重なりの割合を 1/8 単位で表した値に 1 を足したものとする。
+    cmb_fft_overlap_.addItem("Overlap 0 %", 1);
+    cmb_fft_overlap_.addItem("Overlap 50 %", 5);
+    cmb_fft_overlap_.addItem("Overlap 75 %", 7);
+    cmb_fft_overlap_.addItem("Overlap 87.5 %", 8);
+    cmb_fft_overlap_.setSelectedId((int)std::round(spectrum_analyzer_.getOverlap() * 8) + 1, juce::dontSendNotification);
+    cmb_fft_overlap_.onChange = [this] {
+        auto id = cmb_fft_overlap_.getSelectedId();
+        if(id != 0) {
+            spectrum_analyzer_.setOverlap((id - 1) / 8.0f);
+        }
+    };
+
+    cmb_fft_averaging_.addItem("No Averaging", (int)SpectrumAnalyzer::Averaging::kNone);
+    cmb_fft_averaging_.addItem("Exponential", (int)SpectrumAnalyzer::Averaging::kExponential);
+    cmb_fft_averaging_.addItem("Peak Hold", (int)SpectrumAnalyzer::Averaging::kPeakHold);
+    cmb_fft_averaging_.setSelectedId((int)spectrum_analyzer_.getAveraging(), juce::dontSendNotification);
+    cmb_fft_averaging_.onChange = [this] {
+        auto id = cmb_fft_averaging_.getSelectedId();
+        if(id != 0) {
+            spectrum_analyzer_.setAveraging((SpectrumAnalyzer::Averaging)id);
+        }
+    };
+
+    // 録音は Processor が所有する Recorder が行うので、エディタを閉じても続く。
+    btn_record_.onClick = [this] { toggleRecording(); };
+    updateRecordButton();
+
+    // 履歴の保存も Processor が所有する HistoryStore が行うので、エディタを閉じても続く。
+    btn_history_.setButtonText("History");
+    btn_history_.setToggleState(processorRef.getHistory().isRunning(), juce::dontSendNotification);
+    btn_history_.onClick = [this] {
+        auto &history = processorRef.getHistory();
+        if(btn_history_.getToggleState()) {
+            if(history.start(HistoryStore::getDefaultDirectory()) == false) {
+                btn_history_.setToggleState(false, juce::dontSendNotification);
+                juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon,
+                                                       "History",
+                                                       "Failed to open a history file in "
+                                                       + HistoryStore::getDefaultDirectory().getFullPathName()
+                                                       + ", or the disk does not have enough free space.");
+            }
+
+            history_follow_ = true;
+            history_length_ = 0;
+        } else {
+            history.stop();
+        }
+
+        sb_history_.setVisible(btn_history_.getToggleState());
+        resized();
+        repaint();
+    };
+
+    // XY 表示は、エフェクト処理前後のメインバスの先頭 2 チャンネルを L / R として表示する。
+    cmb_view_.addItem("Waveform", (int)WaveformRenderer::View::kWaveform);
+    cmb_view_.addItem("XY L/R", (int)WaveformRenderer::View::kXYLeftRight);
+    cmb_view_.addItem("XY M/S", (int)WaveformRenderer::View::kXYMidSide);
+    cmb_view_.setSelectedId((int)WaveformRenderer::View::kWaveform, juce::dontSendNotification);
+    cmb_view_.onChange = [this] { repaint(); };
+
+    btn_meters_.setButtonText("Meters");
+    btn_meters_.onClick = [this] {
+        // 表示を始めるときは、以前に表示していたときのトゥルーピークの最大値を破棄する。
+        meter_buses_ = {};
+        resized();
+        repaint();
+    };
+
+    sb_history_.setVisible(btn_history_.getToggleState());
+    sb_history_.setAutoHide(false);
+    sb_history_.addListener(this);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
     setSize (800, 300);
     setResizeLimits(400, 300, 1920, 1200);
     setResizable(true, true);
 
-    startTimer(16);
+    waveform_renderer_.start();
+    render_scheduler_->addClient(this);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
 {
+    render_scheduler_->removeClient(this);
+    waveform_renderer_.stop();
+    sb_history_.removeListener(this);
 }
 
 //==============================================================================
 void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 {
+    RenderScheduler::ScopedPaintTimer paint_timer(*render_scheduler_);
+
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 
     // g.fillAll(juce::Colour(0.0f, 0.0f, 0.2f));
 
-    //g.setOrigin(0, kButtonHeight);
-    int const w = getWidth();
-    int const h = getHeight() - kButtonHeight;
+    if(processorRef.getSampleRate() <= 0) { return; }
+
+    juce::Rectangle<int> b_waveform = getWaveformBounds();
+    auto const num_traces = (int)trace_enabled_.size();
+
+    if(btn_spectrum_.getToggleState()) {
+        drawSpectrum(g, b_waveform, num_traces);
+    } else if(btn_history_.getToggleState()) {
+        drawHistory(g, b_waveform, num_traces);
+    } else {
+        // 波形は描画スレッドが描画を完了した最新の画像を転送するだけにする。
+        waveform_renderer_.drawLatest(g, b_waveform.getTopLeft());
+
+        // 新しい画像を表示するたびに、表示したデータが書き込まれてからの時間を記録する。
+        auto const sequence = waveform_renderer_.getSequence();
+        if(sequence != latency_sequence_) {
+            auto const info = waveform_renderer_.getLatestInfo();
+            if(info.data_time_ns != 0) {
+                processorRef.getTelemetry().recordDisplayLatency(ProcessorTelemetry::now() - info.data_time_ns);
+            }
+
+            latency_sequence_ = sequence;
+        }
+
+        // 文字の描画はメッセージスレッドで行う。
+        if(cmb_view_.getSelectedId() != (int)WaveformRenderer::View::kWaveform) {
+            g.setColour(juce::Colours::white);
+            g.setFont(12.0f);
+            g.drawText("Pre", WaveformRenderer::getXYBounds(b_waveform, 0).reduced(4, 2), juce::Justification::topLeft);
+            g.drawText("Post", WaveformRenderer::getXYBounds(b_waveform, 1).reduced(4, 2), juce::Justification::topLeft);
+        }
+    }
+
+    if(btn_meters_.getToggleState()) {
+        drawMeters(g, getMeterBounds());
+    }
+
+    if(btn_telemetry_.getToggleState()) {
+        drawTelemetry(g, b_waveform);
+    }
+}
+
+void AudioPluginAudioProcessorEditor::drawSpectrum(juce::Graphics &g, juce::Rectangle<int> bounds, int num_traces)
+{
+    if(spectrum_.sequence == 0 || bounds.isEmpty()) { return; }
+
+    auto const num_bins = spectrum_analyzer_.getNumDisplayBins();
+    auto const to_x = [&](int bin) {
+        // 表示用のビンは対数周波数軸上で等間隔に並んでいる。
+        return bounds.getX() + bounds.getWidth() * (bin + 0.5f) / num_bins;
+    };
+    auto const to_y = [&](float db) {
+        return juce::jmap<float>(juce::jlimit(SpectrumAnalyzer::kMinDecibels, 0.0f, db),
+                                 SpectrumAnalyzer::kMinDecibels, 0.0f,
+                                 (float)bounds.getBottom(), (float)bounds.getY());
+    };
+
+    // 10 倍ごとの周波数と、 20 dB ごとのレベルに目盛りを引く。
+    g.setColour(juce::Colours::grey.withAlpha(0.4f));
+    auto const log_ratio = std::log(spectrum_.sample_rate / 2.0 / SpectrumAnalyzer::kMinFrequency);
+    for(double freq = 100.0; freq < spectrum_.sample_rate / 2.0; freq *= 10.0) {
+        auto const x = bounds.getX() + bounds.getWidth() * std::log(freq / SpectrumAnalyzer::kMinFrequency) / log_ratio;
+        g.drawVerticalLine((int)x, (float)bounds.getY(), (float)bounds.getBottom());
+    }
+
+    for(float db = -20.0f; db > SpectrumAnalyzer::kMinDecibels; db -= 20.0f) {
+        g.drawHorizontalLine((int)to_y(db), (float)bounds.getX(), (float)bounds.getRight());
+    }
+
+    for(int ch = 0; ch < num_traces && ch < (int)spectrum_.decibels.size(); ++ch) {
+        auto const &decibels = spectrum_.decibels[ch];
+        if(trace_enabled_[ch] == false || (int)decibels.size() != num_bins) { continue; }
+
+        juce::Path path;
+        path.startNewSubPath(to_x(0), to_y(decibels[0]));
+        for(int bin = 1; bin < num_bins; ++bin) {
+            path.lineTo(to_x(bin), to_y(decibels[bin]));
+        }
+
+        auto const hue = (float)ch / num_traces;
+        g.setColour(juce::Colour(hue, 0.7f, 0.9f, 1.0f));
+        g.strokePath(path, juce::PathStrokeType(1.0f));
+    }
+}
+
+void AudioPluginAudioProcessorEditor::drawTelemetry(juce::Graphics &g, juce::Rectangle<int> bounds)
+{
+    auto const stats = render_scheduler_->getStats();
+    auto text = juce::String(processorRef.getTelemetry().getSnapshot().toText())
+              + juce::String::formatted("render     editors %d  drawn %d  skipped %d  fps %.1f / %.0f  load %.0f%% / %.0f%%  dropped %lld\n",
+                                        stats.num_clients, stats.num_rendered, stats.num_skipped,
+                                        stats.fps, stats.max_fps, stats.load * 100.0, stats.cpu_budget * 100.0,
+                                        (long long)waveform_renderer_.getNumDropped());
+
+    // 表示している画像の末尾のタイムライン上の位置と、ホストがそこからどれだけ先に進んでいるか。
+    auto const info = waveform_renderer_.getLatestInfo();
+    auto const sample_rate = processorRef.getSampleRate();
+    if(info.has_transport && sample_rate > 0) {
+        text += juce::String::formatted("transport  %s  shown %.3f s  host %.3f s  behind %.1f ms\n",
+                                        info.is_playing ? "playing" : "stopped",
+                                        info.transport_position / sample_rate,
+                                        info.host_transport_position / sample_rate,
+                                        (info.host_transport_position - info.transport_position) / sample_rate * 1000.0);
+    }
+    auto const font = juce::Font(juce::Font::getDefaultMonospacedFontName(), 12.0f, juce::Font::plain);
+    auto const num_lines = juce::StringArray::fromLines(text.trimEnd()).size();
+
+    auto area = bounds.reduced(4).removeFromTop((int)std::ceil(font.getHeight() * num_lines) + 8);
+    area = area.withWidth(std::min(area.getWidth(), 560));
+
+    g.setColour(juce::Colours::black.withAlpha(0.6f));
+    g.fillRect(area);
+    g.setColour(juce::Colours::white);
+    g.setFont(font);
+    g.drawMultiLineText(text, area.getX() + 4, area.getY() + 4 + (int)font.getAscent(), area.getWidth() - 8);
+}
+
+void AudioPluginAudioProcessorEditor::dumpTelemetry()
+{
+    // 保存先を選んでいる間に集計が進まないように、ボタンを押した時点の集計結果を保存する。
+    auto const csv = processorRef.getTelemetry().getSnapshot().toCsv();
+
+    telemetry_chooser_ = std::make_unique<juce::FileChooser>("Save telemetry",
+                                                             juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                                                                .getChildFile("SimpleOscilloscopeTelemetry.csv"),
+                                                             "*.csv");
+
+    auto const flags = juce::FileBrowserComponent::saveMode
+                     | juce::FileBrowserComponent::canSelectFiles
+                     | juce::FileBrowserComponent::warnAboutOverwriting;
+
+    telemetry_chooser_->launchAsync(flags, [csv](juce::FileChooser const &chooser) {
+        auto const file = chooser.getResult();
+        if(file == juce::File()) { return; }
+
+        file.replaceWithText(juce::String(csv));
+    });
+}
+
+void AudioPluginAudioProcessorEditor::toggleRecording()
+{
+    auto &recorder = processorRef.getRecorder();
+    if(recorder.isRecording()) {
+        recorder.stop();
+        updateRecordButton();
+        return;
+    }
+
+    record_chooser_ = std::make_unique<juce::FileChooser>("Record to file",
+                                                          juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                                                             .getChildFile("SimpleOscilloscopeRecording.wav"),
+                                                          "*.wav;*.raw");
+
+    auto const flags = juce::FileBrowserComponent::saveMode
+                     | juce::FileBrowserComponent::canSelectFiles
+                     | juce::FileBrowserComponent::warnAboutOverwriting;
+
+    // record_chooser_ はエディタが所有していて、エディタより先に破棄されるので this を参照してよい。
+    record_chooser_->launchAsync(flags, [this](juce::FileChooser const &chooser) {
+        auto const file = chooser.getResult();
+        if(file == juce::File()) { return; }
+
+        if(processorRef.getRecorder().start(file, Recorder::getFormatForFile(file)) == false) {
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon,
+                                                   "Record",
+                                                   "Failed to start recording to " + file.getFullPathName());
+        }
+
+        updateRecordButton();
+    });
+}
+
+void AudioPluginAudioProcessorEditor::updateRecordButton()
+{
+    auto const status = processorRef.getRecorder().getStatus();
+    if(status.recording == false) {
+        btn_record_.setButtonText("Record...");
+        return;
+    }
+
+    auto const seconds = status.sample_rate > 0 ? status.num_recorded / status.sample_rate : 0.0;
+    auto text = juce::String(status.failed ? "Failed " : "Stop ") + juce::String(seconds, 1) + " s";
+    if(status.num_dropped > 0) {
+        text << " (" << juce::String(status.num_dropped) << " dropped)";
+    }
+
+    btn_record_.setButtonText(text);
+}
+
+void AudioPluginAudioProcessorEditor::updateHistoryButton()
+{
+    auto const &history = processorRef.getHistory();
 
-    auto num_to_draw = getSampleCountForDuration(saved_sample_rate_, dur_);
-    int const start_index = buffer_.getNumSamples() - num_to_draw;
-    auto draw_start_time = (saved_thumbnail_position_ - num_to_draw) / saved_sample_rate_;
-    auto draw_end_time = (saved_thumbnail_position_) / saved_sample_rate_;
+    juce::String text("History");
+    if(history.isRunning() && history.getNumDropped() > 0) {
+        text << " (" << juce::String(history.getNumDropped()) << " dropped)";
+    }
 
-    juce::Rectangle<int> b_waveform = getBounds();
-    b_waveform.removeFromTop(kButtonHeight);
+    btn_history_.setButtonText(text);
+}
+
+juce::Rectangle<int> AudioPluginAudioProcessorEditor::getWaveformBounds() const
+{
+    auto b = getBounds().withTrimmedTop(kButtonHeight * kNumControlRows);
+    if(btn_meters_.getToggleState()) {
+        b.removeFromRight(kMeterWidth);
+    }
+
+    if(btn_history_.getToggleState()) {
+        b.removeFromBottom(kScrollBarHeight);
+    }
+
+    return b;
+}
 
-    auto draw_waveform = [&, this](float hue, ChannelId ch) {
-        g.setColour (juce::Colour(hue, 0.7f, 0.9f, 1.0f));
-        thumb_.drawChannel(g, b_waveform, draw_start_time, draw_end_time, (int)ch, 1.0);
+juce::Rectangle<int> AudioPluginAudioProcessorEditor::getMeterBounds() const
+{
+    return getBounds().withTrimmedTop(kButtonHeight * kNumControlRows).removeFromRight(kMeterWidth);
+}
+
+bool AudioPluginAudioProcessorEditor::updateMeters()
+{
+    // 表示していない間も FIFO を空にして、表示を始めたときに古い計測結果が残らないようにする。
+    LevelMeter::Frame frame;
+    LevelMeter::Frame pending;
+    while(processorRef.getMeter().pop(frame)) {
+        pending.merge(frame);
+    }
+
+    auto const sample_rate = processorRef.getSampleRate();
+    if(pending.num_samples == 0 || sample_rate <= 0) { return false; }
+
+    // 表示の更新の間隔ではなく、計測したサンプル数から経過時間を求める。
+    auto const elapsed = pending.num_samples / sample_rate;
+    auto const smoothing = 1.0 - std::exp(-elapsed / kMeterSmoothingSeconds);
+    auto const fall_db = (float)(kMeterPeakFallDbPerSecond * elapsed);
+
+    for(int b = 0; b < LevelMeter::kNumBuses; ++b) {
+        auto const &stats = pending.buses[b];
+        auto &bus = meter_buses_[b];
+
+        bus.num_channels = stats.num_channels;
+        for(int ch = 0; ch < stats.num_channels; ++ch) {
+            auto &channel = bus.channels[ch];
+            channel.peak_db = std::max(juce::Decibels::gainToDecibels(stats.peak[ch]), channel.peak_db - fall_db);
+            channel.mean_square += (stats.sum_squares[ch] / pending.num_samples - channel.mean_square) * smoothing;
+            channel.true_peak_max = std::max(channel.true_peak_max, stats.true_peak[ch]);
+        }
+
+        // 無音の区間では相関係数を更新しない。
+        if(stats.sum_ll > 0 && stats.sum_rr > 0) {
+            bus.correlation += (stats.getCorrelation() - bus.correlation) * smoothing;
+        }
+
+        bus.momentary = stats.momentary;
+        bus.short_term = stats.short_term;
+    }
+
+    return true;
+}
+
+void AudioPluginAudioProcessorEditor::drawMeters(juce::Graphics &g, juce::Rectangle<int> bounds)
+{
+    constexpr int kTextLineHeight = 14;
+    constexpr int kNumTextLines = 4;
+
+    auto const to_y = [](float db, juce::Rectangle<int> bar) {
+        auto const ratio = juce::jlimit(0.0f, 1.0f, (db - kMeterMinDb) / -kMeterMinDb);
+        return (float)bar.getBottom() - ratio * (float)bar.getHeight();
     };
 
-    if(btn_left_pre_.getToggleState()) {
-        draw_waveform(0.0, ChannelId::kLeftPre);
+    g.setColour(juce::Colours::black.withAlpha(0.3f));
+    g.fillRect(bounds);
+
+    auto area = bounds.reduced(4);
+    auto const column_width = area.getWidth() / LevelMeter::kNumBuses;
+    char const * const names[] = { "Pre", "Post" };
+
+    g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 11.0f, juce::Font::plain));
+
+    for(int b = 0; b < LevelMeter::kNumBuses; ++b) {
+        auto const &bus = meter_buses_[b];
+        auto column = area.removeFromLeft(column_width).reduced(2, 0);
+
+        g.setColour(juce::Colours::white);
+        g.drawText(names[b], column.removeFromTop(kTextLineHeight), juce::Justification::centred);
+
+        auto text = column.removeFromBottom(kTextLineHeight * kNumTextLines);
+        auto const format_db = [](float value) {
+            return value <= LevelMeter::kSilence ? juce::String("-inf") : juce::String(value, 1);
+        };
+
+        auto true_peak = 0.0f;
+        for(int ch = 0; ch < bus.num_channels; ++ch) {
+            true_peak = std::max(true_peak, bus.channels[ch].true_peak_max);
+        }
+
+        g.drawText("TP " + format_db(juce::Decibels::gainToDecibels(true_peak, LevelMeter::kSilence)),
+                   text.removeFromTop(kTextLineHeight), juce::Justification::left);
+        g.drawText("M  " + format_db(bus.momentary), text.removeFromTop(kTextLineHeight), juce::Justification::left);
+        g.drawText("S  " + format_db(bus.short_term), text.removeFromTop(kTextLineHeight), juce::Justification::left);
+        if(bus.num_channels >= 2) {
+            g.drawText("C  " + juce::String(bus.correlation, 2), text.removeFromTop(kTextLineHeight), juce::Justification::left);
+        }
+
+        if(bus.num_channels == 0) { continue; }
+
+        // チャンネルごとに、 RMS を塗りつぶしたバーと、ピークホールドの線を描画する。
+        auto bars = column.reduced(0, 2);
+        auto const bar_width = bars.getWidth() / bus.num_channels;
+        for(int ch = 0; ch < bus.num_channels; ++ch) {
+            auto const &channel = bus.channels[ch];
+            auto const bar = bars.removeFromLeft(bar_width).reduced(1, 0);
+
+            g.setColour(juce::Colours::darkgrey);
+            g.fillRect(bar);
+
+            auto const rms_db = juce::Decibels::gainToDecibels((float)std::sqrt(channel.mean_square), kMeterMinDb);
+            auto const rms_y = to_y(rms_db, bar);
+            g.setColour(juce::Colours::limegreen);
+            g.fillRect(juce::Rectangle<float>((float)bar.getX(), rms_y, (float)bar.getWidth(), (float)bar.getBottom() - rms_y));
+
+            g.setColour(channel.peak_db >= 0.0f ? juce::Colours::red : juce::Colours::yellow);
+            g.fillRect(juce::Rectangle<float>((float)bar.getX(), to_y(channel.peak_db, bar), (float)bar.getWidth(), 2.0f));
+        }
     }
+}
 
-    if(btn_left_post_.getToggleState()) {
-        draw_waveform(0.5, ChannelId::kLeftPost);
+void AudioPluginAudioProcessorEditor::drawHistory(juce::Graphics &g, juce::Rectangle<int> bounds, int num_traces)
+{
+    auto const &history = processorRef.getHistory();
+    auto const sample_rate = history.getSampleRate();
+    if(history.isRunning() == false || sample_rate <= 0 || history_length_ <= 0 || bounds.isEmpty()) { return; }
+
+    auto const w = bounds.getWidth();
+    columns_.resize(w);
+
+    // 表示範囲の索引だけを参照するので、保持している履歴の長さに関係なく描画の負荷は変わらない。
+    for(int ch = 0; ch < std::min(num_traces, history.getNumChannels()); ++ch) {
+        if(trace_enabled_[ch] == false) { continue; }
+        if(history.getColumns(ch, history_end_, history_length_, w, columns_.data()) == false) { continue; }
+
+        auto const hue = (float)ch / num_traces;
+        g.setColour(juce::Colour(hue, 0.7f, 0.9f, 1.0f));
+        WaveformCache::drawColumns(g, bounds, columns_.data(), w, PeakPyramid::Column {});
     }
 
-    if(btn_right_pre_.getToggleState()) {
-        draw_waveform(0.25, ChannelId::kRightPre);
+    // 表示範囲の両端が、最新の位置から何秒前かを表示する。
+    auto const latest = (double)history.getNumWritten();
+    auto const to_text = [&](double position) {
+        return juce::String((position - latest) / sample_rate, 1) + " s";
+    };
+
+    g.setColour(juce::Colours::white);
+    g.setFont(12.0f);
+    g.drawText(to_text(history_end_ - history_length_) + " .. " + to_text(history_end_),
+               bounds.reduced(4, 2).removeFromTop(14),
+               juce::Justification::topRight);
+}
+
+void AudioPluginAudioProcessorEditor::updateHistoryRange()
+{
+    auto const &history = processorRef.getHistory();
+    if(history.isRunning() == false || history.getSampleRate() <= 0) { return; }
+
+    auto const latest = (double)history.getNumWritten();
+    auto const oldest = (double)history.getOldestPosition();
+
+    // 1 ピクセルあたり 1 サンプルから、保持している全体までの範囲で拡大・縮小する。
+    if(history_length_ <= 0) {
+        history_length_ = history.getSampleRate() * kDefaultHistoryViewSeconds;
+    }
+    history_length_ = juce::jlimit((double)std::max(getWaveformBounds().getWidth(), 1), (double)history.getCapacity(), history_length_);
+
+    if(history_follow_) {
+        history_end_ = latest;
+    }
+    history_end_ = juce::jlimit(std::min(oldest + history_length_, latest), latest, history_end_);
+
+    sb_history_.setRangeLimits(std::min(oldest, latest - history_length_), latest, juce::dontSendNotification);
+    sb_history_.setCurrentRange(history_end_ - history_length_, history_length_, juce::dontSendNotification);
+}
+
+void AudioPluginAudioProcessorEditor::mouseDown(juce::MouseEvent const &e)
+{
+    if(e.mods.isPopupMenu()) {
+        showRenderMenu();
+        return;
+    }
+
+    AudioProcessorEditor::mouseDown(e);
+}
+
+void AudioPluginAudioProcessorEditor::mouseWheelMove(juce::MouseEvent const &e, juce::MouseWheelDetails const &wheel)
+{
+    auto const bounds = getWaveformBounds();
+    if(btn_history_.getToggleState() == false || bounds.contains(e.getPosition()) == false) {
+        AudioProcessorEditor::mouseWheelMove(e, wheel);
+        return;
     }
 
-    if(btn_right_post_.getToggleState()) {
-        draw_waveform(0.75, ChannelId::kRightPost);
+    // 縦方向で拡大・縮小し、横方向でスクロールする。
+    // 拡大・縮小はマウスカーソルの位置を中心に行うが、最新の位置に追従している間は末尾を固定する。
+    auto const ratio = (double)(e.x - bounds.getX()) / std::max(bounds.getWidth(), 1);
+    auto const anchor = history_end_ - history_length_ * (1.0 - ratio);
+    auto const new_length = history_length_ * std::pow(2.0, -wheel.deltaY * 4.0);
+
+    if(history_follow_ == false) {
+        history_end_ = anchor + new_length * (1.0 - ratio);
     }
+
+    history_length_ = new_length;
+
+    if(wheel.deltaX != 0) {
+        history_end_ -= wheel.deltaX * history_length_;
+        history_follow_ = false;
+    }
+
+    updateHistoryRange();
+    repaint(bounds);
+}
+
+void AudioPluginAudioProcessorEditor::scrollBarMoved(juce::ScrollBar *scroll_bar, double new_range_start)
+{
+    if(scroll_bar != &sb_history_) { return; }
+
+    // 末尾までスクロールした場合は、再び最新の位置に追従する。
+    // スクロール中も最新の位置は進むので、表示範囲の 1 % までの差は末尾とみなす。
+    history_end_ = new_range_start + history_length_;
+    history_follow_ = history_end_ >= processorRef.getHistory().getNumWritten() - history_length_ * 0.01;
+
+    updateHistoryRange();
+    repaint(getWaveformBounds());
 }
 
 void AudioPluginAudioProcessorEditor::resized()
@@ -126,92 +757,234 @@ void AudioPluginAudioProcessorEditor::resized()
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
     auto b = getBounds().removeFromTop(kButtonHeight);
-    int const kButtonWidth = b.getWidth() / 6.0;
+    int const kButtonWidth = b.getWidth() / 7.0;
 
     cmb_duration_.setBounds(b.removeFromLeft(kButtonWidth));
-    btn_left_pre_.setBounds(b.removeFromLeft(kButtonWidth));
-    btn_left_post_.setBounds(b.removeFromLeft(kButtonWidth));
-    btn_right_pre_.setBounds(b.removeFromLeft(kButtonWidth));
-    btn_right_post_.setBounds(b.removeFromLeft(kButtonWidth));
+    btn_traces_.setBounds(b.removeFromLeft(kButtonWidth));
+    btn_scroll_cache_.setBounds(b.removeFromLeft(kButtonWidth));
     sl_cutoff_.setBounds(b.removeFromLeft(kButtonWidth));
+    cmb_slope_.setBounds(b.removeFromLeft(kButtonWidth));
+    btn_history_.setBounds(b.removeFromLeft(kButtonWidth));
+    btn_transport_.setBounds(b.removeFromLeft(kButtonWidth));
+
+    auto b2 = getBounds().withTrimmedTop(kButtonHeight).removeFromTop(kButtonHeight);
+    cmb_trigger_mode_.setBounds(b2.removeFromLeft(kButtonWidth));
+    cmb_trigger_source_.setBounds(b2.removeFromLeft(kButtonWidth));
+    sl_trigger_level_.setBounds(b2.removeFromLeft(kButtonWidth));
+    sl_pre_trigger_.setBounds(b2.removeFromLeft(kButtonWidth));
+    btn_telemetry_.setBounds(b2.removeFromLeft(kButtonWidth));
+    btn_dump_telemetry_.setBounds(b2.removeFromLeft(kButtonWidth));
+    btn_meters_.setBounds(b2.removeFromLeft(kButtonWidth));
+
+    auto b4 = getBounds().withTrimmedTop(kButtonHeight * 3).removeFromTop(kButtonHeight);
+    sl_trigger_hysteresis_.setBounds(b4.removeFromLeft(kButtonWidth));
+    sl_trigger_holdoff_.setBounds(b4.removeFromLeft(kButtonWidth));
+
+    auto b3 = getBounds().withTrimmedTop(kButtonHeight * 2).removeFromTop(kButtonHeight);
+    btn_spectrum_.setBounds(b3.removeFromLeft(kButtonWidth));
+    cmb_fft_size_.setBounds(b3.removeFromLeft(kButtonWidth));
+    cmb_fft_window_.setBounds(b3.removeFromLeft(kButtonWidth));
+    cmb_fft_overlap_.setBounds(b3.removeFromLeft(kButtonWidth));
+    cmb_fft_averaging_.setBounds(b3.removeFromLeft(kButtonWidth));
+    btn_record_.setBounds(b3.removeFromLeft(kButtonWidth));
+    cmb_view_.setBounds(b3.removeFromLeft(kButtonWidth));
+
+    auto b_scroll_bar = getBounds().removeFromBottom(kScrollBarHeight);
+    if(btn_meters_.getToggleState()) {
+        b_scroll_bar.removeFromRight(kMeterWidth);
+    }
+
+    sb_history_.setBounds(b_scroll_bar);
 }
 
-void AudioPluginAudioProcessorEditor::timerCallback()
+bool AudioPluginAudioProcessorEditor::isRenderTargetVisible() const
 {
-    auto const new_channel_count = processorRef.getTotalNumOutputChannels();
-    auto const new_sample_rate = processorRef.getSampleRate();
-    auto const new_block_size = processorRef.getBlockSize();
+    // 最小化されたウィンドウや、ホストが隠したウィンドウの中にある場合も false になる。
+    return isShowing();
+}
+
+bool AudioPluginAudioProcessorEditor::onRenderTick()
+{
+    auto const sample_rate = processorRef.getSampleRate();
+    audio_data_ = processorRef.getAudioData();
 
-    assert(new_channel_count == 2);
+    updateTraces();
+    updateRecordButton();
+    updateHistoryButton();
 
-    if(saved_sample_rate_ != new_sample_rate ||
-       saved_block_size_ != new_block_size )
-    {
-        saved_sample_rate_ = new_sample_rate;
-        saved_block_size_ = new_block_size;
+    bool updated = false;
 
-        auto const max_samples = getSampleCountForDuration(new_sample_rate, DurationId::k3s);
-        buffer_ = juce::AudioSampleBuffer(new_channel_count * 2, max_samples);
-        thumb_.reset(new_channel_count * 2, saved_sample_rate_, max_samples);
+    if(btn_history_.getToggleState()) {
+        auto const num_written = processorRef.getHistory().getNumWritten();
+        updated = num_written != history_num_written_;
+        history_num_written_ = num_written;
 
-        thumb_.addBlock(0, buffer_, 0, buffer_.getNumSamples());
-        saved_thumbnail_position_ = buffer_.getNumSamples();
-        saved_written_size_ = 0;
+        updateHistoryRange();
     }
 
-    AudioData *ad = nullptr;
-    std::unique_lock<AudioData> lock;
+    // 解析スレッドが完成させた結果だけを受け取る。
+    if(btn_spectrum_.getToggleState()) {
+        spectrum_analyzer_.setChannelsEnabled(trace_enabled_);
+        updated = spectrum_analyzer_.getSpectrum(spectrum_) || updated;
+    }
 
-    // Processor の Active AudioData を取得してロックする。
-    for( ; ; ) {
-        ad = processorRef.getActiveAudioData();
-        if(ad == nullptr) { return; }
+    // 表示する長さのフレームをトリガーで確定させる。
+    updateDurationItems();
+    auto &trigger = processorRef.getTriggerEngine();
+    trigger.setFrameLength(getSampleCountForDuration(sample_rate, dur_));
+    trigger.setHoldoff((std::int64_t)std::round(sl_trigger_holdoff_.getValue() * 0.001 * sample_rate));
+
+    // 波形は描画スレッドに最新のデータを描画させ、描画が完了した画像が増えていれば再描画する。
+    if(btn_spectrum_.getToggleState() == false && btn_history_.getToggleState() == false) {
+        auto const bounds = getWaveformBounds();
+
+        WaveformRenderer::Settings settings;
+        settings.width = bounds.getWidth();
+        settings.height = bounds.getHeight();
+        settings.num_samples = getSampleCountForDuration(sample_rate, dur_);
+        settings.trace_enabled = trace_enabled_;
+        settings.background = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
+        settings.use_scroll_cache = btn_scroll_cache_.getToggleState();
+        settings.view = (WaveformRenderer::View)std::max(cmb_view_.getSelectedId(), 1);
+        settings.align_to_transport = btn_transport_.getToggleState();
+        waveform_renderer_.requestFrame(settings);
+
+        auto const sequence = waveform_renderer_.getSequence();
+        updated = sequence != drawn_sequence_ || updated;
+        drawn_sequence_ = sequence;
+    }
 
-        lock = std::unique_lock<AudioData>(*ad, std::try_to_lock);
+    // メーターは計測結果が届いたときだけ再描画する。
+    auto const meters_updated = updateMeters() && btn_meters_.getToggleState();
+    if(meters_updated) {
+        repaint(getMeterBounds());
+    }
 
-        // ロックを取得できたので、 GUI スレッドでこの AudioData を使用する。
-        if(lock) { break; }
+    // 新しいデータがなければ表示は変わらないので、再描画しない。
+    if(updated == false) { return meters_updated; }
 
-        // ロックが取得できなかったということは、この AudioData が processor_ 側で使用中ということ。
-        // （ロック処理には juce::SpinLock クラスを使用していて、このクラスは Spurious Failure が発生しないはず）
-        // 一度スレッドのタイムスライスを明け渡してからリトライする。
-        std::this_thread::yield();
-    }
+    repaint(getWaveformBounds());
+    return true;
+}
 
-    assert(lock.owns_lock());
+void AudioPluginAudioProcessorEditor::updateTraces()
+{
+    auto const *audio_data = audio_data_.get();
+    if(audio_data == traced_audio_data_) { return; }
+
+    traced_audio_data_ = audio_data;
+    if(audio_data == nullptr) { return; }
+
+    // チャンネル構成が変わった場合は、表示するチャンネルを初期状態に戻す。
+    auto const num_ring_channels = (int)audio_data->getBuffer().getNumChannels();
+    if((int)trace_enabled_.size() != num_ring_channels) {
+        trace_enabled_.assign(num_ring_channels, false);
+        if(audio_data->getNumChannels() > 0) {
+            trace_enabled_[0] = true;
+            trace_enabled_[audio_data->getNumChannels()] = true;
+        }
+    }
 
-    // ロックを取得したままの状態で、データのコピーを行う。
+    // ComboBox の ID は 0 を使用できないので、チャンネル番号に 1 を足した値を ID とする。
+    auto &trigger = processorRef.getTriggerEngine();
+    cmb_trigger_source_.clear(juce::dontSendNotification);
+    for(int ch = 0; ch < num_ring_channels; ++ch) {
+        cmb_trigger_source_.addItem("Trig: " + audio_data->getChannelName(ch), ch + 1);
+    }
 
-    auto &apre = ad->getPreBuffer();
-    auto &apost = ad->getPostBuffer();
+    if(trigger.getSource() >= num_ring_channels) {
+        trigger.setSource(0);
+    }
 
-    assert(apre.getNumWritten() == apost.getNumWritten());
+    cmb_trigger_source_.setSelectedId(trigger.getSource() + 1, juce::dontSendNotification);
+}
 
-    auto const new_written_size = apre.getNumWritten();
-    auto num_progressed = std::max<std::int64_t>(new_written_size, saved_written_size_) - saved_written_size_;
-    std::int64_t num_to_read = std::min<std::int64_t>(num_progressed, apre.getNumSamples());
-    std::int64_t num_to_discard = buffer_.getNumSamples() - num_to_read;
-    saved_written_size_ = new_written_size;
+void AudioPluginAudioProcessorEditor::showTraceMenu()
+{
+    auto const *audio_data = traced_audio_data_;
+    if(audio_data == nullptr) { return; }
 
-    ad->getPreBuffer().read(buffer_.getArrayOfWritePointers(), 0, num_to_read);
-    ad->getPostBuffer().read(buffer_.getArrayOfWritePointers() + 2, 0, num_to_read);
+    // PopupMenu の ID も 0 を使用できないので、チャンネル番号に 1 を足した値を ID とする。
+    juce::PopupMenu menu;
+    for(int ch = 0; ch < (int)trace_enabled_.size(); ++ch) {
+        menu.addItem(ch + 1, audio_data->getChannelName(ch), true, trace_enabled_[ch]);
+    }
 
-    lock.unlock();
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&btn_traces_),
+                       [this, safe_this = juce::Component::SafePointer<AudioPluginAudioProcessorEditor>(this)](int result) {
+        if(safe_this == nullptr) { return; }
 
-    thumb_.addBlock(saved_thumbnail_position_, buffer_, 0, num_to_read);
-    saved_thumbnail_position_ += num_to_read;
+        auto const ch = result - 1;
+        if(ch < 0 || ch >= (int)trace_enabled_.size()) { return; }
 
-    repaint(getBounds().withTrimmedTop(kButtonHeight));
+        trace_enabled_[ch] = !trace_enabled_[ch];
+        repaint();
+    });
 }
 
-float * AudioPluginAudioProcessorEditor::getBufferData(ChannelId ch)
+void AudioPluginAudioProcessorEditor::showRenderMenu()
 {
-    return buffer_.getWritePointer((int)ch);
+    // 表示のタイマーはプロセス内の全エディタで共有しているので、ここで変更した値はすべてのエディタに適用される。
+    // ID は、フレームレートの上限の項目を 1 から、 CPU 予算の項目を 101 から割り当てる。
+    static constexpr double kFpsItems[] = { 15.0, 30.0, 60.0, 120.0 };
+    static constexpr double kBudgetItems[] = { 0.1, 0.25, 0.5, 0.75 };
+    static constexpr int kBudgetIdOffset = 101;
+
+    auto &scheduler = *render_scheduler_;
+
+    juce::PopupMenu fps_menu;
+    for(int i = 0; i < (int)std::size(kFpsItems); ++i) {
+        fps_menu.addItem(i + 1, juce::String(kFpsItems[i], 0) + " fps", true,
+                         std::abs(scheduler.getMaxFps() - kFpsItems[i]) < 1e-6);
+    }
+
+    juce::PopupMenu budget_menu;
+    for(int i = 0; i < (int)std::size(kBudgetItems); ++i) {
+        budget_menu.addItem(i + kBudgetIdOffset, juce::String(kBudgetItems[i] * 100.0, 0) + " %", true,
+                            std::abs(scheduler.getCpuBudget() - kBudgetItems[i]) < 1e-6);
+    }
+
+    juce::PopupMenu menu;
+    menu.addSubMenu("Max Frame Rate", fps_menu);
+    menu.addSubMenu("CPU Budget", budget_menu);
+
+    menu.showMenuAsync(juce::PopupMenu::Options(),
+                       [this, safe_this = juce::Component::SafePointer<AudioPluginAudioProcessorEditor>(this)](int result) {
+        if(safe_this == nullptr) { return; }
+
+        if(result >= 1 && result <= (int)std::size(kFpsItems)) {
+            render_scheduler_->setMaxFps(kFpsItems[result - 1]);
+        } else if(result >= kBudgetIdOffset && result < kBudgetIdOffset + (int)std::size(kBudgetItems)) {
+            render_scheduler_->setCpuBudget(kBudgetItems[result - kBudgetIdOffset]);
+        }
+    });
 }
 
-float const * AudioPluginAudioProcessorEditor::getBufferData(ChannelId ch) const
+void AudioPluginAudioProcessorEditor::updateDurationItems()
 {
-    return buffer_.getReadPointer((int)ch);
+    // チャンネル数の多い構成ではリングバッファが短くなり、トリガーで確定できるフレームの長さも短くなる。
+    // トリガーを使用している間は、確定できない長さの表示時間を選択できないようにする。
+    auto const sample_rate = processorRef.getSampleRate();
+    auto const triggered = processorRef.getTriggerEngine().getMode() != TriggerEngine::Mode::kOff;
+    auto const max_frame_length = (audio_data_ != nullptr && triggered)
+    ? audio_data_->getMaxFrameLength()
+    : std::numeric_limits<std::int64_t>::max();
+
+    auto longest = DurationId::k100us;
+    for(int i = 0; i < cmb_duration_.getNumItems(); ++i) {
+        auto const id = (DurationId)cmb_duration_.getItemId(i);
+        auto const fits = getSampleCountForDuration(sample_rate, id) <= max_frame_length;
+        cmb_duration_.setItemEnabled((int)id, fits);
+
+        if(fits && getSampleCountForDuration(sample_rate, id) > getSampleCountForDuration(sample_rate, longest)) {
+            longest = id;
+        }
+    }
+
+    // 選択中の表示時間が確定できない場合は、確定できる最も長い表示時間に切り替えて、実際の長さを表示する。
+    if(getSampleCountForDuration(sample_rate, dur_) > max_frame_length) {
+        cmb_duration_.setSelectedId((int)longest);
+    }
 }
 
 int AudioPluginAudioProcessorEditor::getSampleCountForDuration(double sample_rate, DurationId d)
@@ -219,6 +992,8 @@ int AudioPluginAudioProcessorEditor::getSampleCountForDuration(double sample_rat
     double ratio = 0.0;
 
     switch(d) {
+        case DurationId::k100us:    ratio = 0.0001; break;
+        case DurationId::k1ms:      ratio = 0.001; break;
         case DurationId::k10ms:     ratio = 0.01; break;
         case DurationId::k100ms:    ratio = 0.1; break;
         case DurationId::k1s:       ratio = 1.0; break;
@@ -2,11 +2,16 @@
 
 #include <juce_audio_utils/juce_audio_utils.h>
 #include "PluginProcessor.h"
+#include "RenderScheduler.h"
+#include "SpectrumAnalyzer.h"
+#include "WaveformCache.h"
+#include "WaveformRenderer.h"
 
 //==============================================================================
 class AudioPluginAudioProcessorEditor
 :   public juce::AudioProcessorEditor
-,   juce::Timer
+,   RenderScheduler::Client
+,   juce::ScrollBar::Listener
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&);
@@ -15,7 +20,11 @@ public:
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
-    void timerCallback() override;
+    bool isRenderTargetVisible() const override;
+    bool onRenderTick() override;
+    void mouseDown(juce::MouseEvent const &e) override;
+    void mouseWheelMove(juce::MouseEvent const &e, juce::MouseWheelDetails const &wheel) override;
+    void scrollBarMoved(juce::ScrollBar *scroll_bar, double new_range_start) override;
 
 private:
     // This reference is provided as a quick way for your editor to
@@ -23,38 +32,107 @@ private:
     AudioPluginAudioProcessor& processorRef;
 
     juce::ComboBox cmb_duration_;
-    juce::ToggleButton btn_left_pre_;
-    juce::ToggleButton btn_left_post_;
-    juce::ToggleButton btn_right_pre_;
-    juce::ToggleButton btn_right_post_;
+    juce::TextButton btn_traces_;
+    juce::ToggleButton btn_scroll_cache_;
+    juce::ToggleButton btn_telemetry_;
+    juce::TextButton btn_dump_telemetry_;
     juce::Slider sl_cutoff_;
+    juce::ComboBox cmb_slope_;
+    juce::ToggleButton btn_history_;
+    juce::ScrollBar sb_history_ { false };
+    juce::ComboBox cmb_trigger_mode_;
+    juce::ComboBox cmb_trigger_source_;
+    juce::Slider sl_trigger_level_;
+    juce::Slider sl_pre_trigger_;
+    juce::Slider sl_trigger_hysteresis_;
+    juce::Slider sl_trigger_holdoff_;
+    juce::ToggleButton btn_spectrum_;
+    juce::ComboBox cmb_fft_size_;
+    juce::ComboBox cmb_fft_window_;
+    juce::ComboBox cmb_fft_overlap_;
+    juce::ComboBox cmb_fft_averaging_;
+    juce::TextButton btn_record_;
+    juce::ComboBox cmb_view_;
+    juce::ToggleButton btn_meters_;
+    juce::ToggleButton btn_transport_;
 
     enum class DurationId : int {
         k10ms = 1,
         k100ms,
         k1s,
         k3s,
+        k1ms,
+        k100us,
     };
 
-    enum class ChannelId : int {
-        kLeftPre = 0,
-        kRightPre,
-        kLeftPost,
-        kRightPost
+    // 波形を描画するスレッドと、最後に再描画を要求したときの描画済みの画像の通し番号
+    WaveformRenderer waveform_renderer_;
+    std::uint64_t drawn_sequence_ = 0;
+    // 最後に表示の遅れを記録した画像の通し番号
+    std::uint64_t latency_sequence_ = 0;
+    // 履歴の描画に使用する、各列の最小値・最大値・RMS
+    std::vector<PeakPyramid::Column> columns_;
+    DurationId dur_ = DurationId::k10ms;
+    // 最後に Processor から取得した AudioData
+    std::shared_ptr<AudioData const> audio_data_;
+    // AudioData のリングバッファの各チャンネルを表示するかどうか
+    std::vector<bool> trace_enabled_;
+    // trace_enabled_ と cmb_trigger_source_ を作成したときの AudioData
+    AudioData const *traced_audio_data_ = nullptr;
+    std::unique_ptr<juce::FileChooser> telemetry_chooser_;
+    std::unique_ptr<juce::FileChooser> record_chooser_;
+    // プロセス内のすべてのエディタで共有する、表示の更新のタイマー
+    juce::SharedResourcePointer<RenderScheduler> render_scheduler_;
+    SpectrumAnalyzer spectrum_analyzer_;
+    SpectrumAnalyzer::Spectrum spectrum_;
+    // 履歴の表示範囲の末尾の通算サンプル位置と、表示範囲のサンプル数
+    // history_follow_ が true の間は、表示範囲の末尾を最新の位置に合わせる。
+    double history_end_ = 0;
+    double history_length_ = 0;
+    bool history_follow_ = true;
+    // 最後に表示を更新したときの、履歴に書き込まれたサンプル数
+    std::int64_t history_num_written_ = -1;
+
+    // メーターに表示する、チャンネルごとの値
+    struct MeterChannel
+    {
+        //! ピークホールド [dB]
+        float peak_db = -100.0f;
+        //! 平滑化した二乗平均
+        double mean_square = 0;
+        //! メーターを表示してからのトゥルーピークの最大値
+        float true_peak_max = 0;
     };
 
-    float * getBufferData(ChannelId);
-    float const * getBufferData(ChannelId) const;
-
-    juce::AudioSampleBuffer buffer_;
-    juce::AudioThumbnailCache thumb_cache_;
-    juce::AudioFormatManager afm_;
-    juce::AudioThumbnail thumb_;
-    std::int64_t saved_thumbnail_position_ = 0;
-    std::int64_t saved_written_size_ = 0;
-    double saved_sample_rate_ = 1.0;
-    int saved_block_size_ = 0;
-    DurationId dur_ = DurationId::k10ms;
+    // メーターに表示する、バスごとの値
+    struct MeterBus
+    {
+        int num_channels = 0;
+        std::array<MeterChannel, LevelMeter::kMaxChannels> channels;
+        //! 平滑化した L, R の相関係数
+        double correlation = 0;
+        float momentary = LevelMeter::kSilence;
+        float short_term = LevelMeter::kSilence;
+    };
+
+    std::array<MeterBus, LevelMeter::kNumBuses> meter_buses_;
+
+    juce::Rectangle<int> getWaveformBounds() const;
+    juce::Rectangle<int> getMeterBounds() const;
+    void updateTraces();
+    void showTraceMenu();
+    void showRenderMenu();
+    void drawTelemetry(juce::Graphics &g, juce::Rectangle<int> bounds);
+    void dumpTelemetry();
+    void toggleRecording();
+    void updateRecordButton();
+    void drawSpectrum(juce::Graphics &g, juce::Rectangle<int> bounds, int num_traces);
+    void drawHistory(juce::Graphics &g, juce::Rectangle<int> bounds, int num_traces);
+    void updateHistoryRange();
+    void updateHistoryButton();
+    void updateDurationItems();
+    bool updateMeters();
+    void drawMeters(juce::Graphics &g, juce::Rectangle<int> bounds);
 
     static
     int getSampleCountForDuration(double sample_rate, DurationId d);
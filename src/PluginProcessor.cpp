@@ -1,7 +1,13 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "HistoryStore.h"
+#include "RealtimeChecker.h"
+#include "Recorder.h"
+#include "SimdKernels.h"
 
+#include <array>
 #include <cassert>
+#include <type_traits>
 
 //==============================================================================
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
@@ -9,13 +15,12 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
+                       .withInput  ("Sidechain", juce::AudioChannelSet::stereo(), false)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        )
 {
-    active_audio_data_.store(nullptr);
-
     addParameter(cutoff_ = new juce::AudioParameterFloat("cutoff",
                                                          "Cut Off",
                                                          juce::NormalisableRange<float> { 0.0, 1.0 },
@@ -25,10 +30,23 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                                                          [this](float value, int len) { return floatToString(value, len); },
                                                          [this](juce::String const &str) { return stringToFloat(str); }
                                                          ));
+
+    addParameter(slope_ = new juce::AudioParameterChoice("slope",
+                                                         "Slope",
+                                                         juce::StringArray { "12 dB/oct", "24 dB/oct", "48 dB/oct" },
+                                                         0));
+
+    recorder_ = std::make_unique<Recorder>(*this);
+    history_ = std::make_unique<HistoryStore>(*this);
+
+    // 使用する命令セットの判別がオーディオスレッドで行われないように、ここで済ませておく。
+    SimdKernels::getActiveInstructionSet();
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    recorder_->stop();
+    history_->stop();
 }
 
 //==============================================================================
@@ -103,30 +121,44 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     // initialisation that you need..
     juce::ignoreUnused (sampleRate);
 
-    auto buffer = RingBuffer<float>(2, (int)std::round(sampleRate));
-
-    auto reset_buffer = [](AudioData &data, RingBuffer<float> const &new_buffer) {
-        std::unique_lock<AudioData> lock(data);
-        data.getPreBuffer() = new_buffer;
-        data.getPostBuffer() = new_buffer;
-    };
-
-    reset_buffer(datas_[0], buffer);
-    reset_buffer(datas_[1], buffer);
-
-    active_audio_data_.store(&datas_[0]);
-
-    tmp_buf_ = juce::AudioSampleBuffer(2, samplesPerBlock);
+    // チャンネル数に応じたメモリは、すべてここで確保しておく。
+    auto const main_layout = getChannelLayoutOfBus(true, 0);
+    auto const *sidechain_bus = getBus(true, 1);
+    auto const sidechain_layout = (sidechain_bus != nullptr && sidechain_bus->isEnabled())
+    ? sidechain_bus->getCurrentLayout()
+    : juce::AudioChannelSet::disabled();
+
+    // リングバッファは kMaxFrameSeconds のフレームを保持できる長さにするが、 kMaxRingBytes を超える場合は短くする。
+    auto const num_ring_channels = main_layout.size() * 2 + sidechain_layout.size();
+    auto const ring_length = std::min<std::int64_t>((std::int64_t)std::ceil(sampleRate * kMaxFrameSeconds * 2),
+                                                    kMaxRingBytes / ((std::int64_t)sizeof(float) * num_ring_channels));
+    std::atomic_store(&audio_data_, std::make_shared<AudioData>(main_layout, sidechain_layout, ring_length));
+    trigger_.reset();
+    telemetry_.reset();
+    meter_.prepare(main_layout.size(), sampleRate);
+
+    // ブロックの長さに関係なく kSubBlockSize ごとに処理するので、作業用のバッファは samplesPerBlock によらない。
+    juce::ignoreUnused(samplesPerBlock);
+    tmp_buf_ = juce::AudioSampleBuffer(main_layout.size(), kSubBlockSize);
     tmp_buf_.clear();
-    smoothed_cutoff_.reset(5);
-    smoothed_cutoff_.setTargetValue(cutoff_->get());
-    smoothed_cutoff_.skip(5);
-    last_cutoff_ = smoothed_cutoff_.getNextValue();
+    capture_buf_ = juce::AudioSampleBuffer(main_layout.size() + sidechain_layout.size(), kSubBlockSize);
+    capture_buf_.clear();
+
+    // カットオフパラメータに対する係数表をここで作成しておき、オーディオスレッドでは係数を計算しない。
+    num_filter_channels_ = main_layout.size();
+    filter_.prepare(num_filter_channels_, kSubBlockSize, sampleRate, [this](float value) { return (double)paramToHz(value); });
+    filter_.setSlope((BiquadCascade::Slope)(slope_->getIndex() + 1));
+    filter_.reset();
+
+    // カットオフパラメータはサンプルごとに 20 ms かけて目標値に近づける。
+    smoothed_cutoff_.reset(sampleRate, 0.02);
+    smoothed_cutoff_.setCurrentAndTargetValue(cutoff_->get());
+    cutoff_buf_.assign(kSubBlockSize, 0.0f);
 }
 
 void AudioPluginAudioProcessor::releaseResources()
 {
-    active_audio_data_.store(nullptr);
+    std::atomic_store(&audio_data_, std::shared_ptr<AudioData>());
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
 }
@@ -138,14 +170,18 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // メインバスは任意のチャンネル構成に対応する。
+    auto const &main_output = layouts.getMainOutputChannelSet();
+    if (main_output.isDisabled() || main_output.size() > kMaxChannelsPerBus)
         return false;
 
     // This checks if the input layout matches the output layout
    #if ! JucePlugin_IsSynth
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+    if (main_output != layouts.getMainInputChannelSet())
+        return false;
+
+    // サイドチェインは無効にするか、任意のチャンネル構成を使用できる。
+    if (layouts.inputBuses.size() > 1 && layouts.getChannelSet(true, 1).size() > kMaxChannelsPerBus)
         return false;
    #endif
 
@@ -153,11 +189,33 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
   #endif
 }
 
+bool AudioPluginAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
-    // buffer に読み書きするサンプル長
-    auto const length = std::min<int>(buffer.getNumSamples(), tmp_buf_.getNumSamples());
+    processBlockImpl(buffer, midiMessages);
+}
+
+void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer,
+                                              juce::MidiBuffer& midiMessages)
+{
+    processBlockImpl(buffer, midiMessages);
+}
+
+template<class SampleType>
+void AudioPluginAudioProcessor::processBlockImpl(juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midiMessages)
+{
+    // RT チェックを有効にしたビルドでは、この関数の中でのメモリの確保やロックの待機が違反として記録される。
+    RealtimeChecker::ScopedRealtimeSection realtime_section;
+
+    auto const block_start = ProcessorTelemetry::now();
+
+    // buffer に読み書きするサンプル長。 prepareToPlay() で指定された長さを超えていてもすべて処理する。
+    auto const length = buffer.getNumSamples();
 
     juce::ignoreUnused (midiMessages);
 
@@ -165,19 +223,13 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
-    assert(totalNumInputChannels == 2);
-    assert(totalNumOutputChannels == 2);
-    assert(buffer.getNumChannels() >= totalNumInputChannels);
-
-    for(int ch = 0; ch < totalNumInputChannels; ++ch) {
-        auto range = buffer.findMinMax(ch, 0, length);
-        //assert(range.getStart() >= -3.0 && range.getEnd() <= 3.0);
-    }
+    // メインバスのチャンネル数。 prepareToPlay() で確保したバッファのチャンネル数を超えないようにする。
+    auto const num_main_channels = std::min<int>({ getMainBusNumInputChannels(),
+                                                   tmp_buf_.getNumChannels(),
+                                                   num_filter_channels_,
+                                                   kMaxChannelsPerBus });
 
-    // エフェクト処理前のデータを退避
-    for(int ch = 0; ch < totalNumInputChannels; ++ch) {
-        tmp_buf_.copyFrom(ch, 0, buffer, ch, 0, length);
-    }
+    assert(buffer.getNumChannels() >= totalNumInputChannels);
 
     // In case we have more outputs than inputs, this code clears any output
     // channels that didn't contain input data, (because these aren't
@@ -190,17 +242,87 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     }
 
     smoothed_cutoff_.setTargetValue(cutoff_->get());
-    auto const new_cutoff = smoothed_cutoff_.getNextValue();
+    filter_.setSlope((BiquadCascade::Slope)(slope_->getIndex() + 1));
+
+    // 読み込み側とは BroadcastRingBuffer を介してデータを受け渡すので、ここでロックや待機は発生しない。
+    // チャンネル構成が prepareToPlay() の時点から変わっている場合は、 prepareToPlay() が呼ばれ直すまで書き込まない。
+    auto *audio_data = audio_data_.get();
+    if(audio_data != nullptr &&
+       (audio_data->getNumChannels() != num_main_channels ||
+        audio_data->getNumSidechainChannels() > totalNumInputChannels - num_main_channels))
+    {
+        audio_data = nullptr;
+    }
+
+    // サイドチェインの入力は、メインバスの入力に続くチャンネルに格納されている。
+    // getBusBuffer() はチャンネル数によってはメモリを確保するので、チャンネルのインデックスから直接参照する。
+    auto const sidechain_channel = (audio_data != nullptr && audio_data->getNumSidechainChannels() > 0)
+    ? getChannelIndexInProcessBlockBuffer(true, 1, 0)
+    : -1;
+
+    // ブロックの先頭での、リングバッファ上の位置とホストのトランスポートの位置。
+    // GUI 側で表示の遅れを求めたり、表示をトランスポートの位置に合わせたりするために記録する。
+    auto const capture_start = (audio_data != nullptr) ? audio_data->getBuffer().getNumWritten() : 0;
+    // ホストが位置を提供しない場合は、トランスポートの位置を持たない記録にする。
+    juce::Optional<juce::AudioPlayHead::PositionInfo> position_info;
+    if(auto *play_head = getPlayHead()) {
+        position_info = play_head->getPosition();
+    }
+
+    auto const time_in_samples = position_info ? position_info->getTimeInSamples() : juce::Optional<juce::int64>();
+    auto const has_transport = time_in_samples.hasValue();
 
-    // 前回処理時から cutoff パラメータの値が変わっていたら、新しいカットオフ周波数で各チャンネルのフィルタ設定を更新する
-    if(new_cutoff != last_cutoff_) {
-        last_cutoff_ = new_cutoff;
-        double sample_rate = getSampleRate();
+    // 区間ごとの処理時間はサブブロックごとに記録される。
+    for(int offset = 0; offset < length; offset += kSubBlockSize) {
+        processSubBlock(buffer, offset, std::min(kSubBlockSize, length - offset), num_main_channels,
+                        audio_data, sidechain_channel);
+    }
+
+    // レベルの計測結果は、ホストのブロックごとに GUI スレッドに渡す。
+    meter_.publish(length);
+
+    if(audio_data != nullptr) {
+        CaptureStamp stamp;
+        stamp.start = capture_start;
+        stamp.end = audio_data->getBuffer().getNumWritten();
+        stamp.time_ns = ProcessorTelemetry::now();
+        stamp.has_transport = has_transport;
+        stamp.is_playing = has_transport && position_info->getIsPlaying();
+        stamp.transport_position = time_in_samples.orFallback(0);
+        audio_data->getCaptureStampSlot().publish(stamp);
+    } else {
+        telemetry_.recordCaptureSkipped();
+    }
+
+    telemetry_.recordBlock(ProcessorTelemetry::now() - block_start, length, getSampleRate());
+}
+
+template<class SampleType>
+void AudioPluginAudioProcessor::processSubBlock(juce::AudioBuffer<SampleType> &buffer, int offset, int length,
+                                                int num_main_channels, AudioData *audio_data, int sidechain_channel)
+{
+    jassert(length <= kSubBlockSize);
+
+    // 倍精度で処理する場合は、 AudioData に書き込むデータとレベルを計測するデータだけを単精度に変換する。
+    constexpr bool is_double = std::is_same<SampleType, double>::value;
+
+    // サブブロックの先頭を指す、エフェクト処理後（処理前は入力そのもの）のデータ
+    std::array<SampleType *, kMaxChannelsPerBus> main_data;
+    for(int ch = 0; ch < num_main_channels; ++ch) {
+        main_data[ch] = buffer.getWritePointer(ch, offset);
+    }
 
-        // カットオフ周波数をナイキスト周波数限界まで設定すると発振してしまうので、それ以下に制限する。
-        float freq = std::min<float>(paramToHz(new_cutoff), sample_rate / 2.0 - 1);
-        filters_[0].setCoefficients(juce::IIRCoefficients::makeLowPass(sample_rate, freq));
-        filters_[1].setCoefficients(juce::IIRCoefficients::makeLowPass(sample_rate, freq));
+    // エフェクト処理前のデータを退避
+    // 入力のピークは、後で meter_ がレベルの計測と同じ処理で求める。
+    {
+        ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kPreCopy);
+        for(int ch = 0; ch < num_main_channels; ++ch) {
+            if constexpr(is_double) {
+                SimdKernels::convert(tmp_buf_.getWritePointer(ch), main_data[ch], length);
+            } else {
+                SimdKernels::copy(tmp_buf_.getWritePointer(ch), main_data[ch], length);
+            }
+        }
     }
 
     // This is the place where you'd normally do the guts of your plugin's
@@ -209,56 +331,84 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     // the samples and the outer loop is handling the channels.
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
-    for (int ch = 0; ch < totalNumInputChannels; ++ch)
     {
-        filters_[ch].processSamples(buffer.getWritePointer(ch), length);
+        ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kFilter);
+
+        // カットオフパラメータが変化している間だけ、サンプルごとに係数を補間する。
+        // 変化しているかどうかはサブブロックごとに判定する。
+        if(smoothed_cutoff_.isSmoothing()) {
+            // length は kSubBlockSize 以下なので、 cutoff_buf_ の範囲に収まる。
+            for(int i = 0; i < length; ++i) {
+                cutoff_buf_[i] = smoothed_cutoff_.getNextValue();
+            }
+
+            filter_.process(main_data.data(), num_main_channels, length, cutoff_buf_.data());
+        } else {
+            filter_.process(main_data.data(), num_main_channels, length, smoothed_cutoff_.getCurrentValue());
+        }
     }
 
-    for(int ch = 0; ch < totalNumInputChannels; ++ch) {
-        auto ch_data = buffer.getWritePointer(ch);
-        for(int smp = 0; smp < length; ++smp) {
-            ch_data[smp] = juce::jlimit<double>(-1.0, 1.0, ch_data[smp]);
+    // 出力を -1.0 .. 1.0 の範囲に制限する。（NaN は -1.0 になる）
+    {
+        ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kClamp);
+        for(int ch = 0; ch < num_main_channels; ++ch) {
+            SimdKernels::clamp(main_data[ch], length, (SampleType)-1.0, (SampleType)1.0);
+
+            // 倍精度の場合は、制限したデータを単精度に変換しておく。
+            if constexpr(is_double) {
+                SimdKernels::convert(capture_buf_.getWritePointer(ch), main_data[ch], length);
+            }
         }
     }
 
-    // AudioData に書き込みたい、エフェクト処理前のデータ（事前にprocessBlock の先頭で退避しておいたもの）
+    // AudioData に書き込みたい、エフェクト処理前のデータ（事前にサブブロックの先頭で退避しておいたもの）
     float const * const * pre_data = tmp_buf_.getArrayOfReadPointers();
     // AudioData に書き込みたい、エフェクト処理後のデータ
-    float const * const * post_data = buffer.getArrayOfReadPointers();
-
-    auto ad = active_audio_data_.load();
-    std::unique_lock<AudioData> lock(*ad, std::try_to_lock);
-    if(lock) {
-       // ロックに成功した場合は、 GUI がこの AudioData を使用していない状態なので、
-       // そのままデータを書き込む。
-       ad->getPreBuffer().write(pre_data, 0, length);
-       ad->getPostBuffer().write(post_data, 0, length);
+    float const * const * post_data = nullptr;
+    if constexpr(is_double) {
+        post_data = capture_buf_.getArrayOfReadPointers();
     } else {
-        // ロックに失敗した場合は、 GUI が使用中ということ。
-        // その場合はアクティブではない方の AudioData にデータを書き込み、それが完了した段階で
-        // active_audio_data_ のポインタを入れ替える。
-        // 現在アクティブでない方の AudioData を取得
-        auto *opposite_ad = (&datas_[0] == ad) ? &datas_[1] : &datas_[0];
-        // アクティブな AudioData に書き込まれたデータを opposite_ad にコピーする。
-        //
-        // opposite_ad は前回書き込み処理を行った AudioData ではないので、ここで新たに pre_data, post_data を書き込むと、
-        // バッファの内容が不連続になる。そのため、ここでアクティブな AudioData の中身をコピーし、
-        // 新しくアクティブになる AudioData にリングバッファの内容が引き継がれるようにする。
-        //
-        // ここではリングバッファのすべてのデータを複製しているが、今回の length 個分の領域が上書きされることを考慮して、
-        // 必要の最低限のデータだけをコピーするほうが、コピー処理の負荷が小さくて済むので良い。
-        //
-        // opposite_ad はこの瞬間 GUI スレッドで使用されていないはずなので、書き込み処理を行ってもデータ競合は発生しない。
-        // ad はこの瞬間 GUI スレッドでも使用されているかもしれないが、どちらも読み込み処理なのでデータ競合は発生しない。
-        opposite_ad->getPreBuffer() = ad->getPreBuffer();
-        opposite_ad->getPostBuffer() = ad->getPostBuffer();
-        opposite_ad->getPreBuffer().write(pre_data, 0, length);
-        opposite_ad->getPostBuffer().write(post_data, 0, length);
-        // アクティブな AudioData のポインタを置き換える
-        auto prev = active_audio_data_.exchange(opposite_ad);
-        assert(prev == ad && prev != opposite_ad);
-        // 以降は opposite_ad が active_audio_data_ として使用される。
+        post_data = main_data.data();
+    }
+
+    // エフェクト処理前後のレベルを計測する。
+    {
+        ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kMeter);
+        meter_.process(LevelMeter::Bus::kPre, pre_data, num_main_channels, length);
+        meter_.process(LevelMeter::Bus::kPost, post_data, num_main_channels, length);
     }
+
+    if(audio_data == nullptr) { return; }
+
+    auto const position = audio_data->getBuffer().getNumWritten();
+    {
+        ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kRingWrite);
+
+        std::array<float const *, kMaxChannelsPerBus> sidechain_data;
+        if(sidechain_channel >= 0) {
+            for(int ch = 0; ch < audio_data->getNumSidechainChannels(); ++ch) {
+                if constexpr(is_double) {
+                    auto *dest = capture_buf_.getWritePointer(num_main_channels + ch);
+                    SimdKernels::convert(dest, buffer.getReadPointer(sidechain_channel + ch, offset), length);
+                    sidechain_data[ch] = dest;
+                } else {
+                    sidechain_data[ch] = buffer.getReadPointer(sidechain_channel + ch, offset);
+                }
+            }
+        }
+
+        audio_data->write(pre_data, post_data, sidechain_data.data(), length);
+    }
+
+    // 書き込んだデータからトリガーを検出する。
+    // 確定したフレームを GUI スレッドが読み込む前に上書きされないように、フレームの長さはリングバッファの容量の半分までに制限する。
+    // チャンネル数の多い構成ではリングバッファが kMaxRingBytes で切り詰められるので、エディタは長すぎる表示時間を選択させない。
+    ScopedStageTimer timer(telemetry_, ProcessorTelemetry::Stage::kHandoff);
+    auto const num_ring_channels = (int)audio_data->getBuffer().getNumChannels();
+    auto const source = juce::jlimit(0, num_ring_channels - 1, trigger_.getSource());
+    trigger_.process(audio_data->getLastWrittenChannel(source), position, length,
+                     audio_data->getMaxFrameLength(),
+                     audio_data->getTriggeredFrameSlot());
 }
 
 //==============================================================================
@@ -1,31 +1,126 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
-#include "RingBuffer.h"
+#include "BiquadCascade.h"
+#include "BroadcastRingBuffer.h"
+#include "CaptureStamp.h"
+#include "LevelMeter.h"
+#include "Telemetry.h"
+#include "TriggerEngine.h"
 #include <atomic>
+#include <cassert>
 #include <memory>
+#include <vector>
+
+struct HistoryStore;
+struct Recorder;
 
 // オーディオスレッドと GUI スレッドで共有するデータを表すクラス
+//
+// エフェクト処理前後のサンプルと、サイドチェインの入力を、一つのリングバッファにまとめて保持する。
+// リングバッファのチャンネルは、
+// [エフェクト処理前の各チャンネル, エフェクト処理後の各チャンネル, サイドチェインの各チャンネル] の順に並ぶ。
+// 書き込みはオーディオスレッドからのみ行い、読み込み側はそれぞれ BufferType::Reader を使用してデータを読み込む。
 struct AudioData
 {
-    // エフェクト処理前のサンプルを表すリングバッファを返す。
-    RingBuffer<float> & getPreBuffer() { return pre_buffer_; }
-    // エフェクト処理前のサンプルを表すリングバッファを返す。
-    RingBuffer<float> const & getPreBuffer() const { return pre_buffer_; }
-    // エフェクト処理後のサンプルを表すリングバッファを返す。
-    RingBuffer<float> & getPostBuffer() { return post_buffer_; }
-    // エフェクト処理後のサンプルを表すリングバッファを返す。
-    RingBuffer<float> const & getPostBuffer() const { return post_buffer_; }
-
-    // Support Lockable Concept of C++ Standard.
-    void lock() { lock_.enter(); }
-    void unlock() { lock_.exit(); }
-    bool try_lock() { return lock_.tryEnter(); }
+    using BufferType = BroadcastRingBuffer<float>;
+
+    //! コンストラクタ
+    /*! @param main_layout メインバスのチャンネル構成
+     *  @param sidechain_layout サイドチェインのバスのチャンネル構成。サイドチェインが無効な場合は空のチャンネル構成
+     *  @param num_samples リングバッファに保持するサンプル数。
+     *  読み込み側がデータをコピーせずに参照できるように、リングバッファはミラーリングして確保するので、
+     *  実際のサンプル数はこの値より少し大きくなることがある。
+     */
+    AudioData(juce::AudioChannelSet const &main_layout,
+              juce::AudioChannelSet const &sidechain_layout,
+              std::int64_t num_samples)
+    :   buffer_(main_layout.size() * 2 + sidechain_layout.size(), num_samples, BufferType::Layout::kMirrored)
+    ,   channel_pointers_(main_layout.size() * 2 + sidechain_layout.size())
+    ,   num_channels_(main_layout.size())
+    ,   num_sidechain_channels_(sidechain_layout.size())
+    {
+        auto channel_name = [](juce::AudioChannelSet const &layout, int ch) {
+            auto name = juce::AudioChannelSet::getAbbreviatedChannelTypeName(layout.getTypeOfChannel(ch));
+            return name.isNotEmpty() ? name : juce::String(ch + 1);
+        };
+
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            channel_names_.add(channel_name(main_layout, ch) + " Pre");
+        }
+
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            channel_names_.add(channel_name(main_layout, ch) + " Post");
+        }
+
+        for(int ch = 0; ch < num_sidechain_channels_; ++ch) {
+            channel_names_.add("SC " + channel_name(sidechain_layout, ch));
+        }
+    }
+
+    //! エフェクト処理前（後）のチャンネル数を返す。
+    int getNumChannels() const noexcept { return num_channels_; }
+
+    //! サイドチェインのチャンネル数を返す。
+    int getNumSidechainChannels() const noexcept { return num_sidechain_channels_; }
+
+    //! リングバッファの各チャンネルの表示名を返す。
+    juce::String getChannelName(int channel) const { return channel_names_[channel]; }
+
+    //! エフェクト処理前後のサンプルを保持するリングバッファを返す。
+    BufferType const & getBuffer() const noexcept { return buffer_; }
+
+    //! トリガーによって確定した、最新のフレームを保持するスロットを返す。
+    /*! フレームの位置は getBuffer() のリングバッファ上の位置を表す。
+     */
+    TriggeredFrameSlot & getTriggeredFrameSlot() noexcept { return frame_slot_; }
+    TriggeredFrameSlot const & getTriggeredFrameSlot() const noexcept { return frame_slot_; }
+
+    //! トリガーで確定させるフレームのサンプル数の上限を返す。
+    /*! 確定したフレームを GUI スレッドが読み込む前に上書きされないように、リングバッファの容量の半分にする。
+     */
+    std::int64_t getMaxFrameLength() const noexcept { return buffer_.getNumSamples() / 2; }
+
+    //! 最後に書き込んだホストのブロックの、位置と時刻とトランスポートの記録を保持するスロットを返す。
+    /*! 記録の位置は getBuffer() のリングバッファ上の位置を表す。
+     */
+    CaptureStampSlot & getCaptureStampSlot() noexcept { return stamp_slot_; }
+    CaptureStampSlot const & getCaptureStampSlot() const noexcept { return stamp_slot_; }
+
+    //! エフェクト処理前後のサンプルと、サイドチェインの入力を書き込む。
+    /*! オーディオスレッドからのみ呼び出すこと。
+     *  @param sidechain_data getNumSidechainChannels() が 0 の場合は nullptr でもよい。
+     */
+    void write(float const * const * pre_data,
+               float const * const * post_data,
+               float const * const * sidechain_data,
+               int length)
+    {
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            channel_pointers_[ch] = pre_data[ch];
+            channel_pointers_[num_channels_ + ch] = post_data[ch];
+        }
+
+        for(int ch = 0; ch < num_sidechain_channels_; ++ch) {
+            channel_pointers_[num_channels_ * 2 + ch] = sidechain_data[ch];
+        }
+
+        buffer_.write(channel_pointers_.data(), 0, length);
+    }
+
+    //! 直前の write() で書き込んだ、リングバッファの指定したチャンネルのデータを返す。
+    /*! オーディオスレッドからのみ呼び出すこと。
+     */
+    float const * getLastWrittenChannel(int channel) const { return channel_pointers_[channel]; }
 
 private:
-    juce::SpinLock lock_;
-    RingBuffer<float> pre_buffer_;
-    RingBuffer<float> post_buffer_;
+    BufferType buffer_;
+    TriggeredFrameSlot frame_slot_;
+    CaptureStampSlot stamp_slot_;
+    std::vector<float const *> channel_pointers_;
+    juce::StringArray channel_names_;
+    int num_channels_ = 0;
+    int num_sidechain_channels_ = 0;
 };
 
 //==============================================================================
@@ -43,6 +138,10 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+
+    // 倍精度で処理するホストでは、変換せずに double のまま処理する。
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -67,24 +166,92 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    // 最新のデータが書き込まれた AudioData を取得する。
-    AudioData * getActiveAudioData() { return active_audio_data_.load(); }
+    // エフェクト処理前後のデータが書き込まれる AudioData を取得する。
+    // prepareToPlay() のたびに新しい AudioData が作成されるので、呼び出し側は取得したものを保持して使用し、
+    // 定期的にこの関数で取得し直して、 AudioData が変わっていないかを確認する。
+    std::shared_ptr<AudioData const> getAudioData() const { return std::atomic_load(&audio_data_); }
+
+    // 1 つのバスで扱えるチャンネル数の上限
+    static constexpr int kMaxChannelsPerBus = 32;
+
+    // processBlock() は、ホストから渡されたブロックをこのサンプル数ごとのサブブロックに分けて処理する。
+    // 作業用のバッファはこの大きさで確保するので、ホストが prepareToPlay() で指定したより長いブロックを渡しても、すべてのサンプルを処理できる。
+    static constexpr int kSubBlockSize = 256;
+
+    // トリガーで確定させるフレームの長さの上限 [秒]。エディタで選択できる最長の表示時間に合わせる。
+    // 確定したフレームを GUI スレッドが読み込む前に上書きされないように、リングバッファはこの 2 倍の長さで確保する。
+    static constexpr double kMaxFrameSeconds = 3.0;
+
+    // AudioData のリングバッファの大きさの上限 [バイト]。
+    // チャンネル数やサンプルレートが大きく、 kMaxFrameSeconds の 2 倍の長さが収まらない場合は、リングバッファを短くする。
+    // その場合、フレームの長さの上限は AudioData::getMaxFrameLength() になる。
+    static constexpr std::int64_t kMaxRingBytes = std::int64_t(64) << 20;
+
+    // 表示用のフレームを確定させるトリガーの設定を変更するためのオブジェクトを返す。
+    TriggerEngine & getTriggerEngine() { return trigger_; }
+
+    // processBlock() の処理時間と、データの受け渡し状況の記録を返す。
+    // 集計結果は ProcessorTelemetry::getSnapshot() で任意のスレッドから取得できる。
+    ProcessorTelemetry & getTelemetry() { return telemetry_; }
+
+    // エフェクト処理前後のメインバスのレベルの計測結果を受け取るためのオブジェクトを返す。
+    // LevelMeter::pop() は GUI スレッドなど一つのスレッドからだけ呼び出すこと。
+    LevelMeter & getMeter() { return meter_; }
+
+    // AudioData のデータをファイルに書き出すためのオブジェクトを返す。
+    // エディタを閉じても録音を続けられるように、 Processor が所有する。
+    Recorder & getRecorder() { return *recorder_; }
+
+    // AudioData のデータを長時間分ファイルに保持するためのオブジェクトを返す。
+    HistoryStore & getHistory() { return *history_; }
 
     // フィルタのカットオフ周波数を変更するためのパラメータ。
     // 0.0 .. 1.0 の範囲の値を取り、 20 [Hz] .. sampleRate / 2.0 [Hz] の範囲のカットオフ周波数を表す。
     juce::AudioParameterFloat *cutoff_;
 
+    // フィルタの傾きを変更するためのパラメータ。
+    // 選択肢のインデックスの 0, 1, 2 が、 12, 24, 48 dB/oct を表す。
+    juce::AudioParameterChoice *slope_;
+
     float HzToParam(float Hz) const;
     float paramToHz(float value) const;
     juce::String floatToString(float value, int maximumStringLength) const;
     float stringToFloat(juce::String const &str) const;
 private:
+    // エフェクト処理前のデータを退避するバッファ。 kSubBlockSize サンプル分を確保する。
     juce::AudioSampleBuffer tmp_buf_;
-    AudioData datas_[2];
-    std::atomic<AudioData *> active_audio_data_;
-    juce::IIRFilter filters_[2];
+    // 倍精度で処理する場合に、 AudioData に書き込むエフェクト処理後のデータとサイドチェインの入力を、
+    // 単精度に変換しておくバッファ。 [メインバスの各チャンネル, サイドチェインの各チャンネル] の順に kSubBlockSize サンプル分を確保する。
+    juce::AudioSampleBuffer capture_buf_;
+    // オーディオスレッドからは、 prepareToPlay() と並行して呼び出されないことを前提に、ロックせずにアクセスする。
+    std::shared_ptr<AudioData> audio_data_;
+    TriggerEngine trigger_;
+    ProcessorTelemetry telemetry_;
+    LevelMeter meter_;
+    // メインバスの全チャンネルをまとめて処理するフィルタ
+    BiquadCascade filter_;
+    // メインバスのチャンネル数。 filter_ で処理できるチャンネル数を表す。
+    int num_filter_channels_ = 0;
     juce::SmoothedValue<float> smoothed_cutoff_;
-    float last_cutoff_ = 0;
+    // サブブロック内のサンプルごとのカットオフパラメータ
+    std::vector<float> cutoff_buf_;
+    // 書き込みスレッドから audio_data_ を参照するので、 audio_data_ より先に破棄されるように最後に宣言する。
+    std::unique_ptr<Recorder> recorder_;
+    std::unique_ptr<HistoryStore> history_;
+
+    //! 単精度と倍精度の processBlock() に共通の処理
+    /*! AudioData やレベルメーターには、どちらの場合も単精度のデータを渡す。
+     */
+    template<class SampleType>
+    void processBlockImpl(juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midiMessages);
+
+    //! buffer の offset から length (<= kSubBlockSize) サンプルを処理する。
+    /*! @param audio_data 処理したデータを書き込む AudioData 。書き込まない場合は nullptr
+     *  @param sidechain_channel サイドチェインの先頭のチャンネルの、 buffer 上のインデックス。サイドチェインがない場合は -1
+     */
+    template<class SampleType>
+    void processSubBlock(juce::AudioBuffer<SampleType> &buffer, int offset, int length, int num_main_channels,
+                         AudioData *audio_data, int sidechain_channel);
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
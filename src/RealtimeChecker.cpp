@@ -0,0 +1,111 @@
+#include "RealtimeChecker.h"
+
+#if defined(SIMPLE_OSCILLOSCOPE_RT_CHECK)
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__) || defined(__APPLE__)
+  #define SIMPLE_OSCILLOSCOPE_HAS_EXECINFO 1
+  #include <execinfo.h>
+#elif defined(_WIN32)
+  #include <windows.h>
+#endif
+
+namespace RealtimeChecker
+{
+
+namespace
+{
+    thread_local int t_realtime_depth = 0;
+    // 違反の記録中に発生した呼び出しを無視するためのフラグ
+    thread_local bool t_recording = false;
+
+    // 違反はリアルタイム区間の中で記録するので、メモリを確保せずに済むように静的な領域に格納する。
+    Violation g_violations[kMaxViolations];
+    std::atomic<std::int64_t> g_num_violations { 0 };
+}
+
+void enterRealtime() noexcept
+{
+    ++t_realtime_depth;
+}
+
+void exitRealtime() noexcept
+{
+    --t_realtime_depth;
+}
+
+bool isInRealtime() noexcept
+{
+    return t_realtime_depth > 0;
+}
+
+void onBlockingCall(char const *what) noexcept
+{
+    if(t_realtime_depth <= 0 || t_recording) { return; }
+
+    t_recording = true;
+
+    auto const index = g_num_violations.fetch_add(1);
+    if(index < kMaxViolations) {
+        auto &v = g_violations[index];
+        v.what = what;
+
+#if defined(SIMPLE_OSCILLOSCOPE_HAS_EXECINFO)
+        v.num_frames = backtrace(v.frames, kMaxFrames);
+#elif defined(_WIN32)
+        v.num_frames = (int)CaptureStackBackTrace(0, kMaxFrames, v.frames, nullptr);
+#else
+        v.num_frames = 0;
+#endif
+    }
+
+    t_recording = false;
+}
+
+std::int64_t getNumViolations() noexcept
+{
+    return g_num_violations.load();
+}
+
+std::vector<Violation> getViolations()
+{
+    auto const num = (int)std::min<std::int64_t>(g_num_violations.load(), kMaxViolations);
+    return std::vector<Violation>(g_violations, g_violations + num);
+}
+
+std::string format(Violation const &violation)
+{
+    std::string text = violation.what != nullptr ? violation.what : "(unknown)";
+    text += " called from the realtime section\n";
+
+#if defined(SIMPLE_OSCILLOSCOPE_HAS_EXECINFO)
+    auto **symbols = backtrace_symbols(violation.frames, violation.num_frames);
+    for(int i = 0; i < violation.num_frames; ++i) {
+        text += "    ";
+        text += (symbols != nullptr) ? symbols[i] : "?";
+        text += "\n";
+    }
+    std::free(symbols);
+#else
+    for(int i = 0; i < violation.num_frames; ++i) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "    %p\n", violation.frames[i]);
+        text += buf;
+    }
+#endif
+
+    return text;
+}
+
+void reset() noexcept
+{
+    g_num_violations.store(0);
+}
+
+} // namespace RealtimeChecker
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// オーディオスレッドで行ってはいけない処理（メモリの確保・解放、ロックの待機、ブロックするシステムコール）を検出する仕組み
+//
+// SIMPLE_OSCILLOSCOPE_RT_CHECK を定義してビルドした場合だけ有効になり、定義していない場合はすべて何もしない。
+// processBlock() は ScopedRealtimeSection で処理全体をリアルタイム区間として宣言する。
+// 検査用の実行ファイル (tools/RealtimeCheck.cpp) は malloc や pthread_mutex_lock などを置き換えて onBlockingCall() を呼び出し、
+// リアルタイム区間の中で呼ばれた場合は、呼び出し元のスタックトレースとともに違反として記録される。
+namespace RealtimeChecker
+{
+    //! 記録する違反の最大数。これを超えた違反は数だけを数える。
+    constexpr int kMaxViolations = 64;
+
+    //! 一つの違反について記録するスタックトレースの最大の深さ
+    constexpr int kMaxFrames = 32;
+
+    //! 記録された違反
+    struct Violation
+    {
+        //! 呼び出された処理の名前
+        char const *what = nullptr;
+        int num_frames = 0;
+        void *frames[kMaxFrames] = {};
+    };
+
+#if defined(SIMPLE_OSCILLOSCOPE_RT_CHECK)
+    //! 現在のスレッドのリアルタイム区間を開始・終了する。入れ子にできる。
+    void enterRealtime() noexcept;
+    void exitRealtime() noexcept;
+
+    //! 現在のスレッドがリアルタイム区間の中にいるかどうか
+    bool isInRealtime() noexcept;
+
+    //! リアルタイム区間で行ってはいけない処理が呼び出されたことを通知する。
+    /*! リアルタイム区間の外で呼び出された場合は何もしない。
+     *  違反の記録中に発生したメモリの確保などは無視する。
+     *  @param what 処理の名前。文字列リテラルなど、寿命が続くものを渡すこと。
+     */
+    void onBlockingCall(char const *what) noexcept;
+
+    //! これまでに検出した違反の数
+    std::int64_t getNumViolations() noexcept;
+
+    //! 記録した違反を返す。リアルタイム区間の外から呼び出すこと。
+    std::vector<Violation> getViolations();
+
+    //! 違反の内容とスタックトレースを、人が読める形式の文字列にする。
+    std::string format(Violation const &violation);
+
+    //! 記録した違反を破棄する。検査対象のスレッドが止まっている間に呼び出すこと。
+    void reset() noexcept;
+#else
+    inline void enterRealtime() noexcept {}
+    inline void exitRealtime() noexcept {}
+    inline bool isInRealtime() noexcept { return false; }
+    inline void onBlockingCall(char const *) noexcept {}
+    inline std::int64_t getNumViolations() noexcept { return 0; }
+    inline std::vector<Violation> getViolations() { return {}; }
+    inline std::string format(Violation const &) { return {}; }
+    inline void reset() noexcept {}
+#endif
+
+    //! スコープの間、現在のスレッドをリアルタイム区間として扱うクラス
+    struct ScopedRealtimeSection
+    {
+        ScopedRealtimeSection() noexcept { enterRealtime(); }
+        ~ScopedRealtimeSection() { exitRealtime(); }
+
+        ScopedRealtimeSection(ScopedRealtimeSection const &) = delete;
+        ScopedRealtimeSection & operator=(ScopedRealtimeSection const &) = delete;
+    };
+}
@@ -0,0 +1,189 @@
+#include "Recorder.h"
+
+#include <algorithm>
+#include <cmath>
+
+Recorder::Recorder(AudioPluginAudioProcessor &processor)
+:   juce::Thread("Recorder")
+,   processor_(processor)
+{}
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+Recorder::Format Recorder::getFormatForFile(juce::File const &file)
+{
+    return file.hasFileExtension("wav") ? Format::kWav : Format::kRawFloat;
+}
+
+bool Recorder::start(juce::File const &file, Format format)
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    stopThread(2000);
+    close();
+
+    // 以降で開始に失敗した場合も、前の録音は終了した状態になる。
+    recording_ = false;
+
+    auto audio_data = processor_.getAudioData();
+    auto const sample_rate = processor_.getSampleRate();
+    if(audio_data == nullptr || sample_rate <= 0) { return false; }
+
+    auto const num_channels = (int)audio_data->getBuffer().getNumChannels();
+
+    auto stream = std::make_unique<juce::FileOutputStream>(file);
+    if(stream->failedToOpen()) { return false; }
+
+    // 既存のファイルに上書きする場合は、古い内容を残さないようにする。
+    stream->setPosition(0);
+    stream->truncate();
+
+    if(format == Format::kWav) {
+        juce::WavAudioFormat wav;
+        writer_.reset(wav.createWriterFor(stream.get(), sample_rate, (unsigned int)num_channels, 32, {}, 0));
+        if(writer_ == nullptr) {
+            // 作成した空のファイルを残さない。
+            stream.reset();
+            file.deleteFile();
+            return false;
+        }
+
+        // writer_ が出力ストリームの所有権を持つ。
+        stream.release();
+    } else {
+        raw_stream_ = std::move(stream);
+    }
+
+    auto const batch_size = (int)std::ceil(sample_rate * kBatchSeconds);
+    read_buffer_.setSize(num_channels, batch_size);
+    interleaved_.assign((std::size_t)num_channels * batch_size, 0.0f);
+
+    audio_data_ = audio_data;
+    reader_ = AudioData::BufferType::Reader(audio_data_->getBuffer().getNumWritten());
+    format_ = format;
+
+    failed_ = false;
+    num_recorded_ = 0;
+    num_overruns_ = 0;
+    num_dropped_ = 0;
+    sample_rate_ = sample_rate;
+    recording_ = true;
+
+    startThread();
+    return true;
+}
+
+void Recorder::stop()
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    // 書き込みスレッドは終了する前に残りのデータを書き出す。
+    stopThread(2000);
+    close();
+    recording_ = false;
+}
+
+Recorder::Status Recorder::getStatus() const
+{
+    Status s;
+    s.recording = recording_.load();
+    s.failed = failed_.load();
+    s.num_recorded = num_recorded_.load();
+    s.num_overruns = num_overruns_.load();
+    s.num_dropped = num_dropped_.load();
+    s.sample_rate = sample_rate_.load();
+    return s;
+}
+
+void Recorder::run()
+{
+    while(threadShouldExit() == false) {
+        drain();
+        wait(kIntervalMs);
+    }
+
+    drain();
+}
+
+void Recorder::drain()
+{
+    if(failed_.load() || audio_data_ == nullptr) { return; }
+
+    // prepareToPlay() によって AudioData が作り直されていたら、新しい AudioData の先頭から録音を続ける。
+    // チャンネル構成やサンプルレートが変わった場合は、同じファイルに書き込めないので録音を中断する。
+    auto audio_data = processor_.getAudioData();
+    if(audio_data != audio_data_) {
+        if(audio_data == nullptr) { return; }
+
+        if(audio_data->getBuffer().getNumChannels() != audio_data_->getBuffer().getNumChannels() ||
+           processor_.getSampleRate() != sample_rate_.load())
+        {
+            failed_ = true;
+            return;
+        }
+
+        audio_data_ = audio_data;
+        reader_ = AudioData::BufferType::Reader(0);
+    }
+
+    auto const &buffer = audio_data_->getBuffer();
+
+    // 読み込み位置から順に一度に kBatchSeconds ずつ読み込み、溜まっているデータがなくなるまで繰り返す。
+    // 上書きされて読み込めなかったデータだけが失われ、 num_dropped_ に数えられる。
+    for( ; ; ) {
+        auto const result = buffer.read(reader_, read_buffer_.getArrayOfWritePointers(), 0, read_buffer_.getNumSamples());
+
+        if(result.num_dropped > 0) {
+            num_overruns_ += 1;
+            num_dropped_ += result.num_dropped;
+        }
+
+        if(result.num_read > 0) {
+            if(writeBlock((int)result.num_read) == false) {
+                failed_ = true;
+                break;
+            }
+
+            num_recorded_ += result.num_read;
+        }
+
+        if(result.num_pending == 0) { break; }
+    }
+}
+
+bool Recorder::writeBlock(int num_samples)
+{
+    auto const num_channels = read_buffer_.getNumChannels();
+
+    if(format_ == Format::kWav) {
+        return writer_ != nullptr
+            && writer_->writeFromFloatArrays(read_buffer_.getArrayOfReadPointers(), num_channels, num_samples);
+    }
+
+    if(raw_stream_ == nullptr) { return false; }
+
+    for(int ch = 0; ch < num_channels; ++ch) {
+        auto const *src = read_buffer_.getReadPointer(ch);
+        for(int i = 0; i < num_samples; ++i) {
+            interleaved_[(std::size_t)i * num_channels + ch] = src[i];
+        }
+    }
+
+    return raw_stream_->write(interleaved_.data(), sizeof(float) * (std::size_t)num_channels * num_samples);
+}
+
+void Recorder::close()
+{
+    // WAV のヘッダは writer_ を破棄したときに確定する。
+    writer_.reset();
+
+    if(raw_stream_ != nullptr) {
+        raw_stream_->flush();
+        raw_stream_.reset();
+    }
+
+    audio_data_.reset();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "PluginProcessor.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Processor が AudioData に書き込んだデータを、バックグラウンドのスレッドでファイルに書き出すクラス
+//
+// 書き込みスレッドは GUI スレッドとは別の Reader で AudioData のリングバッファを読み込み、
+// 一定の間隔で、前回の続きから溜まっているデータをすべて順にファイルに書き出す。
+// processBlock() は常にリングバッファへ書き込むだけなので、録音中もオーディオスレッドで
+// ファイルの入出力やメモリの確保、ロックは発生しない。
+// 書き込みが間に合わずにリングバッファで上書きされたデータは録音されず、そのサンプル数が記録される。
+//
+// 録音するチャンネルはリングバッファのチャンネルの並び (AudioData::getChannelName()) と同じになる。
+struct Recorder
+:   private juce::Thread
+{
+    //! ファイルの形式
+    enum class Format : int {
+        //! 32 bit float の WAV ファイル。 4 GB を超える場合は RF64 になる。
+        kWav = 1,
+        //! ヘッダを持たない、チャンネルをインターリーブした 32 bit float (ネイティブエンディアン) のファイル
+        kRawFloat,
+    };
+
+    //! 録音の状態
+    struct Status
+    {
+        bool recording = false;
+        //! ファイルへの書き込みに失敗したか、録音中にチャンネル構成やサンプルレートが変わったために録音を中断した
+        bool failed = false;
+        //! ファイルに書き込んだサンプル数
+        std::int64_t num_recorded = 0;
+        //! 書き込みが間に合わずに失われたデータの回数とサンプル数
+        std::int64_t num_overruns = 0;
+        std::int64_t num_dropped = 0;
+        double sample_rate = 0;
+    };
+
+    //! コンストラクタ
+    /*! @param processor 録音するデータを書き込む Processor 。
+     *  書き込みスレッドから getAudioData() と getSampleRate() を呼び出す。
+     */
+    explicit
+    Recorder(AudioPluginAudioProcessor &processor);
+    ~Recorder() override;
+
+    //! ファイルの拡張子から形式を決める。 .wav 以外は kRawFloat になる。
+    static Format getFormatForFile(juce::File const &file);
+
+    //! file へ録音を開始する。
+    /*! 録音中の場合は、現在の録音を終了してから開始する。
+     *  録音は呼び出した時点以降に書き込まれたデータから始まる。
+     *  @return ファイルを作成できなかった場合や、 Processor の準備ができていない場合は false
+     */
+    bool start(juce::File const &file, Format format);
+
+    //! 録音を終了して、ファイルを閉じる。
+    void stop();
+
+    bool isRecording() const { return recording_.load(); }
+
+    //! 録音の状態を返す。任意のスレッドから呼び出せる。
+    Status getStatus() const;
+
+private:
+    //! 一度に読み込む最大の長さ [秒]
+    static constexpr double kBatchSeconds = 0.25;
+    //! 書き込みの間隔 [ms]
+    static constexpr int kIntervalMs = 50;
+
+    AudioPluginAudioProcessor &processor_;
+
+    // start() と stop() が並行して呼び出されないようにする。
+    std::mutex control_mutex_;
+
+    std::atomic<bool> recording_ { false };
+    std::atomic<bool> failed_ { false };
+    std::atomic<std::int64_t> num_recorded_ { 0 };
+    std::atomic<std::int64_t> num_overruns_ { 0 };
+    std::atomic<std::int64_t> num_dropped_ { 0 };
+    std::atomic<double> sample_rate_ { 0 };
+
+    // 以下は録音中は書き込みスレッドからのみアクセスする。
+    std::shared_ptr<AudioData const> audio_data_;
+    AudioData::BufferType::Reader reader_;
+    Format format_ = Format::kWav;
+    std::unique_ptr<juce::AudioFormatWriter> writer_;
+    std::unique_ptr<juce::OutputStream> raw_stream_;
+    juce::AudioSampleBuffer read_buffer_;
+    std::vector<float> interleaved_;
+
+    void run() override;
+    //! リングバッファに溜まっているデータをすべて書き出す。
+    void drain();
+    bool writeBlock(int num_samples);
+    void close();
+};
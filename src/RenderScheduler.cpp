@@ -0,0 +1,149 @@
+#include "RenderScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+//! 負荷の移動平均の係数
+constexpr double kLoadSmoothing = 0.1;
+
+//! フレームレートを調整する間隔 [秒]
+constexpr double kAdjustInterval = 0.5;
+
+//! 1 回の調整で変更するフレームレートの比率の範囲
+constexpr double kMinAdjustRatio = 0.5;
+constexpr double kMaxAdjustRatio = 1.25;
+
+//! 負荷が予算のこの割合を下回っている場合だけ、フレームレートを上げる。
+constexpr double kIncreaseThreshold = 0.7;
+
+double toSeconds(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+} // namespace
+
+RenderScheduler::ScopedPaintTimer::ScopedPaintTimer(RenderScheduler &scheduler)
+:   scheduler_(scheduler)
+,   begin_(Clock::now())
+{}
+
+RenderScheduler::ScopedPaintTimer::~ScopedPaintTimer()
+{
+    scheduler_.paint_seconds_ += toSeconds(Clock::now() - begin_);
+}
+
+RenderScheduler::RenderScheduler()
+{
+    last_tick_ = last_adjust_ = Clock::now();
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    stopTimer();
+}
+
+void RenderScheduler::addClient(Client *client)
+{
+    if(std::find(clients_.begin(), clients_.end(), client) != clients_.end()) { return; }
+
+    clients_.push_back(client);
+    if(isTimerRunning() == false) {
+        last_tick_ = last_adjust_ = Clock::now();
+        paint_seconds_ = 0;
+        restartTimer();
+    }
+}
+
+void RenderScheduler::removeClient(Client *client)
+{
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), client), clients_.end());
+    if(clients_.empty()) {
+        stopTimer();
+    }
+}
+
+void RenderScheduler::setMaxFps(double fps)
+{
+    max_fps_ = juce::jlimit(kMinFps, kMaxFps, fps);
+    current_fps_ = std::min(current_fps_, max_fps_);
+    if(isTimerRunning()) { restartTimer(); }
+}
+
+void RenderScheduler::setCpuBudget(double fraction)
+{
+    cpu_budget_ = juce::jlimit(0.01, 1.0, fraction);
+}
+
+RenderScheduler::Stats RenderScheduler::getStats() const
+{
+    Stats stats;
+    stats.num_clients = (int)clients_.size();
+    stats.num_rendered = num_rendered_;
+    stats.num_skipped = num_skipped_;
+    stats.fps = average_interval_ > 0 ? 1.0 / average_interval_ : 0.0;
+    stats.max_fps = max_fps_;
+    stats.load = load_;
+    stats.cpu_budget = cpu_budget_;
+    return stats;
+}
+
+void RenderScheduler::timerCallback()
+{
+    auto const begin = Clock::now();
+
+    num_rendered_ = 0;
+    num_skipped_ = 0;
+    for(auto *client : clients_) {
+        if(client->isRenderTargetVisible() && client->onRenderTick()) {
+            ++num_rendered_;
+        } else {
+            ++num_skipped_;
+        }
+    }
+
+    auto const now = Clock::now();
+
+    // 前回の更新から今回の更新までの間に、更新と描画に使用した時間の割合を負荷とする。
+    // 描画は repaint() の後に非同期で行われるので、前回の更新で要求した分が今回の間隔に含まれる。
+    auto const interval = toSeconds(begin - last_tick_);
+    if(interval > 0) {
+        auto const busy = toSeconds(now - begin) + paint_seconds_;
+        load_ += (std::min(busy / interval, 1.0) - load_) * kLoadSmoothing;
+        average_interval_ += (interval - average_interval_) * kLoadSmoothing;
+    }
+
+    last_tick_ = begin;
+    paint_seconds_ = 0;
+
+    adjustFrameRate(now);
+}
+
+void RenderScheduler::adjustFrameRate(Clock::time_point now)
+{
+    if(toSeconds(now - last_adjust_) < kAdjustInterval) { return; }
+    last_adjust_ = now;
+
+    // 負荷はフレームレートにほぼ比例するので、予算に収まるフレームレートを見積もる。
+    // 急に変化しないように、 1 回の調整での変化の比率を制限する。
+    double fps = current_fps_;
+    if(load_ > cpu_budget_) {
+        fps *= std::max(cpu_budget_ / load_, kMinAdjustRatio);
+    } else if(load_ < cpu_budget_ * kIncreaseThreshold) {
+        fps *= load_ > 0 ? std::min(cpu_budget_ * kIncreaseThreshold / load_, kMaxAdjustRatio) : kMaxAdjustRatio;
+    }
+
+    fps = juce::jlimit(kMinFps, max_fps_, fps);
+    if(std::abs(fps - current_fps_) < 1.0) { return; }
+
+    current_fps_ = fps;
+    restartTimer();
+}
+
+void RenderScheduler::restartTimer()
+{
+    startTimer(std::max(1, (int)std::lround(1000.0 / current_fps_)));
+}
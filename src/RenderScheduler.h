@@ -0,0 +1,110 @@
+#pragma once
+
+#include <juce_events/juce_events.h>
+
+#include <chrono>
+#include <vector>
+
+// プロセス内のすべてのエディタの表示の更新を、一つのタイマーにまとめて行うクラス
+//
+// エディタごとにタイマーを動かすと、多数のインスタンスを開いた場合にメッセージスレッドの処理が追いつかなくなるため、
+// juce::SharedResourcePointer でプロセス内の一つのインスタンスを共有し、 1 回のタイマーで全エディタを順に更新する。
+// 表示されていないエディタは更新しない。新しいデータがないエディタは、更新しても再描画を要求しないようにする。
+//
+// 更新と描画にかかった時間の割合（負荷）を計測し、 CPU 予算を超えないように、上限の範囲でフレームレートを自動で調整する。
+// すべての関数はメッセージスレッドから呼び出す。
+struct RenderScheduler
+:   private juce::Timer
+{
+    //! フレームレートの範囲 [fps]
+    static constexpr double kMinFps = 5.0;
+    static constexpr double kMaxFps = 120.0;
+
+    //! 表示の更新を受け取るオブジェクト
+    struct Client
+    {
+        virtual ~Client() = default;
+
+        //! 表示されているかどうか。表示されていない場合、 onRenderTick() は呼び出されない。
+        virtual bool isRenderTargetVisible() const = 0;
+
+        //! 新しいデータを取り込み、表示が変わる場合は再描画を要求する。
+        /*! @return 再描画を要求した場合は true
+         */
+        virtual bool onRenderTick() = 0;
+    };
+
+    //! 現在の動作状況
+    struct Stats
+    {
+        //! 登録されているクライアントの数
+        int num_clients = 0;
+        //! 直前の更新で、再描画を要求したクライアントの数と、表示されていないかデータがないために再描画しなかったクライアントの数
+        int num_rendered = 0;
+        int num_skipped = 0;
+        //! 現在のフレームレートと、その上限 [fps]
+        double fps = 0;
+        double max_fps = 0;
+        //! メッセージスレッドの時間のうち、更新と描画に使用した割合の移動平均と、その予算 (0.0 .. 1.0)
+        double load = 0;
+        double cpu_budget = 0;
+    };
+
+    //! 描画にかかった時間を RenderScheduler の負荷として計上するクラス
+    /*! paint() の先頭で作成する。
+     */
+    struct ScopedPaintTimer
+    {
+        explicit ScopedPaintTimer(RenderScheduler &scheduler);
+        ~ScopedPaintTimer();
+
+        ScopedPaintTimer(ScopedPaintTimer const &) = delete;
+        ScopedPaintTimer & operator=(ScopedPaintTimer const &) = delete;
+
+    private:
+        RenderScheduler &scheduler_;
+        std::chrono::steady_clock::time_point begin_;
+    };
+
+    RenderScheduler();
+    ~RenderScheduler() override;
+
+    //! クライアントを登録・解除する。
+    /*! onRenderTick() の中から呼び出してはならない。
+     */
+    void addClient(Client *client);
+    void removeClient(Client *client);
+
+    //! フレームレートの上限を設定する。 [kMinFps, kMaxFps] の範囲に制限される。
+    void setMaxFps(double fps);
+    double getMaxFps() const { return max_fps_; }
+
+    //! 更新と描画に使用するメッセージスレッドの時間の割合の上限を設定する。 (0.0 .. 1.0]
+    void setCpuBudget(double fraction);
+    double getCpuBudget() const { return cpu_budget_; }
+
+    Stats getStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<Client *> clients_;
+    double max_fps_ = 60.0;
+    double cpu_budget_ = 0.25;
+    double current_fps_ = 60.0;
+
+    // 前回の更新の開始時刻と、それ以降に描画に使用した時間 [秒]
+    Clock::time_point last_tick_;
+    double paint_seconds_ = 0;
+    // 更新 1 回分の時間と負荷の移動平均
+    double average_interval_ = 0;
+    double load_ = 0;
+    // 最後にフレームレートを調整した時刻
+    Clock::time_point last_adjust_;
+    int num_rendered_ = 0;
+    int num_skipped_ = 0;
+
+    void timerCallback() override;
+    void adjustFrameRate(Clock::time_point now);
+    void restartTimer();
+};
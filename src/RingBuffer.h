@@ -2,29 +2,123 @@
 
 #include <cassert>
 #include <algorithm>
-#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "RingBufferStorage.h"
+#include "SimdKernels.h"
+
+//! RingBuffer のチャンネル数やサンプル数を、実行時に決めることを表す値
+constexpr std::int64_t kRingBufferDynamicExtent = -1;
+
+namespace RingBufferDetail
+{
+
+//! コンパイル時に決まっているチャンネル数やサンプル数
+template<std::int64_t N>
+struct Extent
+{
+    Extent(std::int64_t value = N) noexcept { assert(value == N); (void)value; }
+    static constexpr std::int64_t get() noexcept { return N; }
+};
+
+//! 実行時に決めるチャンネル数やサンプル数
+template<>
+struct Extent<kRingBufferDynamicExtent>
+{
+    Extent(std::int64_t value = 0) noexcept : value_(value) {}
+    std::int64_t get() const noexcept { return value_; }
+
+private:
+    std::int64_t value_;
+};
+
+} // namespace RingBufferDetail
 
 // リングバッファクラス
-template<class T>
+//
+// 全チャンネルのデータは RingBufferStorage によって一つの領域に確保される。
+// Layout::kMirrored を指定すると、末尾から先頭へまたがる範囲も連続した領域として扱えるようになり、
+// 書き込みと読み込みが一回のコピーで済むほか、 getView() が常に一つの連続した範囲を返すようになる。
+//
+// Channels と Capacity を指定すると、チャンネル数とサンプル数がコンパイル時に決まる。
+// チャンネルごとのループは展開され、 Capacity は 2 の累乗に限る代わりに、位置の折り返しがマスクだけで済む。
+// 省略した場合（ kRingBufferDynamicExtent ）は、コンストラクタの引数で実行時に決める。
+template<class T,
+         std::int64_t Channels = kRingBufferDynamicExtent,
+         std::int64_t Capacity = kRingBufferDynamicExtent>
 struct RingBuffer
 {
+    static_assert(std::is_trivially_copyable<T>::value, "RingBuffer requires a trivially copyable type");
+
+    //! チャンネル数がコンパイル時に決まっているかどうか
+    static constexpr bool kHasStaticChannels = (Channels != kRingBufferDynamicExtent);
+    //! サンプル数がコンパイル時に決まっているかどうか
+    static constexpr bool kHasStaticCapacity = (Capacity != kRingBufferDynamicExtent);
+
+    static_assert(kHasStaticChannels == false || Channels >= 0, "Channels must not be negative");
+    static_assert(kHasStaticCapacity == false || (Capacity > 0 && (Capacity & (Capacity - 1)) == 0),
+                  "Capacity must be a power of two");
+
+    //! 内部バッファの配置方法
+    enum class Layout {
+        //! 全チャンネルを一つの連続した領域に配置する。
+        kContiguous,
+        //! kContiguous に加えて、各チャンネルの直後に同じ領域を仮想的にマッピングする。
+        //! 対応していない環境では kContiguous として扱う。
+        kMirrored,
+    };
+
+    //! 内部バッファの連続した範囲
+    struct Span
+    {
+        T const *data = nullptr;
+        std::int64_t size = 0;
+    };
+
+    //! getView() の結果
+    /*! 指定した範囲がリングバッファの末尾から先頭へまたがる場合は、 first と second の二つに分かれる。
+     */
+    struct View
+    {
+        Span first;
+        Span second;
+
+        bool isContiguous() const noexcept { return second.size == 0; }
+        std::int64_t size() const noexcept { return first.size + second.size; }
+    };
+
     //! 空のリングバッファを構築する
+    /*! チャンネル数とサンプル数がどちらもコンパイル時に決まっている場合は、 Layout::kContiguous のバッファを構築する。
+     */
     RingBuffer()
-    {}
+    {
+        if constexpr(kHasStaticChannels && kHasStaticCapacity) {
+            allocate(Channels, Capacity, Layout::kContiguous);
+        }
+    }
+
+    //! チャンネル数とサンプル数がどちらもコンパイル時に決まっている場合のコンストラクタ
+    /*! Layout::kMirrored を指定しても、 Capacity がミラーリングに必要な単位の倍数でない場合はミラーリングしない。
+     */
+    template<bool IsStatic = kHasStaticChannels && kHasStaticCapacity, std::enable_if_t<IsStatic, int> = 0>
+    explicit
+    RingBuffer(Layout layout)
+    {
+        allocate(Channels, Capacity, layout);
+    }
 
     //! コンストラクタ
     //! 指定したチャンネル数とサンプル数のバッファを構築する。
-    /*! @pre num_channels >= 0 && num_samples >= 0
+    /*! Layout::kMirrored を指定した場合、サンプル数はミラーリングに必要な単位に切り上げられる。
+     *  実際のサンプル数は getNumSamples() で取得する。
+     *  @pre num_channels >= 0 && num_samples >= 0
+     *  @pre チャンネル数とサンプル数がコンパイル時に決まっている場合は、それぞれ Channels と Capacity に等しいこと。
      */
-    RingBuffer(std::int64_t num_channels, std::int64_t num_samples)
+    RingBuffer(std::int64_t num_channels, std::int64_t num_samples, Layout layout = Layout::kContiguous)
     {
-        buffer_.resize(num_channels);
-        for(auto &&ch_data: buffer_) {
-            ch_data.resize(num_samples);
-        }
-
-        num_channels_ = num_channels;
-        num_samples_ = num_samples;
+        allocate(num_channels, num_samples, layout);
     }
 
     //! samples のデータを内部バッファに書き込む。
@@ -37,25 +131,34 @@ struct RingBuffer
      */
     void write(T const * const * src, std::int64_t src_start_sample, std::int64_t length)
     {
-        if(length == 0 || num_samples_ == 0) { return; }
-        assert(length <= num_samples_);
+        auto const num_samples = getNumSamples();
+        if(length == 0 || num_samples == 0) { return; }
+        assert(length <= num_samples);
 
         // write_pos_ から書き込むサイズ
-        int const num_copy1 = std::min<int>(write_pos_ + length, num_samples_) - write_pos_;
+        // ミラーリングしている場合は、末尾を超える分もそのまま書き込めばよい。
+        std::int64_t const num_copy1 = storage_.isMirrored()
+        ? length
+        : std::min<std::int64_t>(write_pos_ + length, num_samples) - write_pos_;
 
         // 先頭から書き込むサイズ
-        int const num_copy2 = length - num_copy1;
+        std::int64_t const num_copy2 = length - num_copy1;
 
-        for(int ch = 0, end = num_channels_; ch < end; ++ch) {
+        forEachChannel([&](std::int64_t ch) {
             auto const  *ch_src    = src[ch];
-            auto        *ch_dest   = buffer_[ch].data();
+            auto        *ch_dest   = getChannelData(ch);
 
-            std::copy_n(ch_src + src_start_sample,              num_copy1, ch_dest + write_pos_);
-            std::copy_n(ch_src + src_start_sample + num_copy1,  num_copy2, ch_dest             );
+            copySamples(ch_src + src_start_sample,              num_copy1, ch_dest + write_pos_);
+            copySamples(ch_src + src_start_sample + num_copy1,  num_copy2, ch_dest             );
+        });
+
+        if constexpr(kHasStaticCapacity) {
+            write_pos_ = (write_pos_ + length) & (Capacity - 1);
+        } else {
+            write_pos_ += length;
+            if(write_pos_ >= num_samples) { write_pos_ -= num_samples; }
         }
 
-        write_pos_ += length;
-        if(write_pos_ >= num_samples_) { write_pos_ -= num_samples_; }
         num_written_ += length;
     }
 
@@ -65,35 +168,161 @@ struct RingBuffer
      */
     void read(T **dest, std::int64_t dest_start_index, std::int64_t length) const
     {
-        if(length == 0 || num_samples_ == 0) { return; }
+        if(length == 0 || getNumSamples() == 0) { return; }
+
+        assert(length <= getNumSamples());
 
-        assert(length <= num_samples_);
+        forEachChannel([&](std::int64_t ch) {
+            auto const view = getLatestView(ch, length);
+            auto *ch_dest = dest[ch] + dest_start_index;
+            copySamples(view.first.data,    view.first.size,    ch_dest                     );
+            copySamples(view.second.data,   view.second.size,   ch_dest + view.first.size   );
+        });
+    }
 
-        // 末尾からコピーする量
-        int const num_copy1
-        = write_pos_ >= length
-        ? 0
-        : length - write_pos_;
+    //! 書き込み開始からの通算のサンプル位置 position から length サンプル分のデータを dest に読み込む。
+    /*! 書き込み位置を参照しないため、 write() を行うスレッドとは別のスレッドから呼び出せる。
+     *  ただし、読み込み中に該当領域が上書きされていないかどうかの確認は呼び出し側で行う必要がある。
+     *  @pre dest に対して、各チャンネルで [dest_start_index, dest_start_index + length) の範囲の書き込みが可能であること。
+     *  @pre position >= 0
+     *  @pre length <= getNumSamples()
+     */
+    void readAt(T **dest, std::int64_t dest_start_index, std::int64_t position, std::int64_t length) const
+    {
+        if(length == 0 || getNumSamples() == 0) { return; }
 
-        // write_pos_ からさかのぼってコピーする量
-        int const num_copy2 = length - num_copy1;
+        assert(position >= 0);
+        assert(length <= getNumSamples());
 
-        for(int ch = 0, end = num_channels_; ch < end; ++ch) {
-            auto const  *ch_src    = buffer_[ch].data();
-            auto        *ch_dest   = dest[ch];
-            std::copy_n(ch_src + (num_samples_ - num_copy1),   num_copy1, ch_dest + dest_start_index               );
-            std::copy_n(ch_src + (write_pos_ - num_copy2),     num_copy2, ch_dest + dest_start_index + num_copy1   );
-        }
+        forEachChannel([&](std::int64_t ch) {
+            auto const view = getView(ch, position, length);
+            auto *ch_dest = dest[ch] + dest_start_index;
+            copySamples(view.first.data,    view.first.size,    ch_dest                     );
+            copySamples(view.second.data,   view.second.size,   ch_dest + view.first.size   );
+        });
     }
 
-    std::int64_t getNumChannels() const noexcept { return num_channels_; }
-    std::int64_t getNumSamples() const noexcept { return num_samples_; }
-    int getNumWritten() const noexcept { return num_written_; }
+    //! 書き込み開始からの通算のサンプル位置 position から length サンプル分のデータを、コピーせずに参照する。
+    /*! readAt() と同様に write() を行うスレッドとは別のスレッドから呼び出せるが、
+     *  参照している間に該当領域が上書きされていないかどうかの確認は呼び出し側で行う必要がある。
+     *  @pre 0 <= channel < getNumChannels()
+     *  @pre position >= 0
+     *  @pre length <= getNumSamples()
+     */
+    View getView(std::int64_t channel, std::int64_t position, std::int64_t length) const
+    {
+        View view;
+        auto const num_samples = getNumSamples();
+        if(length == 0 || num_samples == 0) { return view; }
+
+        assert(position >= 0);
+        assert(length <= num_samples);
+
+        auto const *ch_src = getChannelData(channel);
+        auto const read_pos = wrap(position);
+
+        // read_pos から参照するサイズ
+        view.first.data = ch_src + read_pos;
+        view.first.size = storage_.isMirrored()
+        ? length
+        : std::min<std::int64_t>(read_pos + length, num_samples) - read_pos;
+
+        // 先頭から参照するサイズ
+        view.second.data = ch_src;
+        view.second.size = length - view.first.size;
+
+        return view;
+    }
+
+    //! 最後に書き込んだ length サンプル分のデータを、コピーせずに参照する。
+    /*! @pre length <= getNumSamples()
+     */
+    View getLatestView(std::int64_t channel, std::int64_t length) const
+    {
+        // 書き込み位置の直前までを参照するように、容量の倍数だけずらして負にならないようにする。
+        return getView(channel, write_pos_ + getNumSamples() - length, length);
+    }
+
+    std::int64_t getNumChannels() const noexcept { return num_channels_.get(); }
+    std::int64_t getNumSamples() const noexcept { return num_samples_.get(); }
+    std::int64_t getNumWritten() const noexcept { return num_written_; }
+
+    //! 内部バッファがミラーリングされているかどうか
+    bool isMirrored() const noexcept { return storage_.isMirrored(); }
 
 private:
-    std::int64_t num_channels_ = 0;
-    std::int64_t num_samples_ = 0;
+    void allocate(std::int64_t num_channels, std::int64_t num_samples, Layout layout)
+    {
+        auto const granularity = (std::int64_t)(RingBufferStorage::getMirrorGranularity() / sizeof(T));
+        bool mirrored = (layout == Layout::kMirrored && granularity > 0
+                         && RingBufferStorage::getMirrorGranularity() % sizeof(T) == 0);
+
+        // サンプル数がコンパイル時に決まっている場合は切り上げられないので、単位の倍数のときだけミラーリングする。
+        if constexpr(kHasStaticCapacity) {
+            mirrored = mirrored && num_samples % granularity == 0;
+        } else if(mirrored) {
+            num_samples = (num_samples + granularity - 1) / granularity * granularity;
+        }
+
+        storage_ = RingBufferStorage(num_channels, (std::size_t)num_samples * sizeof(T), mirrored);
+        num_channels_ = ChannelExtent(num_channels);
+        num_samples_ = CapacityExtent(num_samples);
+    }
+
+    T * getChannelData(std::int64_t channel) const noexcept
+    {
+        return static_cast<T *>(storage_.getChannel(channel));
+    }
+
+    //! 通算のサンプル位置を、内部バッファ上の位置に折り返す。
+    std::int64_t wrap(std::int64_t position) const noexcept
+    {
+        if constexpr(kHasStaticCapacity) {
+            return position & (Capacity - 1);
+        } else {
+            return position % num_samples_.get();
+        }
+    }
+
+    //! 各チャンネルについて f(channel) を呼び出す。チャンネル数がコンパイル時に決まっている場合は展開する。
+    template<class F>
+    void forEachChannel(F &&f) const
+    {
+        if constexpr(kHasStaticChannels) {
+            forEachChannelUnrolled(f, std::make_integer_sequence<std::int64_t, kHasStaticChannels ? Channels : 0> {});
+        } else {
+            for(std::int64_t ch = 0, end = num_channels_.get(); ch < end; ++ch) {
+                f(ch);
+            }
+        }
+    }
+
+    template<class F, std::int64_t... Indices>
+    static void forEachChannelUnrolled(F &f, std::integer_sequence<std::int64_t, Indices...>)
+    {
+        (f(Indices), ...);
+    }
+
+    //! サンプル列をコピーする。
+    static void copySamples(T const *src, std::int64_t length, T *dest);
+
+    using ChannelExtent = RingBufferDetail::Extent<Channels>;
+    using CapacityExtent = RingBufferDetail::Extent<Capacity>;
+
+    ChannelExtent num_channels_;
+    CapacityExtent num_samples_;
     std::int64_t write_pos_ = 0;
     std::int64_t num_written_ = 0;
-    std::vector<std::vector<T>> buffer_;
+    RingBufferStorage storage_;
 };
+
+//! float のサンプル列は SIMD 命令を使用してコピーする。
+template<class T, std::int64_t Channels, std::int64_t Capacity>
+void RingBuffer<T, Channels, Capacity>::copySamples(T const *src, std::int64_t length, T *dest)
+{
+    if constexpr(std::is_same<T, float>::value) {
+        SimdKernels::copy(dest, src, length);
+    } else {
+        std::copy_n(src, length, dest);
+    }
+}
@@ -0,0 +1,172 @@
+#include "RingBufferStorage.h"
+
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <atomic>
+#include <cstdio>
+#endif
+#else
+#define SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE 0
+#endif
+
+namespace
+{
+
+std::size_t roundUp(std::size_t value, std::size_t unit)
+{
+    return (value + unit - 1) / unit * unit;
+}
+
+#if SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE
+//! 名前を持たない共有メモリのファイルディスクリプタを作成する。失敗した場合は -1
+int createAnonymousSharedMemory()
+{
+#if defined(__linux__)
+    return memfd_create("SimpleOscilloscopeRingBuffer", MFD_CLOEXEC);
+#else
+    static std::atomic<int> counter { 0 };
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "/SimpleOscilloscope.%d.%d", (int)getpid(), counter.fetch_add(1));
+
+    auto const fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd >= 0) { shm_unlink(name); }
+    return fd;
+#endif
+}
+#endif
+
+} // namespace
+
+RingBufferStorage::RingBufferStorage(std::int64_t num_channels, std::size_t channel_bytes, bool mirrored)
+{
+    assert(num_channels >= 0);
+    if(num_channels == 0 || channel_bytes == 0) { return; }
+
+    if(mirrored && allocateMirrored(num_channels, channel_bytes)) { return; }
+
+    allocateContiguous(num_channels, channel_bytes);
+}
+
+RingBufferStorage::~RingBufferStorage()
+{
+    release();
+}
+
+RingBufferStorage::RingBufferStorage(RingBufferStorage &&rhs) noexcept
+:   data_(std::exchange(rhs.data_, nullptr))
+,   total_bytes_(std::exchange(rhs.total_bytes_, 0))
+,   channel_stride_(std::exchange(rhs.channel_stride_, 0))
+,   mirrored_(std::exchange(rhs.mirrored_, false))
+{}
+
+RingBufferStorage & RingBufferStorage::operator=(RingBufferStorage &&rhs) noexcept
+{
+    if(this != &rhs) {
+        release();
+        data_ = std::exchange(rhs.data_, nullptr);
+        total_bytes_ = std::exchange(rhs.total_bytes_, 0);
+        channel_stride_ = std::exchange(rhs.channel_stride_, 0);
+        mirrored_ = std::exchange(rhs.mirrored_, false);
+    }
+
+    return *this;
+}
+
+std::size_t RingBufferStorage::getMirrorGranularity()
+{
+#if SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE
+    static std::size_t const page_size = (std::size_t)sysconf(_SC_PAGESIZE);
+    return page_size;
+#else
+    return 0;
+#endif
+}
+
+bool RingBufferStorage::allocateMirrored(std::int64_t num_channels, std::size_t channel_bytes)
+{
+#if SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE
+    auto const granularity = getMirrorGranularity();
+    if(granularity == 0 || channel_bytes % granularity != 0) { return false; }
+
+    auto const fd = createAnonymousSharedMemory();
+    if(fd < 0) { return false; }
+
+    auto const file_bytes = channel_bytes * (std::size_t)num_channels;
+    auto const total_bytes = file_bytes * 2;
+
+    // 全チャンネルのミラーを含む領域を予約してから、各チャンネルの実体を二回ずつマッピングする。
+    void *reserved = MAP_FAILED;
+    if(ftruncate(fd, (off_t)file_bytes) == 0) {
+        reserved = mmap(nullptr, total_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    bool ok = (reserved != MAP_FAILED);
+    for(std::int64_t ch = 0; ok && ch < num_channels; ++ch) {
+        auto *channel = (unsigned char *)reserved + channel_bytes * 2 * ch;
+        auto const offset = (off_t)(channel_bytes * ch);
+
+        for(auto *view: { channel, channel + channel_bytes }) {
+            if(mmap(view, channel_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) != view) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // マッピングが残っていれば、ファイルディスクリプタを閉じても共有メモリは解放されない。
+    close(fd);
+
+    if(ok == false) {
+        if(reserved != MAP_FAILED) { munmap(reserved, total_bytes); }
+        return false;
+    }
+
+    data_ = (unsigned char *)reserved;
+    total_bytes_ = total_bytes;
+    channel_stride_ = channel_bytes * 2;
+    mirrored_ = true;
+    return true;
+#else
+    (void)num_channels;
+    (void)channel_bytes;
+    return false;
+#endif
+}
+
+void RingBufferStorage::allocateContiguous(std::int64_t num_channels, std::size_t channel_bytes)
+{
+    channel_stride_ = roundUp(channel_bytes, kAlignment);
+    total_bytes_ = channel_stride_ * (std::size_t)num_channels;
+    data_ = (unsigned char *)::operator new(total_bytes_, std::align_val_t(kAlignment));
+    std::memset(data_, 0, total_bytes_);
+    mirrored_ = false;
+}
+
+void RingBufferStorage::release() noexcept
+{
+    if(data_ == nullptr) { return; }
+
+#if SIMPLE_OSCILLOSCOPE_HAS_MIRRORED_STORAGE
+    if(mirrored_) {
+        munmap(data_, total_bytes_);
+    } else
+#endif
+    {
+        ::operator delete(data_, std::align_val_t(kAlignment));
+    }
+
+    data_ = nullptr;
+    total_bytes_ = 0;
+    channel_stride_ = 0;
+    mirrored_ = false;
+}
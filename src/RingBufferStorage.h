@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// RingBuffer の全チャンネル分のデータを、一つの連続した領域に確保するクラス
+//
+// 各チャンネルの先頭はキャッシュラインの境界に揃えて配置される。
+// ミラーリングを有効にすると、各チャンネルの領域の直後に同じ物理メモリを仮想的にもう一度マッピングする。
+// これにより、リングバッファの末尾から先頭へまたがる範囲も、一つの連続した領域としてアクセスできる。
+// ミラーリングに対応していない環境や、マッピングに失敗した場合は、ミラーリングなしの領域を確保する。
+struct RingBufferStorage
+{
+    //! 各チャンネルの先頭のアライメント（バイト）
+    static constexpr std::size_t kAlignment = 64;
+
+    //! 空の領域を構築する
+    RingBufferStorage()
+    {}
+
+    //! コンストラクタ
+    /*! @param num_channels チャンネル数
+     *  @param channel_bytes 一つのチャンネルのサイズ（バイト）。
+     *  ミラーリングを使用する場合は getMirrorGranularity() の倍数であること。
+     *  @param mirrored ミラーリングを使用するかどうか
+     *  @pre num_channels >= 0 && channel_bytes >= 0
+     */
+    RingBufferStorage(std::int64_t num_channels, std::size_t channel_bytes, bool mirrored);
+
+    ~RingBufferStorage();
+
+    RingBufferStorage(RingBufferStorage &&rhs) noexcept;
+    RingBufferStorage & operator=(RingBufferStorage &&rhs) noexcept;
+
+    RingBufferStorage(RingBufferStorage const &) = delete;
+    RingBufferStorage & operator=(RingBufferStorage const &) = delete;
+
+    //! 指定したチャンネルの領域の先頭を返す。
+    /*! ミラーリングを使用している場合は、この位置から channel_bytes * 2 バイトの範囲にアクセスできる。
+     */
+    void * getChannel(std::int64_t channel) const noexcept
+    {
+        return data_ + channel * channel_stride_;
+    }
+
+    //! ミラーリングを使用しているかどうか
+    bool isMirrored() const noexcept { return mirrored_; }
+
+    //! ミラーリングを使用する場合の、一つのチャンネルのサイズの単位（バイト）
+    /*! ミラーリングに対応していない環境では 0 を返す。
+     */
+    static std::size_t getMirrorGranularity();
+
+private:
+    unsigned char *data_ = nullptr;
+    // 確保した領域全体のサイズ
+    std::size_t total_bytes_ = 0;
+    // チャンネルの先頭同士の間隔
+    std::size_t channel_stride_ = 0;
+    bool mirrored_ = false;
+
+    bool allocateMirrored(std::int64_t num_channels, std::size_t channel_bytes);
+    void allocateContiguous(std::int64_t num_channels, std::size_t channel_bytes);
+    void release() noexcept;
+};
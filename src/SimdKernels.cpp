@@ -0,0 +1,598 @@
+#include "SimdKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SIMPLE_OSCILLOSCOPE_HAS_X86 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER) && ! defined(__clang__)
+    #include <intrin.h>
+    #define SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+  #else
+    #define SIMPLE_OSCILLOSCOPE_TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define SIMPLE_OSCILLOSCOPE_HAS_NEON 1
+  #include <arm_neon.h>
+  // 倍精度の演算は AArch64 の NEON でだけ使用できる。
+  #if defined(__aarch64__) || defined(_M_ARM64)
+    #define SIMPLE_OSCILLOSCOPE_HAS_NEON_F64 1
+  #endif
+#endif
+
+namespace SimdKernels
+{
+
+namespace
+{
+
+//==============================================================================
+// スカラー実装
+//
+// 各 SIMD 実装の端数の処理にも使用する。 SIMD 実装と結果を一致させるため、比較の向きを揃えている。
+
+void clampScalar(float *data, std::int64_t length, float lo, float hi)
+{
+    for(std::int64_t i = 0; i < length; ++i) {
+        auto const x = data[i];
+        auto const v = (x > lo) ? x : lo;
+        data[i] = (v < hi) ? v : hi;
+    }
+}
+
+void copyScalar(float *dest, float const *src, std::int64_t length)
+{
+    if(length > 0) {
+        std::memcpy(dest, src, sizeof(float) * length);
+    }
+}
+
+void copyWithMinMaxScalarImpl(float *dest, float const *src, std::int64_t length, float &mn, float &mx)
+{
+    for(std::int64_t i = 0; i < length; ++i) {
+        auto const x = src[i];
+        dest[i] = x;
+        mn = (x < mn) ? x : mn;
+        mx = (x > mx) ? x : mx;
+    }
+}
+
+MinMax toMinMax(float mn, float mx)
+{
+    // すべて NaN だった場合は、空の範囲として扱う。
+    if(mn > mx) { return MinMax {}; }
+    return MinMax { mn, mx };
+}
+
+MinMax copyWithMinMaxScalar(float *dest, float const *src, std::int64_t length)
+{
+    float mn = std::numeric_limits<float>::infinity();
+    float mx = -std::numeric_limits<float>::infinity();
+    copyWithMinMaxScalarImpl(dest, src, length, mn, mx);
+    return toMinMax(mn, mx);
+}
+
+void clampDoubleScalar(double *data, std::int64_t length, double lo, double hi)
+{
+    for(std::int64_t i = 0; i < length; ++i) {
+        auto const x = data[i];
+        auto const v = (x > lo) ? x : lo;
+        data[i] = (v < hi) ? v : hi;
+    }
+}
+
+void convertScalar(float *dest, double const *src, std::int64_t length)
+{
+    for(std::int64_t i = 0; i < length; ++i) {
+        dest[i] = (float)src[i];
+    }
+}
+
+#if SIMPLE_OSCILLOSCOPE_HAS_X86
+//==============================================================================
+// SSE2 実装
+
+void clampSSE2(float *data, std::int64_t length, float lo, float hi)
+{
+    auto const vlo = _mm_set1_ps(lo);
+    auto const vhi = _mm_set1_ps(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto x = _mm_loadu_ps(data + i);
+        // _mm_max_ps(a, b) は (a > b) ? a : b を、 _mm_min_ps(a, b) は (a < b) ? a : b を返す。
+        x = _mm_min_ps(_mm_max_ps(x, vlo), vhi);
+        _mm_storeu_ps(data + i, x);
+    }
+
+    clampScalar(data + i, length - i, lo, hi);
+}
+
+void copySSE2(float *dest, float const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 8 <= length; i += 8) {
+        _mm_storeu_ps(dest + i,     _mm_loadu_ps(src + i));
+        _mm_storeu_ps(dest + i + 4, _mm_loadu_ps(src + i + 4));
+    }
+
+    copyScalar(dest + i, src + i, length - i);
+}
+
+MinMax copyWithMinMaxSSE2(float *dest, float const *src, std::int64_t length)
+{
+    auto vmn = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    auto vmx = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto const x = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(dest + i, x);
+        vmn = _mm_min_ps(x, vmn);
+        vmx = _mm_max_ps(x, vmx);
+    }
+
+    alignas(16) float mns[4];
+    alignas(16) float mxs[4];
+    _mm_store_ps(mns, vmn);
+    _mm_store_ps(mxs, vmx);
+
+    float mn = mns[0];
+    float mx = mxs[0];
+    for(int k = 1; k < 4; ++k) {
+        mn = (mns[k] < mn) ? mns[k] : mn;
+        mx = (mxs[k] > mx) ? mxs[k] : mx;
+    }
+
+    copyWithMinMaxScalarImpl(dest + i, src + i, length - i, mn, mx);
+    return toMinMax(mn, mx);
+}
+
+void clampDoubleSSE2(double *data, std::int64_t length, double lo, double hi)
+{
+    auto const vlo = _mm_set1_pd(lo);
+    auto const vhi = _mm_set1_pd(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 2 <= length; i += 2) {
+        auto x = _mm_loadu_pd(data + i);
+        x = _mm_min_pd(_mm_max_pd(x, vlo), vhi);
+        _mm_storeu_pd(data + i, x);
+    }
+
+    clampDoubleScalar(data + i, length - i, lo, hi);
+}
+
+void convertSSE2(float *dest, double const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        // _mm_cvtpd_ps は変換した 2 サンプルを下位に置くので、 2 回分を一つのレジスタにまとめる。
+        auto const a = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+        auto const b = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+        _mm_storeu_ps(dest + i, _mm_movelh_ps(a, b));
+    }
+
+    convertScalar(dest + i, src + i, length - i);
+}
+
+//==============================================================================
+// AVX2 実装
+
+SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+void clampAVX2(float *data, std::int64_t length, float lo, float hi)
+{
+    auto const vlo = _mm256_set1_ps(lo);
+    auto const vhi = _mm256_set1_ps(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 8 <= length; i += 8) {
+        auto x = _mm256_loadu_ps(data + i);
+        x = _mm256_min_ps(_mm256_max_ps(x, vlo), vhi);
+        _mm256_storeu_ps(data + i, x);
+    }
+
+    clampScalar(data + i, length - i, lo, hi);
+}
+
+SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+void copyAVX2(float *dest, float const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 16 <= length; i += 16) {
+        _mm256_storeu_ps(dest + i,     _mm256_loadu_ps(src + i));
+        _mm256_storeu_ps(dest + i + 8, _mm256_loadu_ps(src + i + 8));
+    }
+
+    copyScalar(dest + i, src + i, length - i);
+}
+
+SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+MinMax copyWithMinMaxAVX2(float *dest, float const *src, std::int64_t length)
+{
+    auto vmn = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    auto vmx = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+    std::int64_t i = 0;
+    for( ; i + 8 <= length; i += 8) {
+        auto const x = _mm256_loadu_ps(src + i);
+        _mm256_storeu_ps(dest + i, x);
+        vmn = _mm256_min_ps(x, vmn);
+        vmx = _mm256_max_ps(x, vmx);
+    }
+
+    alignas(32) float mns[8];
+    alignas(32) float mxs[8];
+    _mm256_store_ps(mns, vmn);
+    _mm256_store_ps(mxs, vmx);
+
+    float mn = mns[0];
+    float mx = mxs[0];
+    for(int k = 1; k < 8; ++k) {
+        mn = (mns[k] < mn) ? mns[k] : mn;
+        mx = (mxs[k] > mx) ? mxs[k] : mx;
+    }
+
+    copyWithMinMaxScalarImpl(dest + i, src + i, length - i, mn, mx);
+    return toMinMax(mn, mx);
+}
+
+SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+void clampDoubleAVX2(double *data, std::int64_t length, double lo, double hi)
+{
+    auto const vlo = _mm256_set1_pd(lo);
+    auto const vhi = _mm256_set1_pd(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto x = _mm256_loadu_pd(data + i);
+        x = _mm256_min_pd(_mm256_max_pd(x, vlo), vhi);
+        _mm256_storeu_pd(data + i, x);
+    }
+
+    clampDoubleScalar(data + i, length - i, lo, hi);
+}
+
+SIMPLE_OSCILLOSCOPE_TARGET_AVX2
+void convertAVX2(float *dest, double const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 8 <= length; i += 8) {
+        _mm_storeu_ps(dest + i,     _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+        _mm_storeu_ps(dest + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)));
+    }
+
+    convertScalar(dest + i, src + i, length - i);
+}
+
+bool isAVX2Supported()
+{
+  #if defined(_MSC_VER) && ! defined(__clang__)
+    int info[4] = {};
+    __cpuid(info, 0);
+    if(info[0] < 7) { return false; }
+
+    __cpuid(info, 1);
+    bool const has_osxsave = (info[2] & (1 << 27)) != 0;
+    bool const has_avx = (info[2] & (1 << 28)) != 0;
+    if(has_osxsave == false || has_avx == false) { return false; }
+
+    // OS が YMM レジスタの退避に対応しているかを確認する。
+    if((_xgetbv(0) & 0x6) != 0x6) { return false; }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  #else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  #endif
+}
+#endif
+
+#if SIMPLE_OSCILLOSCOPE_HAS_NEON
+//==============================================================================
+// NEON 実装
+//
+// vmaxq_f32 / vminq_f32 は NaN の扱いが SSE と異なるので、比較と選択で実装する。
+
+void clampNEON(float *data, std::int64_t length, float lo, float hi)
+{
+    auto const vlo = vdupq_n_f32(lo);
+    auto const vhi = vdupq_n_f32(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto x = vld1q_f32(data + i);
+        x = vbslq_f32(vcgtq_f32(x, vlo), x, vlo);
+        x = vbslq_f32(vcltq_f32(x, vhi), x, vhi);
+        vst1q_f32(data + i, x);
+    }
+
+    clampScalar(data + i, length - i, lo, hi);
+}
+
+void copyNEON(float *dest, float const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 8 <= length; i += 8) {
+        vst1q_f32(dest + i,     vld1q_f32(src + i));
+        vst1q_f32(dest + i + 4, vld1q_f32(src + i + 4));
+    }
+
+    copyScalar(dest + i, src + i, length - i);
+}
+
+MinMax copyWithMinMaxNEON(float *dest, float const *src, std::int64_t length)
+{
+    auto vmn = vdupq_n_f32(std::numeric_limits<float>::infinity());
+    auto vmx = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto const x = vld1q_f32(src + i);
+        vst1q_f32(dest + i, x);
+        vmn = vbslq_f32(vcltq_f32(x, vmn), x, vmn);
+        vmx = vbslq_f32(vcgtq_f32(x, vmx), x, vmx);
+    }
+
+    float mns[4];
+    float mxs[4];
+    vst1q_f32(mns, vmn);
+    vst1q_f32(mxs, vmx);
+
+    float mn = mns[0];
+    float mx = mxs[0];
+    for(int k = 1; k < 4; ++k) {
+        mn = (mns[k] < mn) ? mns[k] : mn;
+        mx = (mxs[k] > mx) ? mxs[k] : mx;
+    }
+
+    copyWithMinMaxScalarImpl(dest + i, src + i, length - i, mn, mx);
+    return toMinMax(mn, mx);
+}
+
+#if SIMPLE_OSCILLOSCOPE_HAS_NEON_F64
+void clampDoubleNEON(double *data, std::int64_t length, double lo, double hi)
+{
+    auto const vlo = vdupq_n_f64(lo);
+    auto const vhi = vdupq_n_f64(hi);
+
+    std::int64_t i = 0;
+    for( ; i + 2 <= length; i += 2) {
+        auto x = vld1q_f64(data + i);
+        x = vbslq_f64(vcgtq_f64(x, vlo), x, vlo);
+        x = vbslq_f64(vcltq_f64(x, vhi), x, vhi);
+        vst1q_f64(data + i, x);
+    }
+
+    clampDoubleScalar(data + i, length - i, lo, hi);
+}
+
+void convertNEON(float *dest, double const *src, std::int64_t length)
+{
+    std::int64_t i = 0;
+    for( ; i + 4 <= length; i += 4) {
+        auto const a = vcvt_f32_f64(vld1q_f64(src + i));
+        vst1q_f32(dest + i, vcvt_high_f32_f64(a, vld1q_f64(src + i + 2)));
+    }
+
+    convertScalar(dest + i, src + i, length - i);
+}
+#else
+// 32 ビットの ARM では倍精度の処理にスカラー実装を使用する。
+void clampDoubleNEON(double *data, std::int64_t length, double lo, double hi) { clampDoubleScalar(data, length, lo, hi); }
+void convertNEON(float *dest, double const *src, std::int64_t length) { convertScalar(dest, src, length); }
+#endif
+#endif
+
+Functions const kScalarFunctions { clampScalar, copyScalar, copyWithMinMaxScalar, clampDoubleScalar, convertScalar };
+#if SIMPLE_OSCILLOSCOPE_HAS_X86
+Functions const kSSE2Functions { clampSSE2, copySSE2, copyWithMinMaxSSE2, clampDoubleSSE2, convertSSE2 };
+Functions const kAVX2Functions { clampAVX2, copyAVX2, copyWithMinMaxAVX2, clampDoubleAVX2, convertAVX2 };
+#endif
+#if SIMPLE_OSCILLOSCOPE_HAS_NEON
+Functions const kNEONFunctions { clampNEON, copyNEON, copyWithMinMaxNEON, clampDoubleNEON, convertNEON };
+#endif
+
+InstructionSet selectInstructionSet()
+{
+    InstructionSet selected = InstructionSet::kScalar;
+    for(auto is: { InstructionSet::kSSE2, InstructionSet::kAVX2, InstructionSet::kNEON }) {
+        if(isAvailable(is)) { selected = is; }
+    }
+
+    return selected;
+}
+
+struct Active
+{
+    InstructionSet is;
+    Functions const *functions;
+};
+
+Active const & getActive()
+{
+    static Active const active = [] {
+        auto const is = selectInstructionSet();
+        return Active { is, &getFunctions(is) };
+    }();
+
+    return active;
+}
+
+template<class T>
+bool isSameBits(T const *a, T const *b, std::int64_t length)
+{
+    return length == 0 || std::memcmp(a, b, sizeof(T) * length) == 0;
+}
+
+} // namespace
+
+//==============================================================================
+void clamp(float *data, std::int64_t length, float lo, float hi)
+{
+    getActive().functions->clamp(data, length, lo, hi);
+}
+
+void copy(float *dest, float const *src, std::int64_t length)
+{
+    getActive().functions->copy(dest, src, length);
+}
+
+MinMax copyWithMinMax(float *dest, float const *src, std::int64_t length)
+{
+    return getActive().functions->copyWithMinMax(dest, src, length);
+}
+
+void clamp(double *data, std::int64_t length, double lo, double hi)
+{
+    getActive().functions->clampDouble(data, length, lo, hi);
+}
+
+void convert(float *dest, double const *src, std::int64_t length)
+{
+    getActive().functions->convert(dest, src, length);
+}
+
+bool isAvailable(InstructionSet is)
+{
+    switch(is) {
+        case InstructionSet::kScalar:
+            return true;
+      #if SIMPLE_OSCILLOSCOPE_HAS_X86
+        case InstructionSet::kSSE2:
+            return true;
+        case InstructionSet::kAVX2: {
+            static bool const supported = isAVX2Supported();
+            return supported;
+        }
+      #endif
+      #if SIMPLE_OSCILLOSCOPE_HAS_NEON
+        case InstructionSet::kNEON:
+            return true;
+      #endif
+        default:
+            return false;
+    }
+}
+
+Functions const & getFunctions(InstructionSet is)
+{
+    assert(isAvailable(is));
+
+    switch(is) {
+      #if SIMPLE_OSCILLOSCOPE_HAS_X86
+        case InstructionSet::kSSE2: return kSSE2Functions;
+        case InstructionSet::kAVX2: return kAVX2Functions;
+      #endif
+      #if SIMPLE_OSCILLOSCOPE_HAS_NEON
+        case InstructionSet::kNEON: return kNEONFunctions;
+      #endif
+        default: return kScalarFunctions;
+    }
+}
+
+InstructionSet getActiveInstructionSet()
+{
+    return getActive().is;
+}
+
+bool verify(InstructionSet is)
+{
+    if(isAvailable(is) == false) { return false; }
+
+    // 端数の処理やアライメントの違いを含めて確認できるように、長さと開始位置をずらしながら比較する。
+    constexpr int kMaxLength = 131;
+    constexpr int kMaxOffset = 8;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-3.0f, 3.0f);
+
+    std::vector<float> src(kMaxLength + kMaxOffset);
+    for(auto &x: src) { x = dist(rng); }
+
+    // 特殊な値も含める。
+    float const specials[] = {
+        std::numeric_limits<float>::quiet_NaN(),
+        std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::denorm_min(),
+        -0.0f, 0.0f, 1.0f, -1.0f,
+    };
+
+    for(int i = 0; i < (int)(sizeof(specials) / sizeof(specials[0])); ++i) {
+        src[(i * 17 + 3) % src.size()] = specials[i];
+    }
+
+    // 倍精度の入力は、単精度で表せない値と範囲外の値も含める。
+    std::vector<double> src_double(src.size());
+    for(std::size_t i = 0; i < src.size(); ++i) {
+        src_double[i] = src[i] + src[(i + 1) % src.size()] * 1e-9;
+    }
+
+    src_double[5] = 1e300;
+    src_double[11] = -1e300;
+    src_double[23] = std::numeric_limits<double>::denorm_min();
+
+    auto const &scalar = getFunctions(InstructionSet::kScalar);
+
+    std::vector<float> expected(src.size());
+    std::vector<float> actual(src.size());
+    std::vector<double> expected_double(src.size());
+    std::vector<double> actual_double(src.size());
+
+    auto const &funcs = getFunctions(is);
+
+    for(int offset = 0; offset < kMaxOffset; ++offset) {
+        for(int length = 0; length <= kMaxLength; ++length) {
+            auto const *s = src.data() + offset;
+
+            std::copy(s, s + length, expected.begin());
+            std::copy(s, s + length, actual.begin());
+            scalar.clamp(expected.data(), length, -1.0f, 1.0f);
+            funcs.clamp(actual.data(), length, -1.0f, 1.0f);
+            if(isSameBits(expected.data(), actual.data(), length) == false) { return false; }
+
+            std::fill(actual.begin(), actual.end(), 0.0f);
+            funcs.copy(actual.data() + offset, s, length);
+            if(isSameBits(s, actual.data() + offset, length) == false) { return false; }
+
+            std::fill(actual.begin(), actual.end(), 0.0f);
+            auto const e = scalar.copyWithMinMax(expected.data(), s, length);
+            auto const a = funcs.copyWithMinMax(actual.data(), s, length);
+            if(isSameBits(expected.data(), actual.data(), length) == false) { return false; }
+            if(e.min != a.min || e.max != a.max) { return false; }
+
+            auto const *sd = src_double.data() + offset;
+
+            std::copy(sd, sd + length, expected_double.begin());
+            std::copy(sd, sd + length, actual_double.begin());
+            scalar.clampDouble(expected_double.data(), length, -1.0, 1.0);
+            funcs.clampDouble(actual_double.data(), length, -1.0, 1.0);
+            if(isSameBits(expected_double.data(), actual_double.data(), length) == false) { return false; }
+
+            scalar.convert(expected.data(), sd, length);
+            funcs.convert(actual.data(), sd, length);
+            if(isSameBits(expected.data(), actual.data(), length) == false) { return false; }
+        }
+    }
+
+    return true;
+}
+
+bool verify()
+{
+    for(auto is: { InstructionSet::kSSE2, InstructionSet::kAVX2, InstructionSet::kNEON }) {
+        if(isAvailable(is) && verify(is) == false) { return false; }
+    }
+
+    return true;
+}
+
+} // namespace SimdKernels
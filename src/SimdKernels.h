@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// サンプル列を処理する関数群
+//
+// 実行環境で使用可能な命令セット (SSE2 / AVX2 / NEON) を実行時に判別し、それに応じた実装を呼び出す。
+// どの実装もスカラー実装と同じ結果を返す。
+namespace SimdKernels
+{
+    //! 実装に使用する命令セット
+    enum class InstructionSet : int {
+        kScalar,
+        kSSE2,
+        kAVX2,
+        kNEON,
+    };
+
+    //! 最小値と最大値
+    struct MinMax
+    {
+        float min = 0;
+        float max = 0;
+    };
+
+    //! data の各サンプルを [lo, hi] の範囲に制限する。
+    /*! NaN は lo になる。
+     */
+    void clamp(float *data, std::int64_t length, float lo, float hi);
+
+    //! 倍精度のサンプル列の各サンプルを [lo, hi] の範囲に制限する。
+    /*! NaN は lo になる。
+     */
+    void clamp(double *data, std::int64_t length, double lo, double hi);
+
+    //! src から dest へ length サンプルをコピーする。
+    /*! @pre src と dest の領域が重なっていないこと。
+     */
+    void copy(float *dest, float const *src, std::int64_t length);
+
+    //! src から dest へ length サンプルをコピーし、同時に src の最小値と最大値を求める。
+    /*! NaN は無視される。 length が 0 の場合は {0, 0} を返す。
+     *  @pre src と dest の領域が重なっていないこと。
+     */
+    MinMax copyWithMinMax(float *dest, float const *src, std::int64_t length);
+
+    //! 倍精度のサンプル列 src を単精度に変換して、 dest に length サンプル書き込む。
+    /*! 値は最も近い単精度の値に丸められる。
+     *  @pre src と dest の領域が重なっていないこと。
+     */
+    void convert(float *dest, double const *src, std::int64_t length);
+
+    //! 各処理の実装
+    struct Functions
+    {
+        void (*clamp)(float *data, std::int64_t length, float lo, float hi);
+        void (*copy)(float *dest, float const *src, std::int64_t length);
+        MinMax (*copyWithMinMax)(float *dest, float const *src, std::int64_t length);
+        void (*clampDouble)(double *data, std::int64_t length, double lo, double hi);
+        void (*convert)(float *dest, double const *src, std::int64_t length);
+    };
+
+    //! 指定した命令セットが実行環境で使用可能かどうかを返す。
+    bool isAvailable(InstructionSet is);
+
+    //! 指定した命令セットの実装を返す。
+    /*! @pre isAvailable(is)
+     */
+    Functions const & getFunctions(InstructionSet is);
+
+    //! 現在使用している命令セットを返す。
+    InstructionSet getActiveInstructionSet();
+
+    //! 指定した命令セットの実装が、スカラー実装と同じ結果を返すかどうかを確認する。
+    /*! clamp() と copy() と convert() はビット単位で比較する。
+     *  copyWithMinMax() の最小値と最大値は、 +0 と -0 の区別を除いて比較する。
+     *  is が使用できない場合は false を返す。
+     */
+    bool verify(InstructionSet is);
+
+    //! 使用可能なすべての命令セットについて verify(is) を行う。
+    bool verify();
+}
@@ -0,0 +1,127 @@
+#include "SincInterpolator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SIMPLE_OSCILLOSCOPE_SINC_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define SIMPLE_OSCILLOSCOPE_SINC_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace
+{
+
+constexpr double kPi = 3.14159265358979323846;
+
+//! カイザー窓の形状を決めるパラメータ
+constexpr double kKaiserBeta = 7.0;
+
+//! 第 1 種変形ベッセル関数 I0
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12) { break; }
+    }
+
+    return sum;
+}
+
+//! kNumTaps 個の係数とサンプルの内積
+float dot(float const *coeffs, float const *samples)
+{
+    static_assert(SincInterpolator::kNumTaps % 4 == 0, "the kernel processes four taps at a time");
+
+#if defined(SIMPLE_OSCILLOSCOPE_SINC_SSE2)
+    auto acc = _mm_setzero_ps();
+    for(int i = 0; i < SincInterpolator::kNumTaps; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coeffs + i), _mm_loadu_ps(samples + i)));
+    }
+
+    // 4 つのレーンの合計
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc);
+#elif defined(SIMPLE_OSCILLOSCOPE_SINC_NEON)
+    auto acc = vdupq_n_f32(0.0f);
+    for(int i = 0; i < SincInterpolator::kNumTaps; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(coeffs + i), vld1q_f32(samples + i));
+    }
+
+    auto const pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+    float acc = 0;
+    for(int i = 0; i < SincInterpolator::kNumTaps; ++i) {
+        acc += coeffs[i] * samples[i];
+    }
+
+    return acc;
+#endif
+}
+
+} // namespace
+
+SincInterpolator::SincInterpolator()
+{
+    constexpr int kHalf = kNumTaps / 2;
+
+    // std::vector の先頭が 16 バイト境界に揃う保証はないので、 dot() は係数もアライメントを仮定せずに読み込む。
+    table_.resize((kNumPhases + 1) * kNumTaps);
+
+    auto const i0_beta = besselI0(kKaiserBeta);
+
+    for(int p = 0; p <= kNumPhases; ++p) {
+        auto const frac = (double)p / kNumPhases;
+        auto *row = table_.data() + p * kNumTaps;
+
+        // タップ j は、出力位置の整数部 n に対してサンプル位置 n + j - (kHalf - 1) に対応する。
+        double sum = 0;
+        for(int j = 0; j < kNumTaps; ++j) {
+            auto const x = frac - (j - (kHalf - 1));
+            auto const sinc = (x == 0.0) ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            auto const r = x / kHalf;
+            auto const window = (std::abs(r) >= 1.0) ? 0.0 : besselI0(kKaiserBeta * std::sqrt(1.0 - r * r)) / i0_beta;
+            row[j] = (float)(sinc * window);
+            sum += row[j];
+        }
+
+        // 直流成分の利得を 1 にする。
+        for(int j = 0; j < kNumTaps; ++j) {
+            row[j] = (float)(row[j] / sum);
+        }
+    }
+}
+
+void SincInterpolator::process(float const *src, std::int64_t src_length, double start, double step, int num_out, float *dest) const
+{
+    constexpr int kHalf = kNumTaps / 2;
+
+    float edge[kNumTaps];
+
+    for(int k = 0; k < num_out; ++k) {
+        auto const t = start + step * k;
+        auto const n = (std::int64_t)std::floor(t);
+        auto const phase = std::min((int)std::lround((t - n) * kNumPhases), kNumPhases);
+        auto const *coeffs = table_.data() + phase * kNumTaps;
+
+        auto const first = n - (kHalf - 1);
+        if(first >= 0 && first + kNumTaps <= src_length) {
+            dest[k] = dot(coeffs, src + first);
+            continue;
+        }
+
+        // 両端付近では、範囲外のサンプルを端のサンプルで置き換える。
+        for(int j = 0; j < kNumTaps; ++j) {
+            edge[j] = src[std::min(std::max<std::int64_t>(first + j, 0), src_length - 1)];
+        }
+
+        dest[k] = dot(coeffs, edge);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// 帯域制限されたサンプル列から、サンプル間の任意の位置の値を窓付き sinc 関数で復元するクラス
+//
+// 1 サンプルあたり kNumPhases 通りの小数位置について、 kNumTaps タップのフィルタ係数をあらかじめ表にしておき（ポリフェーズ）、
+// 出力する位置ごとに最も近い小数位置の係数とサンプル列の内積を求める。
+// サンプル間を直線で結ぶ場合と異なり、サンプル間のピーク（インターサンプルピーク）も表示できる。
+struct SincInterpolator
+{
+    //! フィルタのタップ数。出力する位置の前後 kNumTaps / 2 サンプルずつを参照する。
+    static constexpr int kNumTaps = 16;
+
+    //! 1 サンプルあたりの小数位置の分割数
+    static constexpr int kNumPhases = 512;
+
+    //! 係数表を作成する。
+    SincInterpolator();
+
+    //! src[i] をサンプル位置 i の値として、サンプル位置 start + k * step (k = 0 .. num_out - 1) の値を dest に求める。
+    /*! src の範囲外のサンプルは、 src の両端のサンプルと同じ値とみなす。
+     *  @pre src_length > 0
+     */
+    void process(float const *src, std::int64_t src_length, double start, double step, int num_out, float *dest) const;
+
+private:
+    // [小数位置][タップ] の順に並べた係数表。小数位置 1.0 に対応する番兵の行を末尾に持つ。
+    std::vector<float> table_;
+};
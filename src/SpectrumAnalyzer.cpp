@@ -0,0 +1,286 @@
+#include "SpectrumAnalyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+juce::dsp::WindowingFunction<float>::WindowingMethod toWindowingMethod(SpectrumAnalyzer::Window window)
+{
+    using Method = juce::dsp::WindowingFunction<float>::WindowingMethod;
+
+    switch(window) {
+        case SpectrumAnalyzer::Window::kRectangular:    return Method::rectangular;
+        case SpectrumAnalyzer::Window::kBlackmanHarris: return Method::blackmanHarris;
+        case SpectrumAnalyzer::Window::kFlatTop:        return Method::flatTop;
+        case SpectrumAnalyzer::Window::kHann:
+        default:                                        return Method::hann;
+    }
+}
+
+} // namespace
+
+SpectrumAnalyzer::SpectrumAnalyzer(AudioPluginAudioProcessor &processor, int num_display_bins)
+:   juce::Thread("SpectrumAnalyzer")
+,   processor_(processor)
+,   num_display_bins_(std::max(num_display_bins, 1))
+{}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    stop();
+}
+
+void SpectrumAnalyzer::start()
+{
+    startThread();
+}
+
+void SpectrumAnalyzer::stop()
+{
+    stopThread(1000);
+}
+
+void SpectrumAnalyzer::setChannelsEnabled(std::vector<bool> const &enabled)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    channels_enabled_ = enabled;
+}
+
+double SpectrumAnalyzer::getDisplayBinFrequency(int bin, int num_display_bins, double sample_rate)
+{
+    // 各ビンの範囲の、対数軸上での中心の周波数
+    auto const ratio = (sample_rate / 2.0) / kMinFrequency;
+    return kMinFrequency * std::pow(ratio, (bin + 0.5) / num_display_bins);
+}
+
+bool SpectrumAnalyzer::getSpectrum(Spectrum &dest) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(result_.sequence == 0 || result_.sequence == dest.sequence) { return false; }
+
+    dest.sample_rate = result_.sample_rate;
+    dest.fft_size = result_.fft_size;
+    dest.sequence = result_.sequence;
+
+    // 内側の vector のメモリを再利用するために、要素ごとに代入する。
+    dest.decibels.resize(result_.decibels.size());
+    for(std::size_t ch = 0; ch < result_.decibels.size(); ++ch) {
+        dest.decibels[ch].assign(result_.decibels[ch].begin(), result_.decibels[ch].end());
+    }
+
+    return true;
+}
+
+void SpectrumAnalyzer::run()
+{
+    while(threadShouldExit() == false) {
+        // 新しいデータがなかった場合は、データが溜まるまで長めに待つ。
+        wait(process() ? 5 : 20);
+    }
+}
+
+bool SpectrumAnalyzer::process()
+{
+    auto audio_data = processor_.getAudioData();
+    auto const sample_rate = processor_.getSampleRate();
+    if(audio_data == nullptr || sample_rate <= 0) { return false; }
+
+    Config config;
+    config.order = getOrder();
+    config.window = getWindow();
+    config.sample_rate = sample_rate;
+    config.num_channels = (int)audio_data->getBuffer().getNumChannels();
+
+    // prepareToPlay() によって AudioData が作り直されていたら、新しい AudioData から読み込みを始める。
+    if(audio_data != audio_data_) {
+        audio_data_ = audio_data;
+        reader_ = audio_data_->getBuffer().createReader();
+        config_ = Config {};
+    }
+
+    if((config == config_) == false) {
+        configure(config);
+    }
+
+    // FFT のサイズより古いデータは解析に使用しないので、最新の FFT サイズ分までを読み込む。
+    auto const result = audio_data_->getBuffer().readLatest(reader_, read_buffer_.getArrayOfWritePointers(), 0, read_buffer_.getNumSamples());
+    if(result.num_read == 0) { return false; }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        analyzed_.assign(config_.num_channels, false);
+        for(int ch = 0; ch < config_.num_channels && ch < (int)channels_enabled_.size(); ++ch) {
+            analyzed_[ch] = channels_enabled_[ch];
+        }
+    }
+
+    auto const fft_size = 1 << config_.order;
+    auto const hop = std::max(1, (int)std::round(fft_size * (1.0 - getOverlap())));
+    auto const averaging = getAveraging();
+    auto const averaging_time = getAveragingTime();
+    bool analyzed_any = false;
+
+    // hop サンプルごとに FFT を行う。
+    for(std::int64_t offset = 0; offset < result.num_read; ) {
+        auto const num = (int)std::min<std::int64_t>(result.num_read - offset, std::max(hop - num_since_last_fft_, 0));
+
+        for(int ch = 0; ch < config_.num_channels; ++ch) {
+            if(analyzed_[ch] == false) { continue; }
+
+            // 古いデータを前に詰めて、新しいデータを末尾に追加する。
+            auto &history = history_[ch];
+            auto const *src = read_buffer_.getReadPointer(ch) + offset;
+            std::copy(history.begin() + num, history.end(), history.begin());
+            std::copy_n(src, num, history.end() - num);
+        }
+
+        offset += num;
+        num_since_last_fft_ += num;
+
+        if(num_since_last_fft_ >= hop) {
+            for(int ch = 0; ch < config_.num_channels; ++ch) {
+                if(analyzed_[ch]) { analyzeChannel(ch, averaging, averaging_time, hop); }
+            }
+
+            num_since_last_fft_ = 0;
+            analyzed_any = true;
+        }
+    }
+
+    if(analyzed_any) {
+        publish();
+    }
+
+    return true;
+}
+
+void SpectrumAnalyzer::configure(Config const &config)
+{
+    auto const fft_size = 1 << config.order;
+
+    if(fft_ == nullptr || config.order != config_.order) {
+        fft_ = std::make_unique<juce::dsp::FFT>(config.order);
+    }
+
+    // 窓関数による振幅の減少を補正して、フルスケールの正弦波が 0 dB になるようにする。
+    window_table_.resize(fft_size);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window_table_.data(), (std::size_t)fft_size,
+                                                              toWindowingMethod(config.window), false);
+
+    double window_sum = 0;
+    for(auto w: window_table_) { window_sum += w; }
+    power_scale_ = (float)std::pow(2.0 / std::max(window_sum, 1e-9), 2.0);
+
+    fft_buffer_.assign(fft_size * 2, 0.0f);
+    read_buffer_.setSize(config.num_channels, fft_size);
+    history_.assign(config.num_channels, std::vector<float>(fft_size, 0.0f));
+    power_.assign(config.num_channels, std::vector<float>(num_display_bins_, 0.0f));
+    frame_power_.assign(num_display_bins_, 0.0f);
+
+    // 表示用の各ビンの範囲に含まれる FFT のビンを求める。
+    // FFT のビンが含まれないほど狭い範囲は、中心の周波数で線形補間する。
+    auto const bins_per_hz = fft_size / config.sample_rate;
+    auto const num_fft_bins = fft_size / 2 + 1;
+    auto const ratio = (config.sample_rate / 2.0) / kMinFrequency;
+
+    mapping_.resize(num_display_bins_);
+    for(int d = 0; d < num_display_bins_; ++d) {
+        auto const lo = kMinFrequency * std::pow(ratio, (double)d / num_display_bins_);
+        auto const hi = kMinFrequency * std::pow(ratio, (double)(d + 1) / num_display_bins_);
+
+        auto &m = mapping_[d];
+        m.begin = std::min((int)std::ceil(lo * bins_per_hz), num_fft_bins);
+        m.end = std::min((int)std::ceil(hi * bins_per_hz), num_fft_bins);
+        m.position = getDisplayBinFrequency(d, num_display_bins_, config.sample_rate) * bins_per_hz;
+    }
+
+    num_since_last_fft_ = 0;
+    config_ = config;
+}
+
+void SpectrumAnalyzer::analyzeChannel(int channel, Averaging averaging, float averaging_time, int hop)
+{
+    auto const fft_size = 1 << config_.order;
+    auto const num_fft_bins = fft_size / 2 + 1;
+
+    auto const &history = history_[channel];
+    for(int i = 0; i < fft_size; ++i) {
+        fft_buffer_[i] = history[i] * window_table_[i];
+    }
+    std::fill(fft_buffer_.begin() + fft_size, fft_buffer_.end(), 0.0f);
+
+    // 先頭の fft_size / 2 + 1 個の要素に、各ビンの振幅が格納される。
+    fft_->performFrequencyOnlyForwardTransform(fft_buffer_.data());
+
+    auto const power_at = [&](int bin) {
+        auto const mag = fft_buffer_[juce::jlimit(0, num_fft_bins - 1, bin)];
+        return mag * mag * power_scale_;
+    };
+
+    for(int d = 0; d < num_display_bins_; ++d) {
+        auto const &m = mapping_[d];
+
+        float p = 0;
+        if(m.begin < m.end) {
+            for(int k = m.begin; k < m.end; ++k) { p = std::max(p, power_at(k)); }
+        } else {
+            auto const k = (int)std::floor(m.position);
+            auto const frac = (float)(m.position - k);
+            p = power_at(k) * (1.0f - frac) + power_at(k + 1) * frac;
+        }
+
+        frame_power_[d] = p;
+    }
+
+    auto &power = power_[channel];
+    auto const frame_seconds = hop / config_.sample_rate;
+
+    switch(averaging) {
+        case Averaging::kExponential: {
+            auto const alpha = (float)std::exp(-frame_seconds / averaging_time);
+            for(int d = 0; d < num_display_bins_; ++d) {
+                power[d] = alpha * power[d] + (1.0f - alpha) * frame_power_[d];
+            }
+            break;
+        }
+        case Averaging::kPeakHold: {
+            // averaging_time 秒で 60 dB 減衰させる。
+            auto const decay = (float)std::pow(10.0, -6.0 * frame_seconds / averaging_time);
+            for(int d = 0; d < num_display_bins_; ++d) {
+                power[d] = std::max(frame_power_[d], power[d] * decay);
+            }
+            break;
+        }
+        case Averaging::kNone:
+        default:
+            std::copy(frame_power_.begin(), frame_power_.end(), power.begin());
+            break;
+    }
+}
+
+void SpectrumAnalyzer::publish()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    result_.sample_rate = config_.sample_rate;
+    result_.fft_size = 1 << config_.order;
+    result_.sequence = ++num_published_;
+    result_.decibels.resize(config_.num_channels);
+
+    auto const min_power = std::pow(10.0f, kMinDecibels / 10.0f);
+
+    for(int ch = 0; ch < config_.num_channels; ++ch) {
+        auto &dest = result_.decibels[ch];
+        if(analyzed_[ch] == false) {
+            dest.clear();
+            continue;
+        }
+
+        dest.resize(num_display_bins_);
+        for(int d = 0; d < num_display_bins_; ++d) {
+            dest[d] = 10.0f * std::log10(std::max(power_[ch][d], min_power));
+        }
+    }
+}
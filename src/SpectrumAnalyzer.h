@@ -0,0 +1,172 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+#include "PluginProcessor.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Processor が AudioData に書き込んだデータを、バックグラウンドのスレッドで周波数解析するクラス
+//
+// 解析スレッドは GUI スレッドとは別の Reader で AudioData のリングバッファを読み込み、
+// 一定のサンプル数ごとに FFT を行って、対数周波数軸上の表示用のビンに変換した結果を公開する。
+// GUI スレッドは getSpectrum() で完成した結果をコピーするだけなので、 FFT のサイズに関係なく描画の負荷は変わらない。
+//
+// 設定は任意のスレッドから変更でき、解析スレッドが次にデータを処理するときに反映される。
+struct SpectrumAnalyzer
+:   private juce::Thread
+{
+    //! FFT のサイズの範囲 (2 のべき乗の指数)
+    static constexpr int kMinOrder = 9;
+    static constexpr int kMaxOrder = 15;
+
+    //! 表示する最も低い周波数 [Hz]
+    static constexpr double kMinFrequency = 20.0;
+
+    //! 表示する最も小さいレベル [dB]
+    static constexpr float kMinDecibels = -120.0f;
+
+    //! 窓関数の種類
+    enum class Window : int {
+        kRectangular = 1,
+        kHann,
+        kBlackmanHarris,
+        kFlatTop,
+    };
+
+    //! 平均化の方法
+    enum class Averaging : int {
+        //! 平均化しない
+        kNone = 1,
+        //! 指数移動平均
+        kExponential,
+        //! ピークホールド。保持した値は時間とともに減衰する。
+        kPeakHold,
+    };
+
+    //! 解析結果
+    struct Spectrum
+    {
+        double sample_rate = 0;
+        int fft_size = 0;
+        //! 何番目に公開された結果か。まだ結果がない場合は 0
+        std::int64_t sequence = 0;
+        //! リングバッファのチャンネルごとの、表示用の各ビンのレベル [dB]。解析していないチャンネルは空
+        std::vector<std::vector<float>> decibels;
+    };
+
+    //! コンストラクタ
+    /*! @param processor 解析するデータを書き込む Processor 。
+     *  解析スレッドから getAudioData() と getSampleRate() を呼び出す。
+     *  @param num_display_bins 表示用のビンの数
+     */
+    SpectrumAnalyzer(AudioPluginAudioProcessor &processor, int num_display_bins);
+    ~SpectrumAnalyzer() override;
+
+    //! 解析スレッドを開始する。
+    void start();
+    //! 解析スレッドを停止する。
+    void stop();
+
+    //! FFT のサイズを 2^order で指定する。
+    void setOrder(int order) { order_.store(juce::jlimit(kMinOrder, kMaxOrder, order)); }
+    int getOrder() const { return order_.load(); }
+
+    void setWindow(Window window) { window_.store((int)window); }
+    Window getWindow() const { return (Window)window_.load(); }
+
+    //! 連続する FFT の区間の重なりの割合 (0.0 .. 0.875)
+    void setOverlap(float overlap) { overlap_.store(juce::jlimit(0.0f, 0.875f, overlap)); }
+    float getOverlap() const { return overlap_.load(); }
+
+    void setAveraging(Averaging averaging) { averaging_.store((int)averaging); }
+    Averaging getAveraging() const { return (Averaging)averaging_.load(); }
+
+    //! 平均化の時定数 [秒]
+    /*! 指数移動平均では平均化の時定数、ピークホールドでは保持した値が 60 dB 減衰するまでの時間を表す。
+     */
+    void setAveragingTime(float seconds) { averaging_time_.store(std::max(seconds, 0.001f)); }
+    float getAveragingTime() const { return averaging_time_.load(); }
+
+    //! 解析するリングバッファのチャンネルを指定する。
+    void setChannelsEnabled(std::vector<bool> const &enabled);
+
+    //! 表示用のビンの数
+    int getNumDisplayBins() const noexcept { return num_display_bins_; }
+
+    //! 表示用のビンの中心周波数を返す。
+    static double getDisplayBinFrequency(int bin, int num_display_bins, double sample_rate);
+
+    //! dest より新しい解析結果があれば dest にコピーする。
+    /*! dest のメモリは再利用される。
+     *  @return 新しい解析結果をコピーした場合は true
+     */
+    bool getSpectrum(Spectrum &dest) const;
+
+private:
+    // FFT ごとの設定。設定が変わったときだけ作り直す。
+    struct Config
+    {
+        int order = 0;
+        Window window = Window::kHann;
+        double sample_rate = 0;
+        int num_channels = 0;
+
+        bool operator==(Config const &rhs) const
+        {
+            return order == rhs.order && window == rhs.window
+                && sample_rate == rhs.sample_rate && num_channels == rhs.num_channels;
+        }
+    };
+
+    // 表示用のビンに対応する FFT のビンの範囲
+    struct BinMapping
+    {
+        int begin = 0;
+        int end = 0;
+        // begin == end の場合に、線形補間に使用する FFT のビンの位置
+        double position = 0;
+    };
+
+    AudioPluginAudioProcessor &processor_;
+    int num_display_bins_ = 0;
+
+    std::atomic<int> order_ { 13 };
+    std::atomic<int> window_ { (int)Window::kHann };
+    std::atomic<float> overlap_ { 0.5f };
+    std::atomic<int> averaging_ { (int)Averaging::kExponential };
+    std::atomic<float> averaging_time_ { 0.3f };
+
+    // 以下はロックして解析スレッドと他のスレッドで共有する。
+    mutable std::mutex mutex_;
+    std::vector<bool> channels_enabled_;
+    Spectrum result_;
+
+    // 以下は解析スレッドからのみアクセスする。
+    std::shared_ptr<AudioData const> audio_data_;
+    AudioData::BufferType::Reader reader_;
+    Config config_;
+    std::unique_ptr<juce::dsp::FFT> fft_;
+    std::vector<float> window_table_;
+    // FFT の振幅の二乗を、正弦波の振幅の二乗に換算する係数
+    float power_scale_ = 1.0f;
+    std::vector<float> fft_buffer_;
+    std::vector<BinMapping> mapping_;
+    juce::AudioSampleBuffer read_buffer_;
+    // チャンネルごとの、直近 FFT サイズ分の入力
+    std::vector<std::vector<float>> history_;
+    // チャンネルごとの、平均化したパワー
+    std::vector<std::vector<float>> power_;
+    std::vector<float> frame_power_;
+    std::vector<bool> analyzed_;
+    int num_since_last_fft_ = 0;
+    std::int64_t num_published_ = 0;
+
+    void run() override;
+    bool process();
+    void configure(Config const &config);
+    void analyzeChannel(int channel, Averaging averaging, float averaging_time, int hop);
+    void publish();
+};
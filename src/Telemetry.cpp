@@ -0,0 +1,169 @@
+#include "Telemetry.h"
+
+#include <cstdio>
+
+double LogHistogram::Snapshot::getPercentile(double p) const
+{
+    if(count == 0) { return 0.0; }
+
+    auto const target = (std::int64_t)(p * count);
+    std::int64_t accumulated = 0;
+
+    for(int i = 0; i < kNumBuckets; ++i) {
+        accumulated += buckets[i];
+        if(accumulated > target) {
+            // 区間 i の上限は 2^i - 1 だが、最大値を超えないようにする。
+            auto const upper = (i == 0) ? 0.0 : (double)(((std::uint64_t)1 << i) - 1);
+            return upper < (double)max ? upper : (double)max;
+        }
+    }
+
+    return (double)max;
+}
+
+LogHistogram::Snapshot LogHistogram::getSnapshot() const noexcept
+{
+    Snapshot s;
+    for(int i = 0; i < kNumBuckets; ++i) {
+        s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    s.count = count_.load(std::memory_order_relaxed);
+    s.sum = sum_.load(std::memory_order_relaxed);
+    s.max = max_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void LogHistogram::reset() noexcept
+{
+    for(auto &bucket: buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+//==============================================================================
+char const * ProcessorTelemetry::getStageName(Stage stage)
+{
+    switch(stage) {
+        case Stage::kPreCopy:   return "pre_copy";
+        case Stage::kFilter:    return "filter";
+        case Stage::kClamp:     return "clamp";
+        case Stage::kMeter:     return "meter";
+        case Stage::kRingWrite: return "ring_write";
+        case Stage::kHandoff:   return "handoff";
+        case Stage::kBlock:     return "block";
+        default:                return "unknown";
+    }
+}
+
+ProcessorTelemetry::Snapshot ProcessorTelemetry::getSnapshot() const noexcept
+{
+    Snapshot s;
+    for(int i = 0; i < kNumStages; ++i) {
+        s.stages[i] = stages_[i].getSnapshot();
+    }
+
+    s.load_permille = load_permille_.getSnapshot();
+    s.num_overloads = num_overloads_.load(std::memory_order_relaxed);
+    s.num_capture_skipped = num_capture_skipped_.load(std::memory_order_relaxed);
+    s.reader_overruns = reader_overruns_.load(std::memory_order_relaxed);
+    s.reader_dropped = reader_dropped_.load(std::memory_order_relaxed);
+    s.reader_lag = reader_lag_.getSnapshot();
+    s.display_latency = display_latency_.getSnapshot();
+    return s;
+}
+
+void ProcessorTelemetry::reset() noexcept
+{
+    for(auto &stage: stages_) {
+        stage.reset();
+    }
+
+    load_permille_.reset();
+    num_overloads_.store(0, std::memory_order_relaxed);
+    num_capture_skipped_.store(0, std::memory_order_relaxed);
+    reader_overruns_.store(0, std::memory_order_relaxed);
+    reader_dropped_.store(0, std::memory_order_relaxed);
+    reader_lag_.reset();
+    display_latency_.reset();
+}
+
+namespace
+{
+
+//! ヒストグラムの内容を CSV の一行として追加する。値は scale で割った単位で出力する。
+void appendCsvRow(std::string &dest, char const *name, char const *unit, LogHistogram::Snapshot const &h, double scale)
+{
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%s,%s,%lld,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                  name, unit, (long long)h.count,
+                  h.getMean() / scale,
+                  h.getPercentile(0.5) / scale,
+                  h.getPercentile(0.99) / scale,
+                  h.getPercentile(0.999) / scale,
+                  h.max / scale);
+    dest += buf;
+}
+
+//! カウンタの値を CSV の一行として追加する。
+void appendCsvCounter(std::string &dest, char const *name, std::int64_t value)
+{
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%s,count,%lld,,,,,\n", name, (long long)value);
+    dest += buf;
+}
+
+} // namespace
+
+std::string ProcessorTelemetry::Snapshot::toCsv() const
+{
+    std::string csv = "metric,unit,count,mean,p50,p99,p999,max\n";
+
+    for(int i = 0; i < kNumStages; ++i) {
+        appendCsvRow(csv, getStageName((Stage)i), "us", stages[i], 1000.0);
+    }
+
+    appendCsvRow(csv, "load", "%", load_permille, 10.0);
+    appendCsvRow(csv, "reader_lag", "samples", reader_lag, 1.0);
+    appendCsvRow(csv, "display_latency", "us", display_latency, 1000.0);
+    appendCsvCounter(csv, "overloads", num_overloads);
+    appendCsvCounter(csv, "capture_skipped", num_capture_skipped);
+    appendCsvCounter(csv, "reader_overruns", reader_overruns);
+    appendCsvCounter(csv, "reader_dropped", reader_dropped);
+
+    return csv;
+}
+
+std::string ProcessorTelemetry::Snapshot::toText() const
+{
+    std::string text;
+    char buf[256];
+
+    for(int i = 0; i < kNumStages; ++i) {
+        auto const &h = stages[i];
+        std::snprintf(buf, sizeof(buf), "%-10s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+                      getStageName((Stage)i), h.getPercentile(0.5) / 1000.0, h.getPercentile(0.99) / 1000.0, h.max / 1000.0);
+        text += buf;
+    }
+
+    std::snprintf(buf, sizeof(buf), "load       p50 %6.1f %%  p99 %6.1f %%  max %6.1f %%  overloads %lld\n",
+                  load_permille.getPercentile(0.5) / 10.0, load_permille.getPercentile(0.99) / 10.0,
+                  load_permille.max / 10.0, (long long)num_overloads);
+    text += buf;
+
+    std::snprintf(buf, sizeof(buf), "reader     lag p99 %lld smp  overruns %lld  dropped %lld  skipped %lld\n",
+                  (long long)reader_lag.getPercentile(0.99), (long long)reader_overruns,
+                  (long long)reader_dropped, (long long)num_capture_skipped);
+    text += buf;
+
+    std::snprintf(buf, sizeof(buf), "display    latency p50 %6.1f ms  p99 %6.1f ms  max %6.1f ms\n",
+                  display_latency.getPercentile(0.5) / 1e6, display_latency.getPercentile(0.99) / 1e6,
+                  display_latency.max / 1e6);
+    text += buf;
+
+    return text;
+}
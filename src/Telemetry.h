@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// 値の分布を 2 のべき乗ごとの区間で数えるヒストグラム
+//
+// 区間 0 は値 0 を、区間 i (i >= 1) は [2^(i-1), 2^i) の範囲の値を数える。
+// 記録はロックやメモリ確保をせずに行うので、オーディオスレッドから呼び出せる。
+struct LogHistogram
+{
+    static constexpr int kNumBuckets = 48;
+
+    //! ある時点でのヒストグラムの内容
+    struct Snapshot
+    {
+        std::array<std::int64_t, kNumBuckets> buckets {};
+        std::int64_t count = 0;
+        std::int64_t sum = 0;
+        std::int64_t max = 0;
+
+        double getMean() const { return count > 0 ? (double)sum / count : 0.0; }
+
+        //! 記録された値の p (0.0 .. 1.0) 分位点を返す。
+        /*! 区間の中の分布はわからないので、該当する区間の上限を返す。
+         */
+        double getPercentile(double p) const;
+    };
+
+    //! 値を記録する。
+    void record(std::int64_t value) noexcept
+    {
+        value = value < 0 ? 0 : value;
+
+        buckets_[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+
+        auto current = max_.load(std::memory_order_relaxed);
+        while(value > current && max_.compare_exchange_weak(current, value, std::memory_order_relaxed) == false) {}
+    }
+
+    //! 現在の内容を返す。
+    /*! 記録と並行して呼び出した場合、各値は同じ時点のものになるとは限らない。
+     */
+    Snapshot getSnapshot() const noexcept;
+
+    //! 記録した内容を破棄する。
+    void reset() noexcept;
+
+    //! value を記録する区間の番号を返す。
+    static int getBucketIndex(std::int64_t value) noexcept
+    {
+        int index = 0;
+        for(auto v = (std::uint64_t)value; v != 0; v >>= 1) { ++index; }
+        return index < kNumBuckets ? index : kNumBuckets - 1;
+    }
+
+private:
+    std::array<std::atomic<std::int64_t>, kNumBuckets> buckets_ {};
+    std::atomic<std::int64_t> count_ { 0 };
+    std::atomic<std::int64_t> sum_ { 0 };
+    std::atomic<std::int64_t> max_ { 0 };
+};
+
+// processBlock() の処理時間と、 GUI スレッドへのデータの受け渡し状況を記録するクラス
+//
+// 記録はオーディオスレッドと GUI スレッドからロックせずに行い、
+// getSnapshot() で任意のスレッドから集計結果を取得する。
+struct ProcessorTelemetry
+{
+    //! 処理時間を計測する区間
+    enum class Stage : int {
+        //! エフェクト処理前のデータの退避
+        kPreCopy,
+        //! IIR フィルタ
+        kFilter,
+        //! 出力のクリップ
+        kClamp,
+        //! エフェクト処理前後のレベルの計測
+        kMeter,
+        //! AudioData のリングバッファへの書き込み
+        kRingWrite,
+        //! トリガーの検出とフレームの公開
+        kHandoff,
+        //! processBlock() 全体
+        kBlock,
+        kNumStages,
+    };
+
+    static constexpr int kNumStages = (int)Stage::kNumStages;
+
+    static char const * getStageName(Stage stage);
+
+    //! ある時点での集計結果
+    struct Snapshot
+    {
+        //! 各区間の処理時間 [ns]
+        std::array<LogHistogram::Snapshot, kNumStages> stages;
+        //! ブロックの長さに対する processBlock() の処理時間の割合 [‰]
+        LogHistogram::Snapshot load_permille;
+        //! 処理時間がブロックの長さを超えた回数
+        std::int64_t num_overloads = 0;
+        //! チャンネル構成の不一致のために AudioData への書き込みを行わなかったブロック数
+        std::int64_t num_capture_skipped = 0;
+
+        //! GUI スレッドの読み込みが間に合わずにデータが失われた回数
+        std::int64_t reader_overruns = 0;
+        //! GUI スレッドの読み込みが間に合わずに失われたサンプル数
+        std::int64_t reader_dropped = 0;
+        //! GUI スレッドが読み込んだ時点での、書き込み位置からの遅れ [samples]
+        LogHistogram::Snapshot reader_lag;
+        //! 表示したデータが書き込まれてから、画面に描画されるまでの時間 [ns]
+        LogHistogram::Snapshot display_latency;
+
+        //! 集計結果を CSV 形式の文字列にする。
+        /*! 一行に一つの指標を出力する。時間の単位は μs
+         */
+        std::string toCsv() const;
+
+        //! 集計結果を人が読むための複数行の文字列にする。
+        std::string toText() const;
+    };
+
+    //! 現在時刻を ns 単位で返す。
+    static std::int64_t now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //! 区間の処理時間を記録する。
+    void recordStage(Stage stage, std::int64_t elapsed_ns) noexcept
+    {
+        stages_[(int)stage].record(elapsed_ns);
+    }
+
+    //! processBlock() 全体の処理時間と、ブロックの長さに対する割合を記録する。
+    void recordBlock(std::int64_t elapsed_ns, int num_samples, double sample_rate) noexcept
+    {
+        recordStage(Stage::kBlock, elapsed_ns);
+        if(num_samples <= 0 || sample_rate <= 0) { return; }
+
+        auto const deadline_ns = num_samples / sample_rate * 1e9;
+        load_permille_.record((std::int64_t)(elapsed_ns / deadline_ns * 1000.0));
+        if(elapsed_ns > deadline_ns) {
+            num_overloads_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //! AudioData への書き込みを行わなかったことを記録する。
+    void recordCaptureSkipped() noexcept
+    {
+        num_capture_skipped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! GUI スレッドの読み込み状況を記録する。
+    /*! @param num_overruns これまでに読み込みが間に合わなかった回数の合計
+     *  @param num_dropped これまでに失われたサンプル数の合計
+     *  @param lag 読み込んだ時点での、書き込み位置からの遅れ
+     */
+    void recordReader(std::int64_t num_overruns, std::int64_t num_dropped, std::int64_t lag) noexcept
+    {
+        reader_overruns_.store(num_overruns, std::memory_order_relaxed);
+        reader_dropped_.store(num_dropped, std::memory_order_relaxed);
+        reader_lag_.record(lag);
+    }
+
+    //! 表示したデータが書き込まれてから、画面に描画されるまでの時間を記録する。
+    void recordDisplayLatency(std::int64_t latency_ns) noexcept
+    {
+        display_latency_.record(latency_ns);
+    }
+
+    Snapshot getSnapshot() const noexcept;
+
+    //! 記録した内容を破棄する。
+    /*! 記録と並行して呼び出した場合、破棄の直前の記録が一部だけ残ることがある。
+     */
+    void reset() noexcept;
+
+private:
+    std::array<LogHistogram, kNumStages> stages_;
+    LogHistogram load_permille_;
+    std::atomic<std::int64_t> num_overloads_ { 0 };
+    std::atomic<std::int64_t> num_capture_skipped_ { 0 };
+    std::atomic<std::int64_t> reader_overruns_ { 0 };
+    std::atomic<std::int64_t> reader_dropped_ { 0 };
+    LogHistogram reader_lag_;
+    LogHistogram display_latency_;
+};
+
+// スコープを抜けるまでの時間を、 ProcessorTelemetry の指定した区間の処理時間として記録するクラス
+struct ScopedStageTimer
+{
+    ScopedStageTimer(ProcessorTelemetry &telemetry, ProcessorTelemetry::Stage stage) noexcept
+    :   telemetry_(telemetry)
+    ,   stage_(stage)
+    ,   start_(ProcessorTelemetry::now())
+    {}
+
+    ~ScopedStageTimer()
+    {
+        telemetry_.recordStage(stage_, ProcessorTelemetry::now() - start_);
+    }
+
+    ScopedStageTimer(ScopedStageTimer const &) = delete;
+    ScopedStageTimer & operator=(ScopedStageTimer const &) = delete;
+
+private:
+    ProcessorTelemetry &telemetry_;
+    ProcessorTelemetry::Stage stage_;
+    std::int64_t start_;
+};
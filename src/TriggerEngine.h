@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// トリガーによって確定した、表示用のフレームの範囲
+struct TriggeredFrame
+{
+    //! フレームの先頭の、書き込み開始からの通算のサンプル位置
+    std::int64_t start = 0;
+    //! フレームのサンプル数
+    std::int64_t length = 0;
+    //! トリガーが発生したサンプル位置
+    std::int64_t trigger_position = 0;
+    //! 何番目に確定したフレームか。まだフレームが確定していない場合は 0
+    std::int64_t sequence = 0;
+};
+
+// オーディオスレッドで確定した TriggeredFrame を、他のスレッドへ公開するクラス
+//
+// 書き込みはオーディオスレッドからのみ行う。書き込み側は待機せず、
+// 読み込み側は書き込み中の値を読み込んでしまった場合だけ読み込みをやり直す。
+struct TriggeredFrameSlot
+{
+    //! フレームを公開する。オーディオスレッドからのみ呼び出すこと。
+    void publish(std::int64_t start, std::int64_t length, std::int64_t trigger_position)
+    {
+        auto const seq = seq_.load(std::memory_order_relaxed);
+
+        // 書き込み中は seq_ を奇数にする。
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        start_.store(start, std::memory_order_relaxed);
+        length_.store(length, std::memory_order_relaxed);
+        trigger_position_.store(trigger_position, std::memory_order_relaxed);
+
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    //! 最後に公開されたフレームを返す。
+    TriggeredFrame load() const
+    {
+        for( ; ; ) {
+            auto const seq1 = seq_.load(std::memory_order_acquire);
+            if(seq1 % 2 != 0) { continue; }
+
+            TriggeredFrame frame;
+            frame.start = start_.load(std::memory_order_relaxed);
+            frame.length = length_.load(std::memory_order_relaxed);
+            frame.trigger_position = trigger_position_.load(std::memory_order_relaxed);
+            frame.sequence = seq1 / 2;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(seq_.load(std::memory_order_relaxed) == seq1) { return frame; }
+        }
+    }
+
+private:
+    std::atomic<std::int64_t> seq_ { 0 };
+    std::atomic<std::int64_t> start_ { 0 };
+    std::atomic<std::int64_t> length_ { 0 };
+    std::atomic<std::int64_t> trigger_position_ { 0 };
+};
+
+// オーディオスレッドでエッジトリガーを検出し、表示用のフレームを確定させるクラス
+//
+// 設定は任意のスレッドから変更でき、 process() の呼び出しごとに反映される。
+// process() はオーディオスレッドからのみ呼び出す。
+struct TriggerEngine
+{
+    //! トリガーの種類
+    enum class Mode : int {
+        kOff = 1,
+        kRising,
+        kFalling,
+    };
+
+    void setMode(Mode mode) { mode_.store((int)mode); }
+    Mode getMode() const { return (Mode)mode_.load(); }
+
+    //! トリガーレベル
+    void setLevel(float level) { level_.store(level); }
+    float getLevel() const { return level_.load(); }
+
+    //! ヒステリシス
+    /*! 立ち上がりの場合は level - hysteresis を下回ってから、立ち下がりの場合は level + hysteresis を上回ってから、
+     *  次のトリガーを受け付ける。ノイズによる誤検出を防ぐために使用する。
+     */
+    void setHysteresis(float hysteresis) { hysteresis_.store(std::max(hysteresis, 0.0f)); }
+    float getHysteresis() const { return hysteresis_.load(); }
+
+    //! フレームが確定してから、次のトリガーを受け付けるまでのサンプル数
+    void setHoldoff(std::int64_t num_samples) { holdoff_.store(std::max<std::int64_t>(num_samples, 0)); }
+    std::int64_t getHoldoff() const { return holdoff_.load(); }
+
+    //! トリガーの検出に使用するチャンネル
+    /*! AudioData のリングバッファのチャンネル番号で指定する。
+     */
+    void setSource(int channel) { source_.store(channel); }
+    int getSource() const { return source_.load(); }
+
+    //! フレームのうち、トリガー位置より前のデータが占める割合 (0.0 .. 1.0)
+    void setPreTrigger(float ratio) { pre_trigger_.store(std::min(std::max(ratio, 0.0f), 1.0f)); }
+    float getPreTrigger() const { return pre_trigger_.load(); }
+
+    //! フレームのサンプル数
+    void setFrameLength(std::int64_t num_samples) { frame_length_.store(std::max<std::int64_t>(num_samples, 1)); }
+    std::int64_t getFrameLength() const { return frame_length_.load(); }
+
+    //! トリガーの検出状態を初期化する。
+    void reset()
+    {
+        state_ = State::kIdle;
+        ignore_until_ = 0;
+    }
+
+    //! source のデータからトリガーを検出し、フレームが確定したら slot に公開する。
+    /*! @param source 設定されたチャンネルのデータ
+     *  @param position source の先頭のサンプルの、書き込み開始からの通算のサンプル位置
+     *  @param length source のサンプル数
+     *  @param max_frame_length フレームのサンプル数の上限（リングバッファの容量）
+     *  @pre [position, position + length) のデータがリングバッファに書き込み済みであること。
+     */
+    void process(float const *source, std::int64_t position, int length,
+                 std::int64_t max_frame_length, TriggeredFrameSlot &slot)
+    {
+        auto const mode = getMode();
+        if(mode == Mode::kOff) {
+            reset();
+            return;
+        }
+
+        if(state_ == State::kIdle) {
+            state_ = State::kWaitingForArm;
+        }
+
+        // 短いフレームは一つのブロックの中で確定することがあるので、確定したら同じブロックの残りから次のトリガーを探す。
+        // scan() は ignore_until_ 以降から探し、次のトリガーは前のトリガーより後になるので、このループは必ず終わる。
+        for( ; ; ) {
+            if(state_ != State::kCapturing) {
+                scan(mode, source, position, length, max_frame_length);
+                if(state_ != State::kCapturing) { return; }
+            }
+
+            // フレームの末尾まで書き込まれたら、フレームを確定させる。
+            auto const frame_end = frame_start_ + frame_length_in_use_;
+            if(position + length < frame_end) { return; }
+
+            slot.publish(frame_start_, frame_length_in_use_, trigger_position_);
+            state_ = State::kWaitingForArm;
+            ignore_until_ = frame_end + getHoldoff();
+        }
+    }
+
+private:
+    enum class State {
+        kIdle,
+        kWaitingForArm,
+        kArmed,
+        kCapturing,
+    };
+
+    std::atomic<int> mode_ { (int)Mode::kOff };
+    std::atomic<float> level_ { 0.0f };
+    std::atomic<float> hysteresis_ { 0.02f };
+    std::atomic<std::int64_t> holdoff_ { 0 };
+    std::atomic<int> source_ { 0 };
+    std::atomic<float> pre_trigger_ { 0.5f };
+    std::atomic<std::int64_t> frame_length_ { 1 };
+
+    // 以下はオーディオスレッドからのみアクセスする。
+    State state_ = State::kIdle;
+    std::int64_t ignore_until_ = 0;
+    std::int64_t trigger_position_ = 0;
+    std::int64_t frame_start_ = 0;
+    std::int64_t frame_length_in_use_ = 0;
+
+    void scan(Mode mode, float const *source, std::int64_t position, int length, std::int64_t max_frame_length)
+    {
+        auto const level = getLevel();
+        auto const hysteresis = getHysteresis();
+        bool const rising = (mode == Mode::kRising);
+
+        int i = (int)std::min<std::int64_t>(std::max<std::int64_t>(ignore_until_ - position, 0), length);
+
+        for( ; i < length; ++i) {
+            auto const x = source[i];
+
+            if(state_ == State::kWaitingForArm) {
+                if(rising ? (x < level - hysteresis) : (x > level + hysteresis)) {
+                    state_ = State::kArmed;
+                }
+            } else if(rising ? (x >= level) : (x <= level)) {
+                auto const frame_length = std::min(getFrameLength(), max_frame_length);
+                auto const num_pre = (std::int64_t)std::round(getPreTrigger() * frame_length);
+
+                trigger_position_ = position + i;
+                frame_start_ = trigger_position_ - num_pre;
+                frame_length_in_use_ = frame_length;
+                state_ = State::kCapturing;
+                return;
+            }
+        }
+    }
+};
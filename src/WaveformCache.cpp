@@ -0,0 +1,138 @@
+#include "WaveformCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+void WaveformCache::setLayout(int width, int height, double num_samples, int num_traces)
+{
+    if(width == width_ && height == height_ && num_samples == num_samples_ && num_traces == (int)traces_.size()) {
+        return;
+    }
+
+    bool const size_changed = (width != width_ || height != height_);
+
+    width_ = width;
+    height_ = height;
+    num_samples_ = num_samples;
+
+    // 画像はサイズが変わったときだけ作り直す。
+    traces_.resize(std::max(num_traces, 0));
+    for(auto &trace: traces_) {
+        trace.valid = false;
+        if(size_changed) { trace.image = juce::Image(); }
+    }
+}
+
+void WaveformCache::invalidate(int trace)
+{
+    if(trace < 0 || trace >= (int)traces_.size()) { return; }
+
+    traces_[trace].valid = false;
+}
+
+void WaveformCache::invalidateAll()
+{
+    for(auto &trace: traces_) {
+        trace.valid = false;
+    }
+}
+
+void WaveformCache::update(int trace, PeakPyramid const &pyramid, juce::Colour colour)
+{
+    if(trace < 0 || trace >= (int)traces_.size()) { return; }
+    if(width_ <= 0 || height_ <= 0 || num_samples_ <= 0) { return; }
+
+    auto &t = traces_[trace];
+    auto const samples_per_column = num_samples_ / width_;
+
+    // 右端の列に対応する、ピラミッドの粗いレベルのビンがすべて確定するのを待つために、最新の一列分は描画しない。
+    auto const end_column = (std::int64_t)std::floor(pyramid.getNumPushed() / samples_per_column) - 1;
+
+    if(t.image.isNull()) {
+        t.image = juce::Image(juce::Image::ARGB, width_, height_, true);
+        t.valid = false;
+    }
+
+    // 色が変わった場合や、ピラミッドが作り直されてデータが巻き戻った場合は、全体を描画し直す。
+    if(t.colour != colour || end_column < t.end_column) {
+        t.valid = false;
+    }
+
+    auto const num_new = t.valid
+    ? (int)std::min<std::int64_t>(end_column - t.end_column, width_)
+    : width_;
+
+    if(num_new <= 0) { return; }
+
+    // 描画済みの列を左にずらして、右端に新しい列の領域を空ける。
+    auto const new_area = juce::Rectangle<int>(width_ - num_new, 0, num_new, height_);
+    if(num_new < width_) {
+        t.image.moveImageSection(0, 0, num_new, 0, width_ - num_new, height_);
+    }
+    t.image.clear(new_area);
+
+    // 新しい列の直前の列も取得して、隙間を埋めるために使用する。
+    columns_.resize(num_new + 1);
+    pyramid.getColumns(end_column * samples_per_column, (num_new + 1) * samples_per_column, num_new + 1, columns_.data());
+
+    {
+        juce::Graphics g(t.image);
+        g.setColour(colour);
+        drawColumns(g, new_area, columns_.data() + 1, num_new, columns_[0]);
+    }
+
+    t.colour = colour;
+    t.end_column = end_column;
+    t.valid = true;
+}
+
+void WaveformCache::draw(juce::Graphics &g, int trace, juce::Point<int> position) const
+{
+    if(trace < 0 || trace >= (int)traces_.size()) { return; }
+
+    auto const &t = traces_[trace];
+    if(t.valid == false) { return; }
+
+    g.drawImageAt(t.image, position.x, position.y);
+}
+
+void WaveformCache::drawColumns(juce::Graphics &g,
+                                juce::Rectangle<int> bounds,
+                                PeakPyramid::Column const *columns,
+                                int num_columns,
+                                PeakPyramid::Column prev)
+{
+    auto const top = (float)bounds.getY();
+    auto const bottom = (float)bounds.getBottom();
+    auto const to_y = [&](float value) {
+        return juce::jmap<float>(juce::jlimit(-1.0f, 1.0f, value), -1.0f, 1.0f, bottom, top);
+    };
+
+    auto const colour = g.getCurrentColour();
+
+    for(int x = 0; x < num_columns; ++x) {
+        auto const &col = columns[x];
+        if(col.valid == false) {
+            prev = col;
+            continue;
+        }
+
+        // 隣の列との間に隙間ができないように、前の列の範囲とつなげる。
+        auto lo = col.min;
+        auto hi = col.max;
+        if(prev.valid) {
+            lo = std::min(lo, prev.max);
+            hi = std::max(hi, prev.min);
+        }
+
+        auto const px = bounds.getX() + x;
+        g.setColour(colour.withMultipliedAlpha(0.6f));
+        g.drawVerticalLine(px, to_y(hi), std::max(to_y(lo), to_y(hi) + 1.0f));
+        g.setColour(colour);
+        g.drawVerticalLine(px, to_y(col.rms), std::max(to_y(-col.rms), to_y(col.rms) + 1.0f));
+
+        prev = col;
+    }
+
+    g.setColour(colour);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <juce_graphics/juce_graphics.h>
+
+#include "PeakPyramid.h"
+
+#include <cstdint>
+#include <vector>
+
+// スクロールする波形の描画結果を、トレースごとに juce::Image として保持するクラス
+//
+// 各列は通算のサンプル位置に対して固定された範囲に対応させる。
+// update() では、前回の描画から新たに確定した列の数だけ画像を左にずらし、右端の新しい列だけを描画する。
+// 表示するサンプル数・画像のサイズ・トレースの数が変わった場合は、全体を描画し直す。
+struct WaveformCache
+{
+    //! 表示設定を指定する。前回と異なる場合は、すべてのトレースの描画結果を破棄する。
+    /*! @param width 波形の表示領域の幅
+     *  @param height 波形の表示領域の高さ
+     *  @param num_samples 表示領域の幅に表示するサンプル数
+     *  @param num_traces トレースの数
+     */
+    void setLayout(int width, int height, double num_samples, int num_traces);
+
+    //! 指定したトレースの描画結果を破棄して、次の update() で全体を描画し直すようにする。
+    void invalidate(int trace);
+
+    //! すべてのトレースの描画結果を破棄する。
+    void invalidateAll();
+
+    //! pyramid に追加されたデータまで、指定したトレースの描画を進める。
+    void update(int trace, PeakPyramid const &pyramid, juce::Colour colour);
+
+    //! 指定したトレースの描画結果を、 position を左上として描画する。
+    void draw(juce::Graphics &g, int trace, juce::Point<int> position) const;
+
+    //! 列ごとの最小値・最大値・RMS を、 bounds の x 座標から順に一列ずつ描画する。
+    /*! y 座標は bounds の上端を 1.0 、下端を -1.0 として決める。
+     *  隣の列との間に隙間ができないように、前の列の範囲とつなげて描画する。
+     *  @param prev columns[0] の直前の列。存在しない場合は Column::valid が false のもの
+     */
+    static void drawColumns(juce::Graphics &g,
+                            juce::Rectangle<int> bounds,
+                            PeakPyramid::Column const *columns,
+                            int num_columns,
+                            PeakPyramid::Column prev);
+
+private:
+    struct Trace
+    {
+        juce::Image image;
+        juce::Colour colour;
+        // 右端に描画済みの列の、通算の列番号の次の値
+        std::int64_t end_column = 0;
+        bool valid = false;
+    };
+
+    int width_ = 0;
+    int height_ = 0;
+    double num_samples_ = 0;
+    std::vector<Trace> traces_;
+    std::vector<PeakPyramid::Column> columns_;
+};
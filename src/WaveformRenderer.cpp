@@ -0,0 +1,440 @@
+#include "WaveformRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+WaveformRenderer::WaveformRenderer(AudioPluginAudioProcessor &processor, double history_seconds)
+:   juce::Thread("WaveformRenderer")
+,   processor_(processor)
+,   capture_reader_(history_seconds)
+,   xy_image_(juce::Image::SingleChannel, Goniometer::kGridSize, Goniometer::kGridSize, true)
+{}
+
+WaveformRenderer::~WaveformRenderer()
+{
+    stop();
+}
+
+void WaveformRenderer::start()
+{
+    startThread();
+}
+
+void WaveformRenderer::stop()
+{
+    stopThread(1000);
+}
+
+void WaveformRenderer::requestFrame(Settings const &settings)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(pending_) { ++num_dropped_; }
+
+        requested_ = settings;
+        pending_ = true;
+    }
+
+    notify();
+}
+
+std::uint64_t WaveformRenderer::getSequence() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sequence_;
+}
+
+void WaveformRenderer::drawLatest(juce::Graphics &g, juce::Point<int> position) const
+{
+    // juce::Image は参照カウントを持つハンドルなので、ロック中はハンドルの複製だけを行い、
+    // 転送はロックを解放してから行う。転送中に描画スレッドが公開を待たされないようにするため。
+    juce::Image image;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        image = front_;
+    }
+
+    if(image.isValid() == false) { return; }
+
+    g.drawImageAt(image, position.x, position.y);
+}
+
+WaveformRenderer::FrameInfo WaveformRenderer::getLatestInfo() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return front_info_;
+}
+
+std::int64_t WaveformRenderer::getNumDropped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_dropped_;
+}
+
+juce::Rectangle<int> WaveformRenderer::getXYBounds(juce::Rectangle<int> bounds, int index)
+{
+    auto const size = std::min(bounds.getWidth() / 2, bounds.getHeight());
+    auto const half = bounds.getWidth() / 2;
+    return juce::Rectangle<int>(size, size)
+        .withCentre({ bounds.getX() + half * index + half / 2, bounds.getCentreY() });
+}
+
+void WaveformRenderer::run()
+{
+    while(threadShouldExit() == false) {
+        wait(100);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(pending_ == false) { continue; }
+
+            settings_ = requested_;
+            pending_ = false;
+        }
+
+        render();
+    }
+}
+
+void WaveformRenderer::render()
+{
+    auto const sample_rate = processor_.getSampleRate();
+    auto const num_read = capture_reader_.update(processor_.getAudioData(), sample_rate);
+
+    // 読み込みの遅れと、読み込みが間に合わずに失われたデータの量を記録する。
+    // 最新のブロックの記録は、表示するデータの時刻とタイムライン上の位置を求めるのに使用する。
+    CaptureStamp stamp;
+    if(auto const *audio_data = capture_reader_.getAudioData()) {
+        auto const &reader = capture_reader_.getReader();
+        processor_.getTelemetry().recordReader(reader.getNumOverruns(),
+                                               reader.getNumDropped(),
+                                               audio_data->getBuffer().getNumWritten() - reader.getPosition());
+        stamp = audio_data->getCaptureStampSlot().load();
+    }
+
+    // 表示する長さのフレームをトリガーで確定させ、確定したフレームだけを読み込む。
+    // フレームの長さは Processor のサンプルレートで決まるので、メッセージスレッドから設定済みのものを使用する。
+    auto const &trigger = processor_.getTriggerEngine();
+    auto const trigger_enabled = trigger.getMode() != TriggerEngine::Mode::kOff;
+    auto const frame_updated = trigger_enabled && capture_reader_.updateFrame();
+
+    // トリガーが有効な場合は、最後に確定したフレームを表示する。
+    // XY 表示は新しいサンプルを順に残光に加えるので、トリガーに関係なく最新のデータを使用する。
+    auto const &s = settings_;
+    bool const xy = s.view != View::kWaveform;
+    bool const use_frame = trigger_enabled && capture_reader_.hasFrame() && xy == false;
+
+    // トランスポートに合わせる場合は、読み込んだ位置に対応するタイムライン上の位置から、
+    // 直前の num_samples の倍数の位置までを遅らせて表示する。
+    auto const reader_end = capture_reader_.getReader().getPosition();
+    bool const aligned = s.align_to_transport && xy == false && use_frame == false
+                      && stamp.sequence != 0 && stamp.is_playing && s.num_samples >= 1;
+    std::int64_t holdback = 0;
+    if(aligned) {
+        auto const period = (std::int64_t)std::round(s.num_samples);
+        auto const position = stamp.toTransportPosition(reader_end);
+        holdback = ((position % period) + period) % period;
+    }
+
+    if(xy) {
+        if(s.view != drawn_.view) {
+            for(auto &goniometer : goniometers_) { goniometer.reset(); }
+        }
+
+        updateGoniometers(num_read, s.view == View::kXYMidSide ? Goniometer::Mode::kMidSide : Goniometer::Mode::kLeftRight);
+    }
+
+    if(s.width <= 0 || s.height <= 0 || capture_reader_.getSampleRate() <= 0) { return; }
+
+    // 表示するデータも設定も変わっていなければ、前回の画像をそのまま使用する。
+    bool const layout_changed = has_drawn_ == false
+                             || s.width != drawn_.width
+                             || s.height != drawn_.height
+                             || s.num_samples != drawn_.num_samples
+                             || s.background != drawn_.background
+                             || s.use_scroll_cache != drawn_.use_scroll_cache
+                             || s.view != drawn_.view
+                             || s.trace_enabled != drawn_.trace_enabled
+                             || aligned != drawn_aligned_
+                             || use_frame != drawn_use_frame_;
+
+    bool const data_changed = use_frame ? frame_updated : num_read > 0;
+
+    if(layout_changed == false && data_changed == false) { return; }
+
+    // 表示を切り替えたトレースは、スクロール描画のキャッシュを描画し直す。
+    if(s.use_scroll_cache != drawn_.use_scroll_cache) {
+        waveform_cache_.invalidateAll();
+    } else {
+        for(int ch = 0; ch < (int)s.trace_enabled.size(); ++ch) {
+            if(ch >= (int)drawn_.trace_enabled.size() || s.trace_enabled[ch] != drawn_.trace_enabled[ch]) {
+                waveform_cache_.invalidate(ch);
+            }
+        }
+    }
+
+    drawn_ = s;
+    drawn_use_frame_ = use_frame;
+    drawn_aligned_ = aligned;
+    has_drawn_ = true;
+
+    // 入れ替えた直後の画像は、メッセージスレッドが drawLatest() で転送中の可能性がある。
+    // front_ から外れた画像のハンドルが新たに複製されることはないので、
+    // 参照がこのスレッドだけになっていなければ、上書きせずに新しい画像を用意する。
+    if(back_.getWidth() != s.width || back_.getHeight() != s.height || back_.getReferenceCount() > 1) {
+        back_ = juce::Image(juce::Image::RGB, s.width, s.height, false);
+    }
+
+    {
+        juce::Graphics g(back_);
+        g.fillAll(s.background);
+
+        if(xy) {
+            drawXY(g, back_.getBounds(), s);
+        } else {
+            drawTraces(g, back_.getBounds(), s, use_frame, holdback);
+        }
+    }
+
+    FrameInfo info;
+    if(use_frame) {
+        auto const &frame = capture_reader_.getFrame();
+        info.data_end = frame.start + frame.length;
+    } else {
+        // 補間して描画する場合は、 drawWaveform() で遅らせた分も含める。
+        info.data_end = reader_end - holdback;
+        if(xy == false && s.num_samples <= s.width) {
+            info.data_end = std::min<std::int64_t>(info.data_end, reader_end - SincInterpolator::kNumTaps / 2);
+        }
+    }
+
+    if(stamp.sequence != 0) {
+        info.data_time_ns = stamp.estimateTime(info.data_end, capture_reader_.getSampleRate());
+        info.has_transport = stamp.has_transport;
+        info.is_playing = stamp.is_playing;
+        info.transport_position = stamp.toTransportPosition(info.data_end);
+        info.host_transport_position = stamp.toTransportPosition(stamp.end);
+    }
+
+    // 描画が完了した画像を公開する。
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(front_, back_);
+    front_info_ = info;
+    ++sequence_;
+}
+
+void WaveformRenderer::drawTraces(juce::Graphics &g, juce::Rectangle<int> bounds, Settings const &s, bool use_frame,
+                                  std::int64_t holdback)
+{
+    double num_to_draw = s.num_samples;
+
+    if(use_frame) {
+        auto const &frame = capture_reader_.getFrame();
+        num_to_draw = (double)frame.length;
+
+        // トリガー位置とトリガーレベルを表示する。
+        auto const &trigger = processor_.getTriggerEngine();
+        auto const trigger_x = bounds.getX() + bounds.getWidth() * (double)(frame.trigger_position - frame.start) / frame.length;
+        auto const level_y = juce::jmap<float>(trigger.getLevel(), -1.0f, 1.0f, (float)bounds.getBottom(), (float)bounds.getY());
+        g.setColour(juce::Colours::grey);
+        g.drawVerticalLine((int)trigger_x, (float)bounds.getY(), (float)bounds.getBottom());
+        g.drawHorizontalLine((int)level_y, (float)bounds.getX(), (float)bounds.getRight());
+    }
+
+    auto const num_traces = std::min<int>(capture_reader_.getNumChannels(), (int)s.trace_enabled.size());
+
+    // フレームは表示のたびに全体が入れ替わるので、キャッシュはフリーランの場合だけ使用する。
+    // 1 ピクセルあたり 1 サンプル以下の場合は、サンプル間を補間して描画するので使用しない。
+    // トランスポートに合わせる場合も、表示範囲が一定の間隔で切り替わるので使用しない。
+    bool const use_cache = s.use_scroll_cache
+                        && use_frame == false
+                        && s.align_to_transport == false
+                        && num_to_draw > bounds.getWidth();
+
+    if(use_cache) {
+        waveform_cache_.setLayout(bounds.getWidth(), bounds.getHeight(), num_to_draw, num_traces);
+    }
+
+    // チャンネルごとに色相をずらして描画する。
+    for(int ch = 0; ch < num_traces; ++ch) {
+        if(s.trace_enabled[ch] == false) { continue; }
+
+        auto const &pyramid = use_frame
+        ? capture_reader_.getFramePyramid(ch)
+        : capture_reader_.getPyramid(ch);
+
+        auto const hue = (float)ch / num_traces;
+        auto const colour = juce::Colour(hue, 0.7f, 0.9f, 1.0f);
+
+        if(use_cache) {
+            waveform_cache_.update(ch, pyramid, colour);
+            waveform_cache_.draw(g, ch, bounds.getTopLeft());
+        } else {
+            g.setColour(colour);
+            drawWaveform(g, bounds, pyramid, num_to_draw, ch, use_frame == false, holdback);
+        }
+    }
+}
+
+void WaveformRenderer::updateGoniometers(std::int64_t num_read, Goniometer::Mode mode)
+{
+    auto const *audio_data = capture_reader_.getAudioData();
+    auto const sample_rate = capture_reader_.getSampleRate();
+    if(audio_data == nullptr || sample_rate <= 0 || num_read <= 0) { return; }
+
+    auto const num_main_channels = audio_data->getNumChannels();
+    if(num_main_channels <= 0) { return; }
+
+    // 経過した時間の分だけ減衰させる。時定数の数倍より古いサンプルはほとんど見えないので加算しない。
+    auto const factor = (float)std::exp(-num_read / (sample_rate * kPersistenceSeconds));
+    auto const num_samples = (int)std::min<std::int64_t>(num_read, (std::int64_t)(sample_rate * kPersistenceSeconds * 4));
+
+    xy_left_.resize(num_samples);
+    xy_right_.resize(num_samples);
+
+    for(int i = 0; i < (int)goniometers_.size(); ++i) {
+        // モノラルの場合は、同じチャンネルを L と R に使用する。
+        auto const left = num_main_channels * i;
+        auto const right = left + (num_main_channels > 1 ? 1 : 0);
+        if(right >= capture_reader_.getNumChannels()) { continue; }
+
+        auto const &left_pyramid = capture_reader_.getPyramid(left);
+        auto const &right_pyramid = capture_reader_.getPyramid(right);
+        auto const start = left_pyramid.getNumPushed() - num_samples;
+
+        goniometers_[i].decay(factor);
+
+        if(left_pyramid.getSamples(start, num_samples, xy_left_.data()) &&
+           right_pyramid.getSamples(start, num_samples, xy_right_.data()))
+        {
+            goniometers_[i].accumulate(xy_left_.data(), xy_right_.data(), num_samples, mode);
+        }
+    }
+}
+
+void WaveformRenderer::drawXY(juce::Graphics &g, juce::Rectangle<int> bounds, Settings const &s)
+{
+    auto const *audio_data = capture_reader_.getAudioData();
+    auto const sample_rate = capture_reader_.getSampleRate();
+    if(audio_data == nullptr || sample_rate <= 0) { return; }
+
+    auto const num_main_channels = audio_data->getNumChannels();
+    auto const num_traces = (int)s.trace_enabled.size();
+
+    // 格子 1 つあたりの平均の密度が、残光の時定数の間に格子の一辺の長さを描く程度の信号で見やすくなるようにする。
+    auto const exposure = (float)(Goniometer::kGridSize * 4 / (sample_rate * kPersistenceSeconds));
+
+    for(int i = 0; i < (int)goniometers_.size(); ++i) {
+        auto const left = num_main_channels * i;
+        auto const right = left + (num_main_channels > 1 ? 1 : 0);
+        if(right >= num_traces || (s.trace_enabled[left] == false && s.trace_enabled[right] == false)) { continue; }
+
+        auto const area = getXYBounds(bounds, i).toFloat();
+
+        // 軸と、モノラルの信号が描く線を表示する。
+        g.setColour(juce::Colours::grey.withAlpha(0.4f));
+        g.drawRect(area);
+        if(s.view == View::kXYMidSide) {
+            g.drawLine(area.getCentreX(), area.getY(), area.getCentreX(), area.getBottom());
+            g.drawLine(area.getX(), area.getCentreY(), area.getRight(), area.getCentreY());
+        } else {
+            g.drawLine(area.getX(), area.getBottom(), area.getRight(), area.getY());
+            g.drawLine(area.getX(), area.getY(), area.getRight(), area.getBottom());
+        }
+
+        // 輝度を透明度として、トレースの色で塗る。
+        goniometers_[i].toneMap(xy_image_, exposure);
+
+        auto const hue = (float)left / num_traces;
+        g.setColour(juce::Colour(hue, 0.7f, 0.9f, 1.0f));
+        g.drawImage(xy_image_, (int)area.getX(), (int)area.getY(), (int)area.getWidth(), (int)area.getHeight(),
+                    0, 0, Goniometer::kGridSize, Goniometer::kGridSize, true);
+    }
+}
+
+void WaveformRenderer::drawWaveform(juce::Graphics &g,
+                                    juce::Rectangle<int> bounds,
+                                    PeakPyramid const &pyramid,
+                                    double num_samples,
+                                    int trace,
+                                    bool live,
+                                    std::int64_t holdback)
+{
+    int const w = bounds.getWidth();
+    if(w <= 0 || num_samples <= 0) { return; }
+
+    auto const top = (float)bounds.getY();
+    auto const bottom = (float)bounds.getBottom();
+    auto const to_y = [&](float value) {
+        return juce::jmap<float>(juce::jlimit(-1.0f, 1.0f, value), -1.0f, 1.0f, bottom, top);
+    };
+
+    auto end = pyramid.getNumPushed() - holdback;
+
+    // 1 ピクセルあたり 1 サンプル以下の場合は、サンプル間を窓付き sinc 関数で補間して描画する。
+    if(num_samples <= w) {
+        constexpr int kHalfTaps = SincInterpolator::kNumTaps / 2;
+
+        // 最新のデータを表示する場合は、末尾のサンプルを補間するのに必要な後続のサンプルがまだないので、
+        // その分だけ表示範囲を遅らせる。
+        if(live) {
+            end = std::min<std::int64_t>(end, pyramid.getNumPushed() - kHalfTaps);
+        }
+
+        auto const start = end - num_samples;
+        auto const oldest = std::max<std::int64_t>(pyramid.getNumPushed() - pyramid.getCapacity(), 0);
+
+        if((int)interpolated_.size() <= trace) {
+            interpolated_.resize(trace + 1);
+        }
+
+        // 表示範囲か描画する幅が変わった場合だけ計算し直す。
+        auto &cache = interpolated_[trace];
+        if(cache.pyramid != &pyramid || cache.end != end || cache.num_samples != num_samples || cache.width != w) {
+            auto const fetch_start = std::max<std::int64_t>((std::int64_t)std::floor(start) - kHalfTaps, oldest);
+            auto const fetch_end = std::min<std::int64_t>(end + kHalfTaps, pyramid.getNumPushed());
+            if(fetch_end <= fetch_start) { return; }
+
+            cache.samples.resize(fetch_end - fetch_start);
+            if(pyramid.getSamples(fetch_start, fetch_end - fetch_start, cache.samples.data()) == false) { return; }
+
+            cache.values.resize(w + 1);
+            sinc_.process(cache.samples.data(), (std::int64_t)cache.samples.size(),
+                          start - fetch_start, num_samples / w, w + 1, cache.values.data());
+
+            cache.pyramid = &pyramid;
+            cache.end = end;
+            cache.num_samples = num_samples;
+            cache.width = w;
+            cache.samples_start = fetch_start;
+        }
+
+        juce::Path path;
+        path.startNewSubPath((float)bounds.getX(), to_y(cache.values[0]));
+        for(int x = 1; x <= w; ++x) {
+            path.lineTo((float)(bounds.getX() + x), to_y(cache.values[x]));
+        }
+
+        g.strokePath(path, juce::PathStrokeType(1.0f));
+
+        // サンプルの間隔が十分に広い場合は、実際のサンプルの位置に点を描画する。
+        auto const px_per_sample = w / num_samples;
+        if(px_per_sample >= 6.0) {
+            for(auto p = std::max<std::int64_t>((std::int64_t)std::ceil(start), cache.samples_start); p <= end; ++p) {
+                auto const i = p - cache.samples_start;
+                if(i >= (std::int64_t)cache.samples.size()) { break; }
+
+                auto const x = bounds.getX() + (float)((p - start) * px_per_sample);
+                g.fillEllipse(x - 2.0f, to_y(cache.samples[i]) - 2.0f, 4.0f, 4.0f);
+            }
+        }
+
+        return;
+    }
+
+    // 1 ピクセルあたり複数のサンプルがある場合は、ピラミッドから各列の最小値・最大値・RMS を取得して描画する。
+    columns_.resize(w);
+    pyramid.getColumns((double)end, num_samples, w, columns_.data());
+
+    WaveformCache::drawColumns(g, bounds, columns_.data(), w, PeakPyramid::Column {});
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "PluginProcessor.h"
+#include "CaptureReader.h"
+#include "Goniometer.h"
+#include "SincInterpolator.h"
+#include "WaveformCache.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 波形の描画をメッセージスレッドとは別のスレッドで行うクラス
+//
+// 描画スレッドは自身の CaptureReader で AudioData から最新のデータを読み込み、表示するトレースを juce::Image に描画する。
+// 描画先の画像は 2 枚を交互に使用し（転送中でまだ参照されている画像は上書きせずに作り直す）、描画が完了した画像だけを公開するので、
+// メッセージスレッドは drawLatest() で完成した画像を転送するだけで済み、描画が遅くてもホストの GUI を止めない。
+//
+// 描画の要求は requestFrame() で行う。描画中に届いた要求は、最新の設定のものだけを次に描画し、
+// 間に届いた古い要求は待たせずに破棄する。
+struct WaveformRenderer
+:   private juce::Thread
+{
+    //! 表示の種類
+    enum class View : int {
+        //! 時間軸の波形
+        kWaveform = 1,
+        //! エフェクト処理前後のステレオの 2 チャンネルを、 L / R を軸とする XY 平面に表示する。
+        kXYLeftRight,
+        //! kXYLeftRight を 45 度回転して、縦軸を Mid 、横軸を Side とする。
+        kXYMidSide,
+    };
+
+    //! XY 表示の残光の時定数 [秒]
+    static constexpr double kPersistenceSeconds = 0.15;
+
+    //! 描画の設定
+    struct Settings
+    {
+        //! 描画する画像の大きさ
+        int width = 0;
+        int height = 0;
+        //! フリーランの場合に、画像の幅に表示するサンプル数
+        double num_samples = 0;
+        //! AudioData のリングバッファの各チャンネルを描画するかどうか
+        std::vector<bool> trace_enabled;
+        //! 背景色
+        juce::Colour background;
+        //! フリーランの場合に、描画済みの波形をスクロールさせて再利用するかどうか
+        bool use_scroll_cache = true;
+        View view = View::kWaveform;
+        //! フリーランでホストが再生中の場合に、画像の右端をトランスポートの位置が num_samples の倍数になる位置に合わせるかどうか
+        bool align_to_transport = false;
+    };
+
+    //! 描画が完了した画像についての情報
+    struct FrameInfo
+    {
+        //! 画像に描画した最新のサンプルの、リングバッファ上の通算のサンプル位置
+        std::int64_t data_end = 0;
+        //! そのサンプルが読み込めるようになった時刻の推定値 [ns] 。 Processor からの記録がない場合は 0
+        std::int64_t data_time_ns = 0;
+        //! ホストからトランスポートの位置を取得できたかどうかと、再生中かどうか
+        bool has_transport = false;
+        bool is_playing = false;
+        //! data_end に対応するタイムライン上の位置 [samples]
+        std::int64_t transport_position = 0;
+        //! 描画した時点で Processor が書き込み終えていた位置に対応する、タイムライン上の位置 [samples]
+        std::int64_t host_transport_position = 0;
+    };
+
+    //! コンストラクタ
+    /*! @param history_seconds 描画用に保持するデータの長さ [秒]
+     */
+    WaveformRenderer(AudioPluginAudioProcessor &processor, double history_seconds);
+    ~WaveformRenderer() override;
+
+    //! 描画スレッドを開始・停止する。
+    void start();
+    void stop();
+
+    //! 最新のデータを settings の設定で描画するように要求する。
+    /*! まだ描画されていない要求がある場合、その要求は破棄されて今回の要求に置き換わる。
+     */
+    void requestFrame(Settings const &settings);
+
+    //! 描画が完了した画像の通し番号。新しい画像が完成するたびに増える。
+    std::uint64_t getSequence() const;
+
+    //! 描画が完了した最新の画像を、 position を左上として描画する。
+    void drawLatest(juce::Graphics &g, juce::Point<int> position) const;
+
+    //! 描画が完了した最新の画像についての情報を返す。
+    FrameInfo getLatestInfo() const;
+
+    //! 描画が間に合わずに破棄した要求の数
+    std::int64_t getNumDropped() const;
+
+    //! XY 表示で、エフェクト処理前 (index = 0) と処理後 (index = 1) を表示する正方形の領域を返す。
+    static juce::Rectangle<int> getXYBounds(juce::Rectangle<int> bounds, int index);
+
+private:
+    // サンプル間を補間して描画する場合の、トレースごとの計算結果
+    // 表示するデータの範囲と描画する幅が変わらない間は、計算し直さずに再利用する。
+    struct InterpolatedTrace
+    {
+        PeakPyramid const *pyramid = nullptr;
+        std::int64_t end = -1;
+        double num_samples = 0;
+        int width = 0;
+        //! 描画する範囲の各ピクセルの位置（右端を含む）で補間した値
+        std::vector<float> values;
+        //! 補間に使用したサンプル列と、その先頭の通算サンプル位置
+        std::vector<float> samples;
+        std::int64_t samples_start = 0;
+    };
+
+    AudioPluginAudioProcessor &processor_;
+
+    // 以下は mutex_ で保護する。
+    mutable std::mutex mutex_;
+    Settings requested_;
+    bool pending_ = false;
+    std::int64_t num_dropped_ = 0;
+    // 描画が完了した画像と、その通し番号
+    juce::Image front_;
+    FrameInfo front_info_;
+    std::uint64_t sequence_ = 0;
+
+    // 以下は描画スレッドだけが使用する。
+    CaptureReader capture_reader_;
+    Settings settings_;
+    // 描画中の画像
+    juce::Image back_;
+    std::vector<PeakPyramid::Column> columns_;
+    // フリーランで 1 ピクセルあたり複数のサンプルを表示する場合に使用する、スクロール描画のキャッシュ
+    WaveformCache waveform_cache_;
+    SincInterpolator sinc_;
+    std::vector<InterpolatedTrace> interpolated_;
+    // XY 表示の、エフェクト処理前と処理後の残光
+    std::array<Goniometer, 2> goniometers_;
+    juce::Image xy_image_;
+    std::vector<float> xy_left_;
+    std::vector<float> xy_right_;
+    // 最後に描画したときの設定
+    Settings drawn_;
+    bool drawn_use_frame_ = false;
+    bool drawn_aligned_ = false;
+    bool has_drawn_ = false;
+
+    void run() override;
+
+    //! 新しいデータがあるか設定が変わっていれば back_ に描画して front_ と入れ替える。
+    void render();
+
+    //! 有効なトレースの波形を描画する。 use_frame が true の場合は、トリガーで確定したフレームを描画する。
+    /*! holdback はフリーランの場合に、最新のデータから遅らせて表示するサンプル数
+     */
+    void drawTraces(juce::Graphics &g, juce::Rectangle<int> bounds, Settings const &s, bool use_frame,
+                    std::int64_t holdback);
+
+    //! 新たに読み込んだ num_read サンプルを XY 表示の残光に加える。
+    void updateGoniometers(std::int64_t num_read, Goniometer::Mode mode);
+    void drawXY(juce::Graphics &g, juce::Rectangle<int> bounds, Settings const &s);
+
+    void drawWaveform(juce::Graphics &g, juce::Rectangle<int> bounds, PeakPyramid const &pyramid, double num_samples,
+                      int trace, bool live, std::int64_t holdback);
+};
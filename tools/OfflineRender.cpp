@@ -0,0 +1,264 @@
+// AudioPluginAudioProcessor でオーディオファイルを実時間より速く処理するコマンドラインツール
+//
+// メッセージスレッドやエディタを使用せずに、 prepareToPlay() / processBlock() を大きなブロックサイズで繰り返し呼び出す。
+// 処理後のオーディオと、エフェクト処理前後の波形を間引いたトレースファイル (CSV) を出力する。
+// --telemetry を指定すると、 processBlock() の処理時間の集計結果 (CSV) も出力する。
+//
+// usage: SimpleOscilloscopeRender --input <file> --output <file> [--trace <file.csv>] [--telemetry <file.csv>]
+//                                 [--cutoff <Hz>] [--slope <12|24|48>] [--block-size <samples>] [--decimation <samples>]
+
+#include "PluginProcessor.h"
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Options
+{
+    juce::File input;
+    juce::File output;
+    juce::File trace;
+    juce::File telemetry;
+    double cutoff_hz = -1;
+    // フィルタの傾き [dB/oct]
+    int slope_db = 12;
+    int block_size = 8192;
+    int decimation = 256;
+};
+
+void printUsage(char const *app)
+{
+    std::fprintf(stderr,
+                 "usage: %s --input <file> --output <file> [--trace <file.csv>] [--telemetry <file.csv>]\n"
+                 "          [--cutoff <Hz>] [--slope <12|24|48>] [--block-size <samples>] [--decimation <samples>]\n",
+                 app);
+}
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if(i + 1 >= argc) { return false; }
+
+        auto const value = juce::String(argv[++i]);
+        auto const path = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+
+        if(arg == "--input") { opts.input = path; }
+        else if(arg == "--output") { opts.output = path; }
+        else if(arg == "--trace") { opts.trace = path; }
+        else if(arg == "--telemetry") { opts.telemetry = path; }
+        else if(arg == "--cutoff") { opts.cutoff_hz = value.getDoubleValue(); }
+        else if(arg == "--slope") { opts.slope_db = value.getIntValue(); }
+        else if(arg == "--block-size") { opts.block_size = value.getIntValue(); }
+        else if(arg == "--decimation") { opts.decimation = value.getIntValue(); }
+        else { return false; }
+    }
+
+    return opts.input != juce::File() && opts.output != juce::File()
+        && opts.block_size > 0 && opts.decimation > 0
+        && (opts.slope_db == 12 || opts.slope_db == 24 || opts.slope_db == 48);
+}
+
+//! エフェクト処理前後のデータを decimation サンプルごとの最小値・最大値に間引いて CSV に書き出すクラス
+struct TraceWriter
+{
+    TraceWriter(juce::File const &file, AudioData const &audio_data, int decimation)
+    :   num_channels_((int)audio_data.getBuffer().getNumChannels())
+    ,   decimation_(decimation)
+    ,   mins_(num_channels_)
+    ,   maxs_(num_channels_)
+    {
+        file.deleteFile();
+        stream_ = file.createOutputStream();
+        if(stream_ == nullptr) { return; }
+
+        *stream_ << "position";
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            auto const name = audio_data.getChannelName(ch).toLowerCase().replaceCharacter(' ', '_');
+            *stream_ << "," << name << "_min," << name << "_max";
+        }
+        *stream_ << "\n";
+
+        reset();
+    }
+
+    bool isOpen() const { return stream_ != nullptr; }
+
+    void push(float const * const * data, std::int64_t position, std::int64_t length)
+    {
+        if(stream_ == nullptr) { return; }
+
+        for(std::int64_t i = 0; i < length; ++i) {
+            if(num_accumulated_ == 0) { start_ = position + i; }
+
+            for(int ch = 0; ch < num_channels_; ++ch) {
+                mins_[ch] = std::min(mins_[ch], data[ch][i]);
+                maxs_[ch] = std::max(maxs_[ch], data[ch][i]);
+            }
+
+            if(++num_accumulated_ == decimation_) { flush(); }
+        }
+    }
+
+    void flush()
+    {
+        if(stream_ == nullptr || num_accumulated_ == 0) { return; }
+
+        *stream_ << juce::String(start_);
+        for(int ch = 0; ch < num_channels_; ++ch) {
+            *stream_ << "," << juce::String(mins_[ch], 6) << "," << juce::String(maxs_[ch], 6);
+        }
+        *stream_ << "\n";
+
+        reset();
+    }
+
+private:
+    std::unique_ptr<juce::FileOutputStream> stream_;
+    int num_channels_ = 0;
+    int decimation_ = 0;
+    int num_accumulated_ = 0;
+    std::int64_t start_ = 0;
+    std::vector<float> mins_;
+    std::vector<float> maxs_;
+
+    void reset()
+    {
+        num_accumulated_ = 0;
+        std::fill(mins_.begin(), mins_.end(), std::numeric_limits<float>::max());
+        std::fill(maxs_.begin(), maxs_.end(), std::numeric_limits<float>::lowest());
+    }
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if(parseOptions(argc, argv, opts) == false) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    juce::AudioFormatManager afm;
+    afm.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(afm.createReaderFor(opts.input));
+    if(reader == nullptr) {
+        std::fprintf(stderr, "failed to open %s\n", opts.input.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    // ファイルのチャンネル数をそのままメインバスのチャンネル数とする。
+    int const num_channels = (int)reader->numChannels;
+    if(num_channels < 1 || num_channels > AudioPluginAudioProcessor::kMaxChannelsPerBus) {
+        std::fprintf(stderr, "unsupported channel count: %d\n", num_channels);
+        return 1;
+    }
+
+    auto const sample_rate = reader->sampleRate;
+    auto const total_length = (std::int64_t)reader->lengthInSamples;
+
+    auto *format = afm.findFormatForFileExtension(opts.output.getFileExtension());
+    if(format == nullptr) {
+        std::fprintf(stderr, "unsupported output format: %s\n", opts.output.getFileName().toRawUTF8());
+        return 1;
+    }
+
+    opts.output.deleteFile();
+    auto out_stream = opts.output.createOutputStream();
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    if(out_stream != nullptr) {
+        writer.reset(format->createWriterFor(out_stream.get(), sample_rate, num_channels,
+                                             (int)reader->bitsPerSample, {}, 0));
+    }
+
+    if(writer == nullptr) {
+        std::fprintf(stderr, "failed to create %s\n", opts.output.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    // writer が出力ストリームの所有権を持つ。
+    out_stream.release();
+
+    AudioPluginAudioProcessor processor;
+    processor.setPlayConfigDetails(num_channels, num_channels, sample_rate, opts.block_size);
+
+    // パラメータの変化がスムージングされないように、 prepareToPlay() の前にカットオフ周波数を設定する。
+    if(opts.cutoff_hz > 0) {
+        *processor.cutoff_ = processor.HzToParam((float)opts.cutoff_hz);
+    }
+
+    // 選択肢のインデックスの 0, 1, 2 が、 12, 24, 48 dB/oct を表す。
+    *processor.slope_ = opts.slope_db == 48 ? 2 : opts.slope_db / 12 - 1;
+
+    processor.prepareToPlay(sample_rate, opts.block_size);
+
+    auto audio_data = processor.getAudioData();
+    auto trace_reader = audio_data->getBuffer().createReader();
+    auto const num_trace_channels = (int)audio_data->getBuffer().getNumChannels();
+    juce::AudioSampleBuffer trace_buffer(num_trace_channels, opts.block_size);
+
+    std::unique_ptr<TraceWriter> trace;
+    if(opts.trace != juce::File()) {
+        trace = std::make_unique<TraceWriter>(opts.trace, *audio_data, opts.decimation);
+        if(trace->isOpen() == false) {
+            std::fprintf(stderr, "failed to create %s\n", opts.trace.getFullPathName().toRawUTF8());
+            return 1;
+        }
+    }
+
+    juce::AudioSampleBuffer buffer(num_channels, opts.block_size);
+    juce::MidiBuffer midi;
+
+    auto const begin = std::chrono::steady_clock::now();
+
+    for(std::int64_t pos = 0; pos < total_length; pos += opts.block_size) {
+        auto const length = (int)std::min<std::int64_t>(opts.block_size, total_length - pos);
+
+        buffer.setSize(num_channels, length, false, false, true);
+        reader->read(&buffer, 0, length, pos, true, true);
+
+        processor.processBlock(buffer, midi);
+
+        writer->writeFromAudioSampleBuffer(buffer, 0, length);
+
+        // リングバッファの容量はブロックサイズより大きいので、ブロックごとに読み込めばデータは失われない。
+        if(trace != nullptr) {
+            auto const result = audio_data->getBuffer().read(trace_reader, trace_buffer.getArrayOfWritePointers(), 0, length);
+            trace->push(trace_buffer.getArrayOfReadPointers(), result.position, result.num_read);
+        }
+    }
+
+    if(trace != nullptr) { trace->flush(); }
+
+    if(opts.telemetry != juce::File()) {
+        auto const csv = processor.getTelemetry().getSnapshot().toCsv();
+        if(opts.telemetry.replaceWithText(juce::String(csv)) == false) {
+            std::fprintf(stderr, "failed to write %s\n", opts.telemetry.getFullPathName().toRawUTF8());
+        }
+    }
+
+    processor.releaseResources();
+    writer.reset();
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    auto const duration = total_length / sample_rate;
+
+    std::printf("processed %.3f s of audio in %.3f s (realtime factor: %.1fx)\n",
+                duration, elapsed, elapsed > 0 ? duration / elapsed : 0.0);
+
+    if(trace_reader.getNumDropped() > 0) {
+        std::fprintf(stderr, "warning: %lld samples were dropped from the trace\n", (long long)trace_reader.getNumDropped());
+    }
+
+    return 0;
+}
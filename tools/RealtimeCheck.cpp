@@ -0,0 +1,220 @@
+// processBlock() の中でメモリの確保やロックの待機、ブロックするシステムコールが行われていないかを検査するコマンドラインツール
+//
+// SIMPLE_OSCILLOSCOPE_RT_CHECK を ON にしてビルドした場合だけ作成される。
+// いくつかのチャンネル数（サイドチェインの有無を含む）とブロックサイズの組み合わせについて、エディタと同じようにリングバッファを読み込むスレッドや、
+// スペクトル解析・録音・履歴の書き込みスレッド、パラメータを変更し続けるスレッドを動かしながら、
+// ランダムな長さのブロックで processBlock() を繰り返し呼び出す。
+// 違反が一つでもあれば、スタックトレースを標準エラー出力に出力して、終了コード 1 で終了する。
+//
+// usage: SimpleOscilloscopeRealtimeCheck [--quick] [--blocks <count>]
+
+#include "PluginProcessor.h"
+#include "CaptureReader.h"
+#include "HistoryStore.h"
+#include "RealtimeChecker.h"
+#include "Recorder.h"
+#include "SpectrumAnalyzer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// RealtimeInterpose.cpp で定義する。置き換えた関数の本来の関数を、リアルタイム区間に入る前に解決する。
+void resolveRealFunctions();
+
+namespace
+{
+
+constexpr double kSampleRate = 48000.0;
+
+struct Options
+{
+    bool quick = false;
+    // 組み合わせごとに processBlock() を呼び出す回数
+    int num_blocks = 20000;
+};
+
+void printUsage(char const *app)
+{
+    std::fprintf(stderr, "usage: %s [--quick] [--blocks <count>]\n", app);
+}
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+
+        if(arg == "--quick") {
+            opts.quick = true;
+            opts.num_blocks = 2000;
+        } else if(arg == "--blocks" && i + 1 < argc) {
+            opts.num_blocks = std::atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+
+    return opts.num_blocks > 0;
+}
+
+//! 検査するバスのチャンネル数
+struct ChannelConfig
+{
+    int num_channels;
+    //! サイドチェインのチャンネル数。 0 の場合はサイドチェインを無効にする。
+    int num_sidechain_channels;
+};
+
+//! config のチャンネル数のバスと max_block_size のブロックサイズで processBlock() を検査する。
+/*! @return 違反が見つからなかった場合は true
+ */
+bool runConfig(Options const &opts, ChannelConfig const &config, int max_block_size, std::uint32_t seed)
+{
+    RealtimeChecker::reset();
+
+    auto const num_channels = config.num_channels;
+
+    AudioPluginAudioProcessor processor;
+    processor.setPlayConfigDetails(num_channels, num_channels, kSampleRate, max_block_size);
+    if(config.num_sidechain_channels > 0) {
+        processor.getBus(true, 1)->setCurrentLayout(juce::AudioChannelSet::canonicalChannelSet(config.num_sidechain_channels));
+    }
+
+    processor.prepareToPlay(kSampleRate, max_block_size);
+    processor.getTriggerEngine().setMode(TriggerEngine::Mode::kRising);
+
+    // 書き込みスレッドを持つものは、エディタから操作されたときと同じように開始しておく。
+    auto const work_dir = juce::File::getSpecialLocation(juce::File::tempDirectory)
+        .getChildFile("SimpleOscilloscopeRealtimeCheck");
+    work_dir.createDirectory();
+
+    processor.getRecorder().start(work_dir.getChildFile("record.raw"), Recorder::Format::kRawFloat);
+    processor.getHistory().start(work_dir, 10.0);
+
+    auto const num_capture_channels = (int)processor.getAudioData()->getBuffer().getNumChannels();
+    SpectrumAnalyzer analyzer(processor, 256);
+    analyzer.setChannelsEnabled(std::vector<bool>(num_capture_channels, true));
+    analyzer.start();
+
+    std::atomic<bool> stop { false };
+
+    // エディタのタイマーと同じように、リングバッファとトリガーされたフレームを読み込み続ける。
+    std::thread reader([&] {
+        CaptureReader capture_reader(2.0);
+        while(stop.load() == false) {
+            capture_reader.update(processor.getAudioData(), kSampleRate);
+            capture_reader.updateFrame();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // ホストのオートメーションやエディタの操作を模して、メッセージスレッド側からパラメータを変更し続ける。
+    std::thread automation([&] {
+        int step = 0;
+        while(stop.load() == false) {
+            processor.cutoff_->setValueNotifyingHost(0.5f + 0.5f * (float)std::sin(step * 0.05));
+            if(step % 50 == 0) {
+                processor.slope_->setValueNotifyingHost(processor.slope_->convertTo0to1((float)((step / 50) % 3)));
+            }
+
+            ++step;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    // サイドチェインを含む、 processBlock() に渡されるすべてのチャンネル
+    // prepareToPlay() で指定したより長いブロックを渡すホストもあるので、その 2 倍までの長さで検査する。
+    auto const num_buffer_channels = processor.getTotalNumInputChannels();
+    juce::AudioSampleBuffer buffer(num_buffer_channels, max_block_size * 2);
+    juce::MidiBuffer midi;
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> block_length(1, max_block_size * 2);
+    std::uniform_real_distribution<float> noise(-0.1f, 0.1f);
+    double phase = 0;
+
+    for(int i = 0; i < opts.num_blocks; ++i) {
+        auto const length = block_length(rng);
+
+        // メモリを確保しないように、ブロックの長さは確保済みの範囲で変更する。
+        buffer.setSize(num_buffer_channels, length, false, false, true);
+        for(int n = 0; n < length; ++n) {
+            auto const value = 0.5f * (float)std::sin(phase) + noise(rng);
+            phase += 2.0 * juce::MathConstants<double>::pi * 440.0 / kSampleRate;
+            for(int ch = 0; ch < num_buffer_channels; ++ch) {
+                buffer.setSample(ch, n, value);
+            }
+        }
+
+        {
+            // ホストがオーディオスレッドからパラメータを変更する場合と同じ経路も検査する。
+            RealtimeChecker::ScopedRealtimeSection realtime_section;
+            static_cast<juce::AudioProcessorParameter *>(processor.cutoff_)->setValue((float)(i % 100) / 100.0f);
+        }
+
+        processor.processBlock(buffer, midi);
+    }
+
+    stop.store(true);
+    reader.join();
+    automation.join();
+    analyzer.stop();
+    processor.getRecorder().stop();
+    processor.getHistory().stop();
+    processor.releaseResources();
+    work_dir.deleteRecursively();
+
+    auto const num_violations = RealtimeChecker::getNumViolations();
+    std::printf("channels: %d, sidechain: %d, max block size: %5d, blocks: %d, violations: %lld\n",
+                num_channels, config.num_sidechain_channels, max_block_size, opts.num_blocks, (long long)num_violations);
+
+    for(auto const &v : RealtimeChecker::getViolations()) {
+        std::fprintf(stderr, "%s\n", RealtimeChecker::format(v).c_str());
+    }
+
+    if(num_violations > RealtimeChecker::kMaxViolations) {
+        std::fprintf(stderr, "(%lld more violations are not shown)\n",
+                     (long long)(num_violations - RealtimeChecker::kMaxViolations));
+    }
+
+    return num_violations == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if(parseOptions(argc, argv, opts) == false) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    resolveRealFunctions();
+
+    // backtrace() は最初の呼び出しでライブラリを読み込んでメモリを確保するので、リアルタイム区間の外で一度呼び出しておく。
+    {
+        RealtimeChecker::ScopedRealtimeSection realtime_section;
+        RealtimeChecker::onBlockingCall("warm up");
+    }
+    RealtimeChecker::reset();
+
+    std::vector<ChannelConfig> const channel_configs = { { 1, 0 }, { 2, 0 }, { 6, 0 }, { 2, 2 } };
+    std::vector<int> const block_sizes = opts.quick ? std::vector<int> { 512 } : std::vector<int> { 64, 512, 4096 };
+
+    bool passed = true;
+    std::uint32_t seed = 1;
+    for(auto const &config : channel_configs) {
+        for(auto max_block_size : block_sizes) {
+            passed = runConfig(opts, config, max_block_size, seed++) && passed;
+        }
+    }
+
+    std::printf("%s\n", passed ? "no realtime violations" : "realtime violations found");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,429 @@
+// リアルタイム区間で行ってはいけない処理を検出するために、標準ライブラリの関数を置き換える。
+//
+// SimpleOscilloscopeRealtimeCheck にだけリンクする。
+// Linux (glibc) では、メモリ管理関数と、ロック・待機・スリープ・ファイルを開く・読み書きする関数を同名の関数で置き換え、
+// RealtimeChecker::onBlockingCall() を呼び出してから本来の関数を呼び出す。
+// それ以外の環境では operator new / delete （アライメントを指定するものを含む）だけを置き換える。
+//
+// <unistd.h> や <fcntl.h> は _FORTIFY_SOURCE が有効な場合に read() や open() をインライン関数として定義するため、
+// このファイルではそれらをインクルードせずに、置き換える関数を直接宣言する。
+
+#include "RealtimeChecker.h"
+
+#include <cstdarg>
+#include <cstddef>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_MSC_VER)
+  #include <malloc.h>
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__)
+  #define SIMPLE_OSCILLOSCOPE_RT_INTERPOSE 1
+  #include <dlfcn.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <semaphore.h>
+  #include <stdio.h>
+  #include <sys/types.h>
+  #include <time.h>
+#endif
+
+#if defined(SIMPLE_OSCILLOSCOPE_RT_INTERPOSE)
+
+// glibc が提供する、置き換える前のメモリ管理関数
+extern "C" {
+void * __libc_malloc(std::size_t size);
+void __libc_free(void *p);
+void * __libc_calloc(std::size_t n, std::size_t size);
+void * __libc_realloc(void *p, std::size_t size);
+void * __libc_memalign(std::size_t alignment, std::size_t size);
+}
+
+namespace
+{
+
+//! 置き換える前の関数を dlsym() で探す。
+/*! dlsym() はメモリを確保することがあるので、 resolveRealFunctions() でリアルタイム区間に入る前にすべて解決しておく。
+ */
+template<class Func>
+Func findNext(Func &cache, char const *name)
+{
+    if(cache == nullptr) {
+        cache = reinterpret_cast<Func>(dlsym(RTLD_NEXT, name));
+    }
+
+    return cache;
+}
+
+using MutexFunc = int (*)(pthread_mutex_t *);
+using RwlockFunc = int (*)(pthread_rwlock_t *);
+using CondWaitFunc = int (*)(pthread_cond_t *, pthread_mutex_t *);
+using CondTimedWaitFunc = int (*)(pthread_cond_t *, pthread_mutex_t *, timespec const *);
+using SemWaitFunc = int (*)(sem_t *);
+using NanosleepFunc = int (*)(timespec const *, timespec *);
+using ClockNanosleepFunc = int (*)(clockid_t, int, timespec const *, timespec *);
+using UsleepFunc = int (*)(useconds_t);
+using SchedYieldFunc = int (*)();
+using ReadFunc = ssize_t (*)(int, void *, std::size_t);
+using WriteFunc = ssize_t (*)(int, void const *, std::size_t);
+using OpenFunc = int (*)(char const *, int, ...);
+using OpenatFunc = int (*)(int, char const *, int, ...);
+using FopenFunc = FILE * (*)(char const *, char const *);
+using CloseFunc = int (*)(int);
+
+MutexFunc real_pthread_mutex_lock;
+RwlockFunc real_pthread_rwlock_rdlock;
+RwlockFunc real_pthread_rwlock_wrlock;
+CondWaitFunc real_pthread_cond_wait;
+CondTimedWaitFunc real_pthread_cond_timedwait;
+SemWaitFunc real_sem_wait;
+NanosleepFunc real_nanosleep;
+ClockNanosleepFunc real_clock_nanosleep;
+UsleepFunc real_usleep;
+SchedYieldFunc real_sched_yield;
+ReadFunc real_read;
+WriteFunc real_write;
+OpenFunc real_open;
+OpenFunc real_open64;
+OpenatFunc real_openat;
+OpenatFunc real_openat64;
+FopenFunc real_fopen;
+FopenFunc real_fopen64;
+CloseFunc real_close;
+
+//! open() 系の関数の可変長引数から、ファイルのモードを取り出す。
+/*! O_CREAT (0100) または O_TMPFILE (020200000) を指定した場合だけ、ファイルのモードが渡される。
+ */
+bool hasOpenMode(int flags)
+{
+    return (flags & 0100) != 0 || (flags & 020200000) == 020200000;
+}
+
+// pthread_cond_* は複数のバージョンのシンボルがあるので、 pthread_cond_t の現在の実装に対応するものを探す。
+template<class Func>
+Func findNextCond(Func &cache, char const *name)
+{
+    if(cache == nullptr) {
+        cache = reinterpret_cast<Func>(dlvsym(RTLD_NEXT, name, "GLIBC_2.3.2"));
+    }
+
+    return findNext(cache, name);
+}
+
+} // namespace
+
+void resolveRealFunctions()
+{
+    findNext(real_pthread_mutex_lock, "pthread_mutex_lock");
+    findNext(real_pthread_rwlock_rdlock, "pthread_rwlock_rdlock");
+    findNext(real_pthread_rwlock_wrlock, "pthread_rwlock_wrlock");
+    findNextCond(real_pthread_cond_wait, "pthread_cond_wait");
+    findNextCond(real_pthread_cond_timedwait, "pthread_cond_timedwait");
+    findNext(real_sem_wait, "sem_wait");
+    findNext(real_nanosleep, "nanosleep");
+    findNext(real_clock_nanosleep, "clock_nanosleep");
+    findNext(real_usleep, "usleep");
+    findNext(real_sched_yield, "sched_yield");
+    findNext(real_read, "read");
+    findNext(real_write, "write");
+    findNext(real_open, "open");
+    findNext(real_open64, "open64");
+    findNext(real_openat, "openat");
+    findNext(real_openat64, "openat64");
+    findNext(real_fopen, "fopen");
+    findNext(real_fopen64, "fopen64");
+    findNext(real_close, "close");
+}
+
+extern "C" {
+
+void * malloc(std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("malloc");
+    return __libc_malloc(size);
+}
+
+void free(void *p) noexcept
+{
+    // free(nullptr) は何もしないので違反としない。
+    if(p != nullptr) { RealtimeChecker::onBlockingCall("free"); }
+    __libc_free(p);
+}
+
+void * calloc(std::size_t n, std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("calloc");
+    return __libc_calloc(n, size);
+}
+
+void * realloc(void *p, std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("realloc");
+    return __libc_realloc(p, size);
+}
+
+void * memalign(std::size_t alignment, std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, std::size_t alignment, std::size_t size) noexcept
+{
+    RealtimeChecker::onBlockingCall("posix_memalign");
+
+    if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) { return 22; /* EINVAL */ }
+
+    auto *q = __libc_memalign(alignment, size);
+    if(q == nullptr && size != 0) { return 12; /* ENOMEM */ }
+
+    *p = q;
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept
+{
+    RealtimeChecker::onBlockingCall("pthread_mutex_lock");
+    return findNext(real_pthread_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock) noexcept
+{
+    RealtimeChecker::onBlockingCall("pthread_rwlock_rdlock");
+    return findNext(real_pthread_rwlock_rdlock, "pthread_rwlock_rdlock")(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock) noexcept
+{
+    RealtimeChecker::onBlockingCall("pthread_rwlock_wrlock");
+    return findNext(real_pthread_rwlock_wrlock, "pthread_rwlock_wrlock")(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    RealtimeChecker::onBlockingCall("pthread_cond_wait");
+    return findNextCond(real_pthread_cond_wait, "pthread_cond_wait")(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, timespec const *abstime)
+{
+    RealtimeChecker::onBlockingCall("pthread_cond_timedwait");
+    return findNextCond(real_pthread_cond_timedwait, "pthread_cond_timedwait")(cond, mutex, abstime);
+}
+
+int sem_wait(sem_t *sem)
+{
+    RealtimeChecker::onBlockingCall("sem_wait");
+    return findNext(real_sem_wait, "sem_wait")(sem);
+}
+
+int nanosleep(timespec const *req, timespec *rem)
+{
+    RealtimeChecker::onBlockingCall("nanosleep");
+    return findNext(real_nanosleep, "nanosleep")(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, timespec const *req, timespec *rem)
+{
+    RealtimeChecker::onBlockingCall("clock_nanosleep");
+    return findNext(real_clock_nanosleep, "clock_nanosleep")(clock, flags, req, rem);
+}
+
+int usleep(useconds_t usec)
+{
+    RealtimeChecker::onBlockingCall("usleep");
+    return findNext(real_usleep, "usleep")(usec);
+}
+
+int sched_yield() noexcept
+{
+    RealtimeChecker::onBlockingCall("sched_yield");
+    return findNext(real_sched_yield, "sched_yield")();
+}
+
+ssize_t read(int fd, void *buf, std::size_t count)
+{
+    RealtimeChecker::onBlockingCall("read");
+    return findNext(real_read, "read")(fd, buf, count);
+}
+
+ssize_t write(int fd, void const *buf, std::size_t count)
+{
+    RealtimeChecker::onBlockingCall("write");
+    return findNext(real_write, "write")(fd, buf, count);
+}
+
+int open(char const *path, int flags, ...)
+{
+    RealtimeChecker::onBlockingCall("open");
+
+    unsigned int mode = 0;
+    if(hasOpenMode(flags)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, unsigned int);
+        va_end(args);
+    }
+
+    return findNext(real_open, "open")(path, flags, mode);
+}
+
+// _FILE_OFFSET_BITS=64 でビルドされたコードや、 glibc 自身の多くの関数はこちらを呼び出す。
+int open64(char const *path, int flags, ...)
+{
+    RealtimeChecker::onBlockingCall("open64");
+
+    unsigned int mode = 0;
+    if(hasOpenMode(flags)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, unsigned int);
+        va_end(args);
+    }
+
+    return findNext(real_open64, "open64")(path, flags, mode);
+}
+
+int openat(int dirfd, char const *path, int flags, ...)
+{
+    RealtimeChecker::onBlockingCall("openat");
+
+    unsigned int mode = 0;
+    if(hasOpenMode(flags)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, unsigned int);
+        va_end(args);
+    }
+
+    return findNext(real_openat, "openat")(dirfd, path, flags, mode);
+}
+
+int openat64(int dirfd, char const *path, int flags, ...)
+{
+    RealtimeChecker::onBlockingCall("openat64");
+
+    unsigned int mode = 0;
+    if(hasOpenMode(flags)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, unsigned int);
+        va_end(args);
+    }
+
+    return findNext(real_openat64, "openat64")(dirfd, path, flags, mode);
+}
+
+// fopen() は glibc の内部でファイルを開くので、 open() の置き換えでは検出できない。
+FILE * fopen(char const *path, char const *mode)
+{
+    RealtimeChecker::onBlockingCall("fopen");
+    return findNext(real_fopen, "fopen")(path, mode);
+}
+
+FILE * fopen64(char const *path, char const *mode)
+{
+    RealtimeChecker::onBlockingCall("fopen64");
+    return findNext(real_fopen64, "fopen64")(path, mode);
+}
+
+int close(int fd)
+{
+    RealtimeChecker::onBlockingCall("close");
+    return findNext(real_close, "close")(fd);
+}
+
+} // extern "C"
+
+#else
+
+void resolveRealFunctions()
+{
+}
+
+#endif
+
+// メモリの確保は malloc() / free() を経由させる。
+// malloc() を置き換えている場合は、そちらで違反を記録するので、ここでは二重に記録しない。
+namespace
+{
+
+void * allocate(std::size_t size)
+{
+#if !defined(SIMPLE_OSCILLOSCOPE_RT_INTERPOSE)
+    RealtimeChecker::onBlockingCall("operator new");
+#endif
+
+    if(auto *p = std::malloc(size != 0 ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void deallocate(void *p) noexcept
+{
+#if !defined(SIMPLE_OSCILLOSCOPE_RT_INTERPOSE)
+    if(p != nullptr) { RealtimeChecker::onBlockingCall("operator delete"); }
+#endif
+
+    std::free(p);
+}
+
+} // namespace
+
+void * operator new(std::size_t size) { return allocate(size); }
+void * operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void *p) noexcept { deallocate(p); }
+void operator delete[](void *p) noexcept { deallocate(p); }
+void operator delete(void *p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void *p, std::size_t) noexcept { deallocate(p); }
+
+// アライメントを指定した new / delete も同じように扱う。
+// glibc では posix_memalign() を経由させるので、置き換えた posix_memalign() で違反が記録される。
+namespace
+{
+
+void * allocateAligned(std::size_t size, std::align_val_t al)
+{
+#if !defined(SIMPLE_OSCILLOSCOPE_RT_INTERPOSE)
+    RealtimeChecker::onBlockingCall("operator new");
+#endif
+
+    auto const alignment = std::max<std::size_t>((std::size_t)al, sizeof(void *));
+#if defined(_MSC_VER)
+    if(auto *p = _aligned_malloc(size != 0 ? size : 1, alignment)) { return p; }
+#else
+    void *p = nullptr;
+    if(posix_memalign(&p, alignment, size != 0 ? size : 1) == 0) { return p; }
+#endif
+    throw std::bad_alloc();
+}
+
+void deallocateAligned(void *p) noexcept
+{
+#if !defined(SIMPLE_OSCILLOSCOPE_RT_INTERPOSE)
+    if(p != nullptr) { RealtimeChecker::onBlockingCall("operator delete"); }
+#endif
+
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+} // namespace
+
+void * operator new(std::size_t size, std::align_val_t al) { return allocateAligned(size, al); }
+void * operator new[](std::size_t size, std::align_val_t al) { return allocateAligned(size, al); }
+void operator delete(void *p, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { deallocateAligned(p); }
@@ -0,0 +1,49 @@
+// SimdKernels の各命令セットの実装がスカラー実装と一致することを確認するコマンドラインツール
+//
+// 実行環境で使用可能な命令セットごとに SimdKernels::verify(is) を呼び出して結果を出力し、
+// 一つでも一致しなければ終了コード 1 で終了する。 ctest から実行される。
+//
+// usage: SimpleOscilloscopeSimdCheck
+
+#include "SimdKernels.h"
+
+#include <cstdio>
+#include <initializer_list>
+
+namespace
+{
+
+char const * getName(SimdKernels::InstructionSet is)
+{
+    switch(is) {
+        case SimdKernels::InstructionSet::kScalar: return "scalar";
+        case SimdKernels::InstructionSet::kSSE2: return "sse2";
+        case SimdKernels::InstructionSet::kAVX2: return "avx2";
+        case SimdKernels::InstructionSet::kNEON: return "neon";
+    }
+
+    return "unknown";
+}
+
+} // namespace
+
+int main()
+{
+    using SimdKernels::InstructionSet;
+
+    int num_failed = 0;
+    for(auto is: { InstructionSet::kSSE2, InstructionSet::kAVX2, InstructionSet::kNEON }) {
+        if(SimdKernels::isAvailable(is) == false) {
+            std::printf("%-6s: not available\n", getName(is));
+            continue;
+        }
+
+        auto const ok = SimdKernels::verify(is);
+        std::printf("%-6s: %s\n", getName(is), ok ? "ok" : "MISMATCH");
+        if(ok == false) { num_failed += 1; }
+    }
+
+    std::printf("active: %s\n", getName(SimdKernels::getActiveInstructionSet()));
+
+    return (num_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,450 @@
+// Processor から GUI 側へのデータの受け渡しを、並行して動かしながら検査するコマンドラインツール
+//
+// 一つのスレッドがオーディオスレッドとして processBlock() を呼び出し続け、
+// 複数のスレッドがエディタの描画スレッドと同じ CaptureReader::update() / updateFrame() でデータを読み込む。
+// 各スレッドの待機時間やブロックの長さは乱数で決め、時折長く停止させて、読み込みが追い越される状況を意図的に作る。
+// 乱数はシードから決まるので、同じシードで同じ操作の順序を再現できる（スレッドの実行の順序までは再現しない）。
+//
+// 入力には、リングバッファ上の通算のサンプル位置を値に埋め込んだ信号を使用する。
+// 読み込んだエフェクト処理前のデータとトリガーで確定したフレームがその位置の値と一致すること、
+// 読み込み位置が失われたサンプル数を除いて連続していることを確認し、一つでも食い違えば終了コード 1 で終了する。
+// 検査できたフレームが少なすぎる場合も、フレームの検査が行われていないものとして終了コード 1 で終了する。
+// あわせて、書き込んでから読み込まれるまでの時間と、読み込み方法ごとの回数を出力する。
+//
+// SIMPLE_OSCILLOSCOPE_TSAN を ON にしてビルドすると、 ThreadSanitizer の下で実行できる。
+//
+// usage: SimpleOscilloscopeStress [--quick] [--seconds <s>] [--readers <n>] [--seed <n>]
+
+#include "PluginProcessor.h"
+#include "CaptureReader.h"
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr double kSampleRate = 48000.0;
+constexpr int kNumChannels = 2;
+//! prepareToPlay() に渡すブロックサイズと、実際に渡すブロックの最大の長さ
+constexpr int kPreparedBlockSize = 512;
+constexpr int kMaxBlockSize = 2048;
+//! オーディオスレッドを実時間の何倍の速さで動かすか
+constexpr double kSpeed = 4.0;
+//! オーディオスレッドが prepareToPlay() を呼び出し直して、 AudioData を作り直す確率 (1 ブロックあたり)
+constexpr double kReprepareProbability = 1.0 / 4000;
+//! 読み込み側が保持するデータの長さ [秒]
+constexpr double kHistorySeconds = 1.0;
+
+//! サンプル値に埋め込む位置のビット数。 float で正確に表せ、かつ周期がリングバッファの容量 (kMaxFrameSeconds の 2 倍) より長くなるようにする。
+constexpr int kStampBits = 20;
+//! トリガーの検出に使用するチャンネル 0 に埋め込む位置のビット数
+/*! チャンネル 0 は周期の短いのこぎり波にして、フレームが頻繁に確定するようにする。
+ *  位置を一意に表すのは他のチャンネルの値で、すべてのチャンネルを同じ位置で比べるので、位置のずれは検出できる。
+ */
+constexpr int kTriggerStampBits = 13;
+//! チャンネルごとに値をずらして、チャンネルの取り違えも検出する。
+constexpr std::int64_t kChannelOffset = 7919;
+//! トリガーで確定させるフレームの長さ。のこぎり波の 1 周期に 1 回確定する。
+constexpr std::int64_t kFrameLength = 4096;
+//! 読み込みスレッドごとに、少なくとも検査しなければならないフレームの数
+constexpr std::int64_t kMinVerifiedFrames = 5;
+
+static_assert(kNumChannels >= 2, "the position is stamped in the channels other than the trigger channel");
+static_assert((std::int64_t(1) << kStampBits) > kSampleRate * AudioPluginAudioProcessor::kMaxFrameSeconds * 2,
+              "the stamp period must be longer than the ring buffer");
+static_assert((std::int64_t(1) << kTriggerStampBits) > kFrameLength,
+              "a frame must end before the next trigger");
+
+//! 報告する食い違いの最大数
+constexpr int kMaxReportedErrors = 20;
+
+struct Options
+{
+    double seconds = 10.0;
+    int num_readers = 3;
+    std::uint32_t seed = 1;
+};
+
+void printUsage(char const *app)
+{
+    std::fprintf(stderr, "usage: %s [--quick] [--seconds <s>] [--readers <n>] [--seed <n>]\n", app);
+}
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+
+        if(arg == "--quick") {
+            opts.seconds = 2.0;
+        } else if(arg == "--seconds" && i + 1 < argc) {
+            opts.seconds = std::atof(argv[++i]);
+        } else if(arg == "--readers" && i + 1 < argc) {
+            opts.num_readers = std::atoi(argv[++i]);
+        } else if(arg == "--seed" && i + 1 < argc) {
+            opts.seed = (std::uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+
+    return opts.seconds > 0 && opts.num_readers > 0;
+}
+
+//! チャンネル ch に埋め込む位置のビット数
+int getStampBits(int ch)
+{
+    return (ch == 0) ? kTriggerStampBits : kStampBits;
+}
+
+//! リングバッファ上の通算のサンプル位置 position に、チャンネル ch が持つべき値 (0.0 .. 0.5)
+/*! 0.0 .. 0.5 の範囲なので、フィルタやクリップを通っても処理前のデータは変わらない。
+ */
+float stamp(std::int64_t position, int ch)
+{
+    auto const bits = getStampBits(ch);
+    auto const mask = (std::int64_t(1) << bits) - 1;
+    return (float)((position + ch * kChannelOffset) & mask) / (float)(std::int64_t(1) << (bits + 1));
+}
+
+//! チャンネル ch の値 value に埋め込まれた位置を返す。食い違いの報告に使用する。
+long long decodeStamp(float value, int ch)
+{
+    return (long long)(value * (float)(std::int64_t(1) << (getStampBits(ch) + 1)));
+}
+
+//! 検査の失敗を数え、最初のいくつかを出力する。
+struct ErrorLog
+{
+    void report(char const *format, int reader, long long a, long long b, long long c)
+    {
+        auto const n = num_errors_.fetch_add(1);
+        if(n >= kMaxReportedErrors) { return; }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fprintf(stderr, "reader %d: ", reader);
+        std::fprintf(stderr, format, a, b, c);
+        std::fprintf(stderr, "\n");
+    }
+
+    std::int64_t getNumErrors() const { return num_errors_.load(); }
+
+private:
+    std::atomic<std::int64_t> num_errors_ { 0 };
+    std::mutex mutex_;
+};
+
+//! オーディオスレッドが書き込みを終えた時刻の記録
+/*! 読み込み側は、読み込んだ末尾の位置を書き込んだブロックの時刻から、受け渡しにかかった時間を求める。
+ */
+struct PublishLog
+{
+    static constexpr int kSize = 1 << 16;
+
+    struct Entry
+    {
+        std::atomic<AudioData const *> audio_data { nullptr };
+        std::atomic<std::int64_t> end { 0 };
+        std::atomic<std::int64_t> time { 0 };
+    };
+
+    void record(AudioData const *audio_data, std::int64_t end, std::int64_t time)
+    {
+        auto const index = num_entries_.load(std::memory_order_relaxed);
+        auto &entry = entries_[(size_t)(index % kSize)];
+        entry.audio_data.store(audio_data, std::memory_order_relaxed);
+        entry.end.store(end, std::memory_order_relaxed);
+        entry.time.store(time, std::memory_order_relaxed);
+        num_entries_.store(index + 1, std::memory_order_release);
+    }
+
+    //! audio_data の位置 end までを書き込んだ時刻を、 next 番目以降の記録から探す。
+    /*! next は見つかった記録の次の番号に進む。見つからなかった場合は -1 を返す。
+     */
+    std::int64_t findTime(AudioData const *audio_data, std::int64_t end, std::int64_t &next) const
+    {
+        auto const num_entries = num_entries_.load(std::memory_order_acquire);
+        next = std::max(next, num_entries - kSize / 2);
+
+        for( ; next < num_entries; ++next) {
+            auto const &entry = entries_[(size_t)(next % kSize)];
+            if(entry.audio_data.load(std::memory_order_relaxed) != audio_data) { continue; }
+
+            auto const entry_end = entry.end.load(std::memory_order_relaxed);
+            if(entry_end > end) { return -1; }
+            if(entry_end == end) {
+                ++next;
+                return entry.time.load(std::memory_order_relaxed);
+            }
+        }
+
+        return -1;
+    }
+
+private:
+    std::array<Entry, kSize> entries_;
+    std::atomic<std::int64_t> num_entries_ { 0 };
+};
+
+//! 読み込みスレッドごとの集計
+struct ReaderResult
+{
+    CaptureReader::ReadStats read_stats;
+    std::int64_t num_updates = 0;
+    std::int64_t num_overruns = 0;
+    std::int64_t num_dropped = 0;
+    std::int64_t num_verified_samples = 0;
+    std::int64_t num_verified_frames = 0;
+};
+
+//! 乱数で決めた時間だけ停止する。時折長く停止して、書き込み側に追い越される状況を作る。
+void injectPreemption(std::mt19937 &rng, double stall_probability, int max_stall_ms)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    auto const r = uniform(rng);
+
+    if(r < stall_probability) {
+        std::uniform_int_distribution<int> stall_ms(max_stall_ms / 4, max_stall_ms);
+        std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms(rng)));
+    } else if(r < 0.2) {
+        std::this_thread::yield();
+    } else {
+        std::uniform_int_distribution<int> sleep_us(0, 2000);
+        std::this_thread::sleep_for(std::chrono::microseconds(sleep_us(rng)));
+    }
+}
+
+//! reader が直前の update() で読み込んだデータと、確定したフレームを検査する。
+void runReader(int index, Options const &opts, AudioPluginAudioProcessor &processor, PublishLog const &publish_log,
+               std::atomic<bool> const &stop, LogHistogram &latency, ErrorLog &errors, ReaderResult &result)
+{
+    std::mt19937 rng(opts.seed * 7919u + (std::uint32_t)index + 1);
+    CaptureReader capture_reader(kHistorySeconds);
+
+    AudioData const *audio_data = nullptr;
+    std::int64_t prev_end = -1;
+    std::int64_t prev_dropped = 0;
+    std::int64_t prev_invalidated = 0;
+    std::int64_t next_entry = 0;
+    std::vector<float> samples((size_t)(kSampleRate * kHistorySeconds));
+
+    while(stop.load() == false) {
+        auto const num_read = capture_reader.update(processor.getAudioData(), kSampleRate);
+        auto const now = ProcessorTelemetry::now();
+        result.num_updates += 1;
+
+        // AudioData が作り直された場合は、新しい AudioData の位置から検査し直す。
+        if(capture_reader.getAudioData() != audio_data) {
+            audio_data = capture_reader.getAudioData();
+            prev_end = -1;
+            prev_dropped = capture_reader.getReader().getNumDropped();
+            next_entry = 0;
+        }
+
+        auto const &reader = capture_reader.getReader();
+        auto const end = reader.getPosition();
+        auto const start = end - num_read;
+        auto const dropped = reader.getNumDropped() - prev_dropped;
+        auto const invalidated = capture_reader.getReadStats().num_invalidated != prev_invalidated;
+        prev_dropped = reader.getNumDropped();
+        prev_invalidated = capture_reader.getReadStats().num_invalidated;
+
+        // 読み込み位置は、失われたサンプル数を除いて前回の末尾から続いていること。
+        if(prev_end >= 0 && start != prev_end + dropped && invalidated == false) {
+            errors.report("discontinuity: previous end %lld, dropped %lld, start %lld", index, prev_end, dropped, start);
+        }
+        prev_end = end;
+
+        // 追い越された場合は、読み込んだ範囲が無音に置き換えられているので検査しない。
+        if(num_read > 0 && invalidated == false) {
+            for(int ch = 0; ch < kNumChannels; ++ch) {
+                auto const &pyramid = capture_reader.getPyramid(ch);
+                if(pyramid.getSamples(pyramid.getNumPushed() - num_read, num_read, samples.data()) == false) {
+                    errors.report("samples not retained: channel %lld, start %lld, length %lld", index, ch, start, num_read);
+                    continue;
+                }
+
+                for(std::int64_t i = 0; i < num_read; ++i) {
+                    if(samples[(size_t)i] != stamp(start + i, ch)) {
+                        errors.report("sample mismatch: channel %lld, position %lld, stamp %lld", index, ch, start + i,
+                                      decodeStamp(samples[(size_t)i], ch));
+                        break;
+                    }
+                }
+            }
+
+            result.num_verified_samples += num_read;
+
+            auto const time = publish_log.findTime(audio_data, end, next_entry);
+            if(time >= 0) {
+                latency.record(now - time);
+            }
+        }
+
+        if(capture_reader.updateFrame() && capture_reader.hasFrame()) {
+            auto const &frame = capture_reader.getFrame();
+            for(int ch = 0; ch < kNumChannels; ++ch) {
+                if(capture_reader.getFramePyramid(ch).getSamples(0, frame.length, samples.data()) == false) {
+                    errors.report("frame not retained: channel %lld, start %lld, length %lld", index, ch, frame.start, frame.length);
+                    continue;
+                }
+
+                for(std::int64_t i = 0; i < frame.length; ++i) {
+                    if(samples[(size_t)i] != stamp(frame.start + i, ch)) {
+                        errors.report("frame mismatch: channel %lld, frame start %lld, offset %lld", index, ch, frame.start, i);
+                        break;
+                    }
+                }
+            }
+
+            result.num_verified_frames += 1;
+        }
+
+        injectPreemption(rng, 0.01, 300);
+    }
+
+    result.read_stats = capture_reader.getReadStats();
+    result.num_overruns = capture_reader.getReader().getNumOverruns();
+    result.num_dropped = capture_reader.getReader().getNumDropped();
+}
+
+//! オーディオスレッドとして、位置を埋め込んだ信号で processBlock() を呼び出し続ける。
+/*! @return processBlock() を呼び出した回数
+ */
+std::int64_t runAudio(Options const &opts, AudioPluginAudioProcessor &processor, PublishLog &publish_log,
+                      std::atomic<bool> const &stop, std::int64_t &num_reprepared)
+{
+    std::mt19937 rng(opts.seed);
+    std::uniform_int_distribution<int> block_length(1, kMaxBlockSize);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    juce::AudioSampleBuffer buffer(kNumChannels, kMaxBlockSize);
+    juce::MidiBuffer midi;
+
+    auto const start_time = std::chrono::steady_clock::now();
+    std::int64_t total_samples = 0;
+    std::int64_t position = 0;
+    std::int64_t num_blocks = 0;
+
+    while(stop.load() == false) {
+        // ホストがオーディオを止めて prepareToPlay() を呼び出し直した場合と同じく、 AudioData が作り直される。
+        if(uniform(rng) < kReprepareProbability) {
+            processor.releaseResources();
+            processor.prepareToPlay(kSampleRate, kPreparedBlockSize);
+            position = 0;
+            num_reprepared += 1;
+        }
+
+        // メモリを確保しないように、ブロックの長さは確保済みの範囲で変更する。
+        auto const length = block_length(rng);
+        buffer.setSize(kNumChannels, length, false, false, true);
+        for(int ch = 0; ch < kNumChannels; ++ch) {
+            auto *dest = buffer.getWritePointer(ch);
+            for(int i = 0; i < length; ++i) {
+                dest[i] = stamp(position + i, ch);
+            }
+        }
+
+        processor.processBlock(buffer, midi);
+        position += length;
+        total_samples += length;
+        num_blocks += 1;
+
+        publish_log.record(processor.getAudioData().get(), position, ProcessorTelemetry::now());
+
+        // 平均して kSpeed 倍の速さになるように待機し、その上で乱数で決めた時間だけ停止する。
+        auto const due = start_time + std::chrono::duration<double>(total_samples / (kSampleRate * kSpeed));
+        std::this_thread::sleep_until(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(due));
+        injectPreemption(rng, 0.001, 20);
+    }
+
+    return num_blocks;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if(parseOptions(argc, argv, opts) == false) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    AudioPluginAudioProcessor processor;
+    processor.setPlayConfigDetails(kNumChannels, kNumChannels, kSampleRate, kPreparedBlockSize);
+    processor.prepareToPlay(kSampleRate, kPreparedBlockSize);
+
+    // チャンネル 0 は 2^kTriggerStampBits サンプル周期ののこぎり波になるので、周期ごとに立ち上がりでトリガーがかかる。
+    auto &trigger = processor.getTriggerEngine();
+    trigger.setMode(TriggerEngine::Mode::kRising);
+    trigger.setSource(0);
+    trigger.setLevel(0.25f);
+    trigger.setFrameLength(kFrameLength);
+
+    auto publish_log = std::make_unique<PublishLog>();
+    LogHistogram latency;
+    ErrorLog errors;
+    std::atomic<bool> stop { false };
+
+    std::vector<ReaderResult> results((size_t)opts.num_readers);
+    std::vector<std::thread> readers;
+    for(int i = 0; i < opts.num_readers; ++i) {
+        readers.emplace_back([&, i] {
+            runReader(i, opts, processor, *publish_log, stop, latency, errors, results[(size_t)i]);
+        });
+    }
+
+    std::int64_t num_blocks = 0;
+    std::int64_t num_reprepared = 0;
+    std::thread audio([&] {
+        num_blocks = runAudio(opts, processor, *publish_log, stop, num_reprepared);
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(opts.seconds));
+    stop.store(true);
+    audio.join();
+    for(auto &reader : readers) { reader.join(); }
+
+    std::printf("seed: %u, blocks: %lld, reprepared: %lld\n", opts.seed, (long long)num_blocks, (long long)num_reprepared);
+
+    for(int i = 0; i < opts.num_readers; ++i) {
+        auto const &r = results[(size_t)i];
+        std::printf("reader %d: updates %lld  direct %lld  copied %lld  invalidated %lld  overruns %lld  dropped %lld  "
+                    "verified samples %lld  frames %lld\n",
+                    i, (long long)r.num_updates,
+                    (long long)r.read_stats.num_direct, (long long)r.read_stats.num_copied,
+                    (long long)r.read_stats.num_invalidated, (long long)r.num_overruns, (long long)r.num_dropped,
+                    (long long)r.num_verified_samples, (long long)r.num_verified_frames);
+    }
+
+    auto const snapshot = latency.getSnapshot();
+    std::printf("handoff latency [us]: mean %.1f  p50 %.1f  p99 %.1f  max %.1f  (%lld samples)\n",
+                snapshot.getMean() / 1000.0, snapshot.getPercentile(0.5) / 1000.0,
+                snapshot.getPercentile(0.99) / 1000.0, snapshot.max / 1000.0, (long long)snapshot.count);
+
+    // フレームの検査がほとんど行われないまま成功としないように、各読み込みスレッドが検査したフレームの数も確認する。
+    for(int i = 0; i < opts.num_readers; ++i) {
+        auto const &r = results[(size_t)i];
+        if(r.num_verified_frames < kMinVerifiedFrames) {
+            errors.report("too few frames verified: %lld (minimum %lld) in %lld updates", i,
+                          r.num_verified_frames, kMinVerifiedFrames, r.num_updates);
+        }
+    }
+
+    auto const num_errors = errors.getNumErrors();
+    std::printf("%s (%lld errors)\n", num_errors == 0 ? "handoff verified" : "handoff errors found", (long long)num_errors);
+    return num_errors == 0 ? 0 : 1;
+}